@@ -0,0 +1,145 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Local APIC and IOAPIC interrupt controller
+ */
+#ifndef APIC_H
+#define APIC_H
+
+#include <spede/machine/asmacros.h>
+
+// Set to 0 (e.g. EXTRA_CFLAGS += -DAPIC_ENABLE=0) to always use the 8259 PIC
+#ifndef APIC_ENABLE
+#define APIC_ENABLE 1
+#endif
+
+// Local APIC timer modes
+#define APIC_TIMER_PERIODIC     0   // Fixed-rate countdown, calibrated against the PIT
+#define APIC_TIMER_TSC_DEADLINE 1   // Re-armed every tick against the TSC
+
+#ifndef APIC_TIMER_MODE
+#define APIC_TIMER_MODE APIC_TIMER_PERIODIC
+#endif
+
+// Vector used for spurious local APIC interrupts (low nibble must be 0xf)
+#define IRQ_APIC_SPURIOUS   0xef
+
+// Vector the APIC delivers an ISA IRQ on at the given priority
+// The local APIC ranks vectors by their upper nibble, so each IRQ priority
+// gets its own block of 16 vectors (IRQ_PRIORITY_NONE keeps 0x20 + IRQ)
+#define APIC_IRQ_VECTOR(irq, priority) (0x20 + 0x10 * (priority) + ((irq) & 0xf))
+
+#ifndef ASSEMBLER
+/**
+ * Detects and enables the local APIC and IOAPIC
+ * If found, the 8259 PIC is masked and all IRQ operations go through the APIC
+ * @return 0 if the APIC is in use, -1 if the PIC remains in use
+ */
+int apic_init(void);
+
+/**
+ * Indicates if interrupts are being delivered through the APIC
+ * @return 1 if the APIC is in use, 0 if the PIC is in use
+ */
+int apic_enabled(void);
+
+/**
+ * Enables the specified IRQ
+ * IRQ 0 is the local APIC timer, all others are routed through the IOAPIC
+ * @param irq - IRQ number
+ */
+void apic_irq_enable(int irq);
+
+/**
+ * Disables the specified IRQ
+ * @param irq - IRQ number
+ */
+void apic_irq_disable(int irq);
+
+/**
+ * Dismisses the current IRQ with a single write to the EOI register
+ * @param irq - IRQ number
+ */
+void apic_irq_dismiss(int irq);
+
+/**
+ * Returns the mask of disabled IRQs
+ * @return - IRQ mask (bit n set if IRQ n is disabled)
+ */
+unsigned int apic_mask_get(void);
+
+/**
+ * Sets the mask of disabled IRQs
+ * @param mask - IRQ mask (bit n set if IRQ n is disabled)
+ */
+void apic_mask_set(unsigned int mask);
+
+/**
+ * Moves an IRQ to the vector block of its priority
+ * @param irq - IRQ number
+ * @param priority - IRQ_PRIORITY_NONE or a higher priority level
+ */
+void apic_irq_priority_set(int irq, int priority);
+
+/**
+ * Raises the task priority of the calling CPU's local APIC so only IRQs of
+ * a higher priority are delivered; the others stay pending in the local
+ * APIC until the task priority is restored
+ * @param priority - priority of the IRQ being handled
+ * @return the previous task priority
+ */
+unsigned int apic_priority_raise(int priority);
+
+/**
+ * Restores the task priority returned by apic_priority_raise()
+ * @param tpr - the previous task priority
+ */
+void apic_priority_restore(unsigned int tpr);
+
+/**
+ * Returns the local APIC id of the calling CPU
+ * @return local APIC id
+ */
+int apic_id(void);
+
+/**
+ * Returns the number of enabled CPUs described by ACPI
+ * @return number of CPUs (including the bootstrap CPU)
+ */
+int apic_cpu_count(void);
+
+/**
+ * Returns the local APIC id of the given CPU described by ACPI
+ * @param n - CPU index (0 to apic_cpu_count()-1)
+ * @return local APIC id or -1 on error
+ */
+int apic_cpu_apic_id(int n);
+
+/**
+ * Sends an INIT IPI followed by two startup IPIs to the given CPU
+ * @param apic_id - local APIC id of the target CPU
+ * @param addr - physical address of the startup code (page aligned, below 1MB)
+ */
+void apic_cpu_start(int apic_id, unsigned int addr);
+
+/**
+ * Enables the local APIC and its timer on an application processor
+ * Uses the calibration done by apic_timer_start() on the bootstrap CPU
+ */
+void apic_ap_init(void);
+
+/**
+ * Starts the local APIC timer on IRQ 0 at the given rate
+ * @param hz - number of timer interrupts per second
+ * @return 0 on success, -1 on error
+ */
+int apic_timer_start(int hz);
+
+__BEGIN_DECLS
+
+extern void isr_entry_apic_spurious();
+
+__END_DECLS
+#endif
+#endif
@@ -0,0 +1,66 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * User heap arenas (allocator library for user programs)
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+// Size classes: 16, 32, ... ARENA_SMALL_MAX bytes; larger blocks are cut
+// to size and reused first fit once freed
+#define ARENA_SMALL_MIN 16
+#define ARENA_SMALL_MAX 2048
+#define ARENA_CLASSES   8
+
+// Heap memory is taken from the kernel (sbrk) in chunks of at least this size
+#ifndef ARENA_CHUNK_SIZE
+#define ARENA_CHUNK_SIZE 16384
+#endif
+
+// Arena
+// Lives in the heap of the process that created it, so every process has
+// free lists of its own and nothing needs to be locked
+typedef struct arena_t {
+    void *free[ARENA_CLASSES];          // Free blocks of each size class
+    void *large;                        // Free blocks larger than ARENA_SMALL_MAX
+    struct arena_chunk_t *chunks;       // Heap memory taken from the kernel, oldest first
+    struct arena_chunk_t *current;      // Chunk new blocks are cut from
+    char *next;                         // First unused byte of the current chunk
+    char *limit;                        // End of the current chunk
+
+    unsigned int in_use;                // Bytes allocated (including block headers)
+    unsigned int heap;                  // Bytes of heap memory held by the arena
+} arena_t;
+
+/**
+ * Creates an arena in the heap of the current process
+ * @return pointer to the arena, NULL if the heap can't grow
+ */
+arena_t *arena_create(void);
+
+/**
+ * Allocates memory from an arena
+ * The memory is 8 byte aligned and not cleared
+ * @param arena - the arena
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if the heap can't grow
+ */
+void *arena_alloc(arena_t *arena, unsigned int size);
+
+/**
+ * Returns memory to its arena
+ * @param arena - the arena the memory was allocated from
+ * @param ptr - pointer to the memory (NULL is ignored)
+ * @return 0 on success, -1 on error (e.g. a double free)
+ */
+int arena_free(arena_t *arena, void *ptr);
+
+/**
+ * Frees everything allocated from an arena at once
+ * The arena keeps its heap memory, so refilling it doesn't call the kernel
+ * @param arena - the arena
+ */
+void arena_reset(arena_t *arena);
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel micro-benchmarks
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+// Number of bytes moved through the ring buffer for each transfer size
+#ifndef BENCH_RINGBUF_BYTES
+#define BENCH_RINGBUF_BYTES (1024 * 1024)
+#endif
+
+// Number of operations timed for each bit/bitmap function
+#ifndef BENCH_BIT_OPS
+#define BENCH_BIT_OPS 100000
+#endif
+
+/**
+ * Compares the byte-at-a-time and bulk-copy ring buffer transfers
+ * Runs as a kernel process; results are printed to the host console
+ */
+void bench_ringbuf(void);
+
+/**
+ * Compares the recursive/bit-at-a-time bit helpers with the word-at-a-time
+ * bit and bitmap functions
+ * Runs as a kernel process; results are printed to the host console
+ */
+void bench_bit(void);
+
+#endif
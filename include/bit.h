@@ -43,4 +43,45 @@ unsigned int bit_clear(unsigned int value, int bit);
  */
 unsigned int bit_toggle(unsigned int value, int bit);
 
+/**
+ * Finds the lowest set bit (bsf)
+ * @param value - the integer value to search
+ * @return bit number, -1 if no bits are set
+ */
+static inline int bit_ffs(unsigned int value) {
+    int bit;
+
+    if (!value) {
+        return -1;
+    }
+
+    asm("bsfl %1, %0" : "=r"(bit) : "rm"(value));
+    return bit;
+}
+
+/**
+ * Finds the highest set bit (bsr)
+ * @param value - the integer value to search
+ * @return bit number, -1 if no bits are set
+ */
+static inline int bit_fls(unsigned int value) {
+    int bit;
+
+    if (!value) {
+        return -1;
+    }
+
+    asm("bsrl %1, %0" : "=r"(bit) : "rm"(value));
+    return bit;
+}
+
+/**
+ * Finds the lowest clear bit
+ * @param value - the integer value to search
+ * @return bit number, -1 if every bit is set
+ */
+static inline int bit_ffz(unsigned int value) {
+    return bit_ffs(~value);
+}
+
 #endif
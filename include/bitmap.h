@@ -0,0 +1,120 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Multi-word bitmaps
+ */
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include "bit.h"
+
+// Number of 32-bit words needed to hold the given number of bits
+#define BITMAP_WORDS(bits) (((bits) + 31) / 32)
+
+/**
+ * Iterates over every set bit in a bitmap, lowest first
+ * @param bit - int variable that holds each set bit number
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ */
+#define bitmap_for_each(bit, map, bits) \
+    for ((bit) = bitmap_next_set((map), (bits), 0); \
+         (bit) >= 0; \
+         (bit) = bitmap_next_set((map), (bits), (bit) + 1))
+
+/**
+ * Checks if the given bit is set
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to check
+ * @return 1 if set, 0 if not set
+ */
+static inline int bitmap_test(unsigned int *map, int bit) {
+    return (map[bit / 32] >> (bit % 32)) & 1;
+}
+
+/**
+ * Sets the given bit
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to set
+ */
+static inline void bitmap_set(unsigned int *map, int bit) {
+    map[bit / 32] |= 1U << (bit % 32);
+}
+
+/**
+ * Clears the given bit
+ * @param map - pointer to the bitmap words
+ * @param bit - which bit to clear
+ */
+static inline void bitmap_clear(unsigned int *map, int bit) {
+    map[bit / 32] &= ~(1U << (bit % 32));
+}
+
+/**
+ * Sets a range of bits
+ * @param map - pointer to the bitmap words
+ * @param start - first bit to set
+ * @param count - number of bits to set
+ */
+void bitmap_set_range(unsigned int *map, int start, int count);
+
+/**
+ * Clears a range of bits
+ * @param map - pointer to the bitmap words
+ * @param start - first bit to clear
+ * @param count - number of bits to clear
+ */
+void bitmap_clear_range(unsigned int *map, int start, int count);
+
+/**
+ * Counts the number of bits that are set
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return number of bits that are set
+ */
+int bitmap_count(unsigned int *map, int bits);
+
+/**
+ * Finds the next set bit at or after the given bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @param start - first bit to look at
+ * @return bit number, -1 if there are no more set bits
+ */
+int bitmap_next_set(unsigned int *map, int bits, int start);
+
+/**
+ * Finds the next clear bit at or after the given bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @param start - first bit to look at
+ * @return bit number, -1 if there are no more clear bits
+ */
+int bitmap_next_clear(unsigned int *map, int bits, int start);
+
+/**
+ * Finds the lowest set bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return bit number, -1 if no bits are set
+ */
+int bitmap_first_set(unsigned int *map, int bits);
+
+/**
+ * Finds the lowest clear bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return bit number, -1 if every bit is set
+ */
+int bitmap_first_clear(unsigned int *map, int bits);
+
+/**
+ * Finds the highest set bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return bit number, -1 if no bits are set
+ */
+int bitmap_last_set(unsigned int *map, int bits);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Monotonic clock based on the CPU time-stamp counter
+ */
+#ifndef CLOCK_H
+#define CLOCK_H
+
+// Length of the TSC calibration against the PIT (at most 54ms)
+#ifndef CLOCK_CALIBRATE_MS
+#define CLOCK_CALIBRATE_MS 50
+#endif
+
+/**
+ * Calibrates the time-stamp counter against the PIT and starts the clock
+ * Must run before any other clock function is used
+ */
+void clock_init(void);
+
+/**
+ * Returns the number of nanoseconds since clock_init()
+ * The clock is 64-bit and never goes backwards
+ * @return nanoseconds since boot
+ */
+unsigned long long clock_now_ns(void);
+
+/**
+ * Converts a number of TSC cycles to nanoseconds
+ * @param cycles - number of TSC cycles
+ * @return nanoseconds
+ */
+unsigned long long clock_cycles_to_ns(unsigned long long cycles);
+
+/**
+ * Returns the calibrated TSC frequency
+ * @return TSC cycles per millisecond
+ */
+unsigned int clock_tsc_khz(void);
+
+/**
+ * Starts a one-shot countdown on PIT channel 2, the reference the TSC and
+ * the local APIC timer are calibrated against
+ * @param ms - length of the countdown in milliseconds (at most 54)
+ */
+void clock_pit_start(unsigned int ms);
+
+/**
+ * Busy waits until the countdown started by clock_pit_start() expires
+ */
+void clock_pit_wait(void);
+
+/**
+ * Busy waits for the given number of microseconds
+ * @param us - number of microseconds
+ */
+void udelay(unsigned int us);
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Bitmap ID allocator
+ */
+#ifndef IDMAP_H
+#define IDMAP_H
+
+// Largest number of ids a single allocator can manage
+#ifndef IDMAP_MAX
+#define IDMAP_MAX 256
+#endif
+
+#define IDMAP_WORDS ((IDMAP_MAX + 31) / 32)
+
+// One bit per id; a set bit means the id is allocated
+typedef struct idmap_t {
+    int size;                       // Number of ids (0 .. size - 1)
+    int used;                       // Number of ids allocated
+    unsigned int bits[IDMAP_WORDS]; // Allocation bitmap
+} idmap_t;
+
+/**
+ * Initializes an allocator with every id free
+ * @param map - pointer to the allocator
+ * @param size - number of ids to manage (at most IDMAP_MAX)
+ * @return -1 on error, 0 on success
+ */
+int idmap_init(idmap_t *map, int size);
+
+/**
+ * Allocates the lowest free id
+ * @param map - pointer to the allocator
+ * @return -1 if every id is in use, otherwise the allocated id
+ */
+int idmap_alloc(idmap_t *map);
+
+/**
+ * Frees an id
+ * @param map - pointer to the allocator
+ * @param id - the id to free
+ * @return -1 if the id is out of range or not allocated, 0 on success
+ */
+int idmap_free(idmap_t *map, int id);
+
+/**
+ * Indicates if an id is allocated
+ * @param map - pointer to the allocator
+ * @param id - the id to check
+ * @return 1 if allocated, 0 if free or out of range
+ */
+int idmap_test(idmap_t *map, int id);
+
+#endif
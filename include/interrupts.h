@@ -10,12 +10,32 @@
 #include <spede/machine/asmacros.h>
 
 // IRQ Definitions
+#define IRQ_PAGE_FAULT 0x0e     // Page fault exception
 #define IRQ_TIMER    0x20       // PIC IRQ 0 (Timer)
 #define IRQ_KEYBOARD 0x21       // PIC IRQ 1 (Keyboard)
 #define IRQ_SYSCALL  0x80       // System call IRQ
 
+// IRQ priorities
+// IRQs at IRQ_PRIORITY_NONE are handled with interrupts disabled.
+// Handlers for IRQs with a higher priority run with interrupts enabled
+// and may only be preempted by IRQs with a strictly higher priority.
+// Since they may interrupt softirqs and lower-priority handlers halfway
+// through an update, they must not touch the process table, the
+// allocators, the run queues or the timers; they should only fill ring
+// buffers and raise a softirq for anything else.
+#define IRQ_PRIORITY_NONE   0
+#define IRQ_PRIORITY_LOW    1
+#define IRQ_PRIORITY_HIGH   2
+
+// Maximum number of handlers that may share a single vector
+#ifndef IRQ_HANDLERS_MAX
+#define IRQ_HANDLERS_MAX    4
+#endif
+
 
 #ifndef ASSEMBLER
+#include "syscall_common.h"
+
 /**
  * General interrupt enablement
  */
@@ -31,8 +51,30 @@ void interrupts_enable(void);
  */
 void interrupts_disable(void);
 
+/**
+ * Disables interrupts with the CPU and returns the previous state
+ * Used around short critical sections that may run with interrupts enabled
+ * @return - the previous EFLAGS value
+ */
+unsigned int interrupts_save_disable(void);
+
+/**
+ * Restores the interrupt state returned by interrupts_save_disable()
+ * @param flags - the previous EFLAGS value
+ */
+void interrupts_restore(unsigned int flags);
+
+/**
+ * Sets the priority of the specified IRQ
+ * @param irq - IRQ number
+ * @param priority - IRQ_PRIORITY_NONE or a higher priority level
+ */
+void interrupts_irq_priority_set(int irq, int priority);
+
 /**
  * Registers an ISR in the IDT and IRQ handler for processing interrupts
+ * Several handlers may be registered for the same IRQ; all of them are
+ * called, in registration order, each time the IRQ occurs
  * @param irq - IRQ number
  * @param entry - function pointer to be registered in the IDT
  * @param handler - function pointer to be called when the specified IRQ occurs
@@ -45,6 +87,19 @@ void interrupts_irq_register(int irq, void (*entry)(), void (*handler)());
  */
 void interrupts_irq_handler(int irq);
 
+/**
+ * Gets the statistics for the specified IRQ
+ * @param irq - IRQ number
+ * @param stats - pointer to the structure to copy the statistics to
+ * @return 0 on success, -1 on error
+ */
+int interrupts_irq_stats_get(int irq, irq_stats_t *stats);
+
+/**
+ * Prints the statistics of every IRQ that has occurred to the host console
+ */
+void interrupts_stats_dump(void);
+
 /**
  * Enables the specified IRQ in the PIC
  * @param irq - IRQ number
@@ -64,6 +119,18 @@ void pic_irq_disable(int irq);
  */
 int pic_irq_enabled(int irq);
 
+/**
+ * Reads the combined mask of both PICs
+ * @return - IRQ mask (bit n set if IRQ n is disabled)
+ */
+unsigned int pic_mask_get(void);
+
+/**
+ * Writes the combined mask of both PICs
+ * @param mask - IRQ mask (bit n set if IRQ n is disabled)
+ */
+void pic_mask_set(unsigned int mask);
+
 /**
  * Dismisses the specified IRQ in the PIC
  * @param irq - IRQ number
@@ -76,6 +143,7 @@ __BEGIN_DECLS
 extern void isr_entry_timer();
 extern void isr_entry_keyboard();
 extern void isr_entry_syscall();
+extern void isr_entry_page_fault();
 
 __END_DECLS
 #endif
@@ -13,6 +13,7 @@
 
 #ifndef ASSEMBLER
 #include "kproc.h"
+#include "smp.h"
 #include <spede/machine/asmacros.h>
 
 #ifndef OS_NAME
@@ -30,8 +31,18 @@ typedef enum log_level {
     KERNEL_LOG_LEVEL_ALL    // Log everything!
 } log_level_t;
 
-//global pointer to the current active process.
-extern proc_t *active_proc;
+//pointer to the process running on the calling CPU.
+#define active_proc (smp_cpu()->current)
+
+/**
+ * Reads the CPU time-stamp counter
+ * @return number of CPU cycles since reset
+ */
+static inline unsigned long long kernel_rdtsc(void) {
+    unsigned int lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
 
 /**
  * Kernel initialization
@@ -118,8 +129,31 @@ void kernel_break(void);
  */
 void kernel_exit(void);
 
+// Number of interrupt levels currently being handled by the calling CPU
+// 0 when a process is running; checked by kernel_stack_get
+#define kernel_irq_depth (smp_cpu()->irq_depth)
+
+/**
+ * Returns the top of the kernel stack to switch to on kernel entry
+ * Called from kernel_enter (context.S) on the interrupted stack
+ * @return stack pointer, or 0 if the kernel itself was interrupted
+ */
+unsigned int kernel_stack_get(void);
+
+/**
+ * Kernel entry point for interrupts that occur while a process is running
+ * Handles the interrupt, runs deferred work and schedules the next process
+ * @param trapframe - pointer to the trapframe of the interrupted process
+ */
 void kernel_context_enter(trapframe_t *trapframe);
 
+/**
+ * Kernel entry point for interrupts that occur while the kernel is running
+ * Handles the interrupt and returns to the interrupted kernel code
+ * @param trapframe - pointer to the trapframe of the interrupted kernel code
+ */
+void kernel_context_enter_nested(trapframe_t *trapframe);
+
 //Following functions are written irectly in assembly.
 __BEGIN_DECLS
 //Exits the kernel context, restoring the process.
@@ -0,0 +1,111 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel object caches (slab allocator) and kmalloc
+ */
+#ifndef KMEM_H
+#define KMEM_H
+
+// Maximum number of caches, including the kmalloc size classes
+#ifndef KMEM_CACHES_MAX
+#define KMEM_CACHES_MAX 32
+#endif
+
+#define KMEM_NAME_LEN 16
+
+// Slabs are made large enough to hold at least this many objects
+#ifndef KMEM_SLAB_OBJECTS_MIN
+#define KMEM_SLAB_OBJECTS_MIN 8
+#endif
+
+// kmalloc size classes: 16, 32, ... KMEM_KMALLOC_MAX bytes; larger
+// requests are handed whole blocks from the page allocator
+#define KMEM_KMALLOC_MIN 16
+#define KMEM_KMALLOC_MAX 2048
+
+// Object cache
+typedef struct kmem_cache_t {
+    char name[KMEM_NAME_LEN];       // Cache name
+    int active;                     // Indicates that this cache has been created
+    unsigned int size;              // Object size
+    unsigned int stride;            // Distance between objects (object and free link)
+    int order;                      // Page order of each slab
+    unsigned int per_slab;          // Objects in each slab
+    void (*ctor)(void *);           // Object constructor (NULL for none)
+
+    void *free;                     // First free object
+    struct kmem_slab_t *slabs;      // Slabs owned by the cache
+
+    unsigned int slab_count;        // Slabs allocated
+    unsigned int in_use;            // Objects allocated
+    unsigned int allocs;            // Successful allocations
+    unsigned int frees;             // Objects freed
+    unsigned int failures;          // Allocations that could not be satisfied
+} kmem_cache_t;
+
+/**
+ * Initializes the cache table and creates the kmalloc caches
+ * Must be called after the page allocator has been initialized
+ * @return 0 on success, -1 on error
+ */
+int kmem_init(void);
+
+/**
+ * Creates a cache of fixed-size objects
+ *
+ * The constructor is run once for each object when its slab is allocated,
+ * not on every allocation: objects must be handed back to kmem_cache_free
+ * in their constructed state (e.g. empty wait queues) so they can be
+ * reused as they are.
+ *
+ * @param name - cache name (for statistics)
+ * @param size - object size in bytes
+ * @param ctor - object constructor (NULL for none)
+ * @return pointer to the cache, NULL on error
+ */
+kmem_cache_t *kmem_cache_create(char *name, unsigned int size, void (*ctor)(void *));
+
+/**
+ * Destroys a cache and gives its slabs back to the page allocator
+ * @param cache - the cache
+ * @return 0 on success, -1 on error (or if objects are still allocated)
+ */
+int kmem_cache_destroy(kmem_cache_t *cache);
+
+/**
+ * Allocates an object from a cache
+ * @param cache - the cache
+ * @return pointer to the constructed object, NULL if no memory is available
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+/**
+ * Returns an object to its cache
+ * @param cache - the cache the object was allocated from
+ * @param obj - the object
+ * @return 0 on success, -1 on error
+ */
+int kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+/**
+ * Allocates memory from the smallest kmalloc size class that fits
+ * The memory is not cleared
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if no memory is available
+ */
+void *kmalloc(unsigned int size);
+
+/**
+ * Frees memory returned by kmalloc
+ * @param ptr - pointer to the memory (NULL is ignored)
+ * @return 0 on success, -1 on error
+ */
+int kfree(void *ptr);
+
+/**
+ * Prints the occupancy of every cache to the host console
+ */
+void kmem_stats_dump(void);
+
+#endif
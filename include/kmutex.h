@@ -16,10 +16,9 @@
 #endif
 
 typedef struct mutex_t {
-    int allocated;          // Indicates that this mutex has been allocated
     int locks;              // The current number of locks held
     proc_t *owner;          // The process that currently holds the mutex
-    queue_t wait_queue;     // The processes waiting on the mutex
+    pid_queue_t wait_queue; // The processes waiting on the mutex
 } mutex_t;
 
 /**
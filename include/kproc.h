@@ -7,19 +7,35 @@
 #ifndef KPROC_H
 #define KPROC_H
 
+#include "paging.h"
 #include "trapframe.h"
 #include "ringbuf.h"
 #include "queue.h"
 
 #ifndef PROC_MAX
-#define PROC_MAX        20   // maximum number of processes to support
+#define PROC_MAX        32   // maximum number of processes to support
 #endif
 
+// Queue of process ids, big enough for every process (PROC_MAX must be a
+// power of two); used for the run, sleep and wait queues
+DEFINE_QUEUE(pid_queue, int, PROC_MAX)
+
 #define PROC_IO_MAX     4    // Maximum process I/O buffers
 
 #define PROC_NAME_LEN   32   // Maximum length of a process name
 #define PROC_STACK_SIZE 8192 // Process stack size
 
+// User process stacks are mapped at the top of the per-process window,
+// at the same address in every address space
+#define PROC_USER_STACK (PAGING_USER_LIMIT - PROC_STACK_SIZE)
+
+// User process heaps grow from PROC_HEAP_BASE, above the shared memory
+// segments (see kshm.h), up to an unmapped guard page below the stack
+#ifndef PROC_HEAP_BASE
+#define PROC_HEAP_BASE  (PAGING_USER_BASE + PAGING_DIR_SPAN)
+#endif
+#define PROC_HEAP_LIMIT (PROC_USER_STACK - 0x1000)
+
 #define PROC_IO_IN 0
 #define PROC_IO_OUT 1
 
@@ -54,12 +70,16 @@ typedef struct proc_t {
     int cpu_time;                   // Current CPU time the process has used
     int sleep_time;                 // Time that a process should be sleeping
 
-    queue_t *scheduler_queue;       // Pointer to the queue where the process resides
+    pid_queue_t *scheduler_queue;   // Pointer to the queue where the process resides
 
     ringbuf_t *io[PROC_IO_MAX];     // Process input/output buffers
 
-    unsigned char *stack;           // Pointer to the process stack
-    trapframe_t *trapframe;         // Pointer to the trapframe
+    unsigned char *stack;           // Pointer to the kernel process stack (NULL until used)
+    trapframe_t *trapframe;         // Pointer to the trapframe (in the address space of the process)
+
+    pde_t *page_dir;                // Address space (the kernel's for kernel processes)
+    unsigned int shm_attached;      // Shared memory segments attached (bit per segment id)
+    unsigned int heap_end;          // End of the heap (the program break)
 } proc_t;
 
 
@@ -84,6 +104,24 @@ void kproc_init(void);
  */
 int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type);
 
+/**
+ * Creates a copy of a user process that shares its pages copy on write
+ * The child resumes from the same trapframe as the parent, with 0 as the
+ * return value of the system call
+ * @param parent - process to copy (the active process)
+ * @return process id of the child, -1 on error
+ */
+int kproc_fork(proc_t *parent);
+
+/**
+ * Grows or shrinks the heap of a user process
+ * Pages are mapped (cleared) or unmapped as the break crosses page boundaries
+ * @param proc - the process
+ * @param increment - number of bytes to add to the heap (negative to shrink it)
+ * @return the previous break, -1 on error
+ */
+int kproc_sbrk(proc_t *proc, int increment);
+
 /**
  * Destroys a process
  * If the process is currently scheduled it must be unscheduled
@@ -114,6 +152,11 @@ proc_t *entry_to_proc(int entry);
  */
 int kproc_attach_tty(int pid, int tty_number);
 
+/**
+ * Idle process
+ */
+void kproc_idle(void);
+
 /**
  * Test process
  */
@@ -16,9 +16,8 @@
 #endif
 
 typedef struct sem_t {
-    int allocated;          // Indicates that this semaphore has been allocated
     int count;              // The current semaphore count
-    queue_t wait_queue;     // The processes waiting on the semaphore
+    pid_queue_t wait_queue; // The processes waiting on the semaphore
 } sem_t;
 
 /**
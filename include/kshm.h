@@ -0,0 +1,83 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Shared Memory Segments
+ */
+#ifndef KSHM_H
+#define KSHM_H
+
+#include "kproc.h"
+#include "paging.h"
+
+// Maximum number of shared memory segments supported
+// (each process records its attachments in a 32 bit mask)
+#ifndef SHM_MAX
+#define SHM_MAX 16
+#endif
+
+// Largest segment, in bytes
+#ifndef SHM_SIZE_MAX
+#define SHM_SIZE_MAX 0x40000
+#endif
+
+// Segment n is mapped at SHM_BASE + n * SHM_SIZE_MAX in every process that
+// attaches it, so pointers into a segment can be passed between processes
+#define SHM_BASE PAGING_USER_BASE
+#define SHM_LIMIT (SHM_BASE + SHM_MAX * SHM_SIZE_MAX)
+
+typedef struct shm_t {
+    unsigned int size;      // Segment size (whole pages)
+    int refs;               // Processes the segment is attached to
+    void **pages;           // Pages of the segment
+} shm_t;
+
+/**
+ * Initializes kernel shared memory data structures
+ * @return -1 on error, 0 on success
+ */
+int kshm_init(void);
+
+/**
+ * Creates a shared memory segment and attaches it to a process
+ * The segment is cleared and lives until the last process detaches it
+ * @param proc - the creating (user) process
+ * @param size - segment size in bytes, rounded up to whole pages
+ * @return -1 on error, otherwise the segment id
+ */
+int kshm_create(proc_t *proc, unsigned int size);
+
+/**
+ * Maps a shared memory segment into a process' address space
+ * Attaching a segment that is already attached just returns its address
+ * @param proc - the (user) process
+ * @param id - the segment id
+ * @return address of the segment in the process, 0 (NULL) on error
+ */
+unsigned int kshm_attach(proc_t *proc, int id);
+
+/**
+ * Unmaps a shared memory segment from a process' address space
+ * The segment is freed when its last process detaches it
+ * @param proc - the process
+ * @param id - the segment id
+ * @return 0 on success, -1 on error
+ */
+int kshm_detach(proc_t *proc, int id);
+
+/**
+ * Gives a forked process the parent's attachments
+ * The pages were already shared by paging_dir_fork; only the references
+ * of the segments are taken
+ * @param parent - the forked process
+ * @param child - its copy
+ */
+void kshm_fork(proc_t *parent, proc_t *child);
+
+/**
+ * Detaches every segment a process still has attached (on exit)
+ * @param proc - the process
+ */
+void kshm_release(proc_t *proc);
+
+#endif
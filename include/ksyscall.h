@@ -39,12 +39,28 @@ int ksyscall_io_read(int io, char *buf, int n);
  */
 int ksyscall_io_flush(int io);
 
+/**
+ * Replaces the I/O buffers of the process' TTY with ones of the given sizes
+ * Anything still buffered is discarded
+ * @param input_size - input buffer capacity in bytes
+ * @param output_size - output buffer capacity in bytes
+ * @return -1 on error or 0 on success
+ */
+int ksyscall_io_resize(int input_size, int output_size);
+
 /**
  * Gets the current system time (in seconds)
  * @return system time in seconds
  */
 int ksyscall_sys_get_time(void);
 
+/**
+ * Gets the time since boot from the monotonic nanosecond clock
+ * @param ns - pointer to where the number of nanoseconds will be copied
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_sys_get_time_ns(unsigned long long *ns);
+
 /**
  * Gets the operating system name
  * @param name - pointer to a character buffer where the name will be copied
@@ -52,6 +68,14 @@ int ksyscall_sys_get_time(void);
  */
 int ksyscall_sys_get_name(char *name);
 
+/**
+ * Gets the interrupt statistics for the specified vector
+ * @param irq - interrupt vector number
+ * @param stats - pointer to the structure where the statistics will be copied
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_sys_irq_stats(int irq, irq_stats_t *stats);
+
 /**
  * Puts the current process to sleep for the specified number of seconds
  * @param seconds - number of seconds the process should sleep
@@ -63,6 +87,19 @@ int ksyscall_proc_sleep(int seconds);
  */
 int ksyscall_proc_exit(void);
 
+/**
+ * Creates a copy of the current process that shares its pages copy on write
+ * @return process id of the child (0 is returned in the child), -1 on error
+ */
+int ksyscall_proc_fork(void);
+
+/**
+ * Grows or shrinks the heap of the current process
+ * @param increment - number of bytes to add to the heap (negative to shrink it)
+ * @return the previous end of the heap, -1 on error
+ */
+int ksyscall_proc_sbrk(int increment);
+
 /**
  * Gets the current process' id
  * @return process id
@@ -76,6 +113,43 @@ int ksyscall_proc_get_pid(void);
  */
 int ksyscall_proc_get_name(char *name);
 
+/**
+ * Creates a timer for the active process that posts a semaphore when it expires
+ * @param ms - milliseconds until the timer expires
+ * @param periodic - 0 to fire once, otherwise fire every ms milliseconds
+ * @param sem - semaphore id to post
+ * @return -1 on error, all other values indicate the timer id
+ */
+int ksyscall_timer_create(int ms, int periodic, int sem);
+
+/**
+ * Cancels a timer owned by the active process
+ * @param timer - timer id
+ * @return -1 on error, 0 on success
+ */
+int ksyscall_timer_cancel(int timer);
+
+/**
+ * Creates a shared memory segment and attaches it to the active process
+ * @param size - segment size in bytes
+ * @return -1 on error, all other values indicate the segment id
+ */
+int ksyscall_shm_create(int size);
+
+/**
+ * Attaches a shared memory segment to the active process
+ * @param shm - segment id
+ * @return address of the segment, 0 (NULL in the process) on error
+ */
+int ksyscall_shm_attach(int shm);
+
+/**
+ * Detaches a shared memory segment from the active process
+ * @param shm - segment id
+ * @return -1 on error, 0 on success
+ */
+int ksyscall_shm_detach(int shm);
+
 /**
  * Allocates a mutex from the kernel
  * @return -1 on error, all other values indicate the mutex id
@@ -0,0 +1,138 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Physical page-frame allocator (buddy system)
+ */
+#ifndef PAGE_H
+#define PAGE_H
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+
+// Blocks are 2^order pages: 4 KB (order 0) to 4 MB (order 10)
+#define PAGE_ORDER_MAX 10
+#define PAGE_ORDERS (PAGE_ORDER_MAX + 1)
+#define PAGE_BLOCK_MAX (PAGE_SIZE << PAGE_ORDER_MAX)
+
+// Memory left unused at the top of RAM, where the BIOS keeps the ACPI tables
+// (the CMOS doesn't say where they are, so this is a guess; see page.c)
+#ifndef PAGE_TOP_RESERVE
+#define PAGE_TOP_RESERVE 0x100000
+#endif
+
+// Memory above this address is never managed: the per-process paging
+// window starts here (see paging.h), followed by the APIC and other MMIO
+#ifndef PAGE_MEMORY_LIMIT
+#define PAGE_MEMORY_LIMIT 0xc0000000
+#endif
+
+// Allocator statistics
+typedef struct page_stats_t {
+    unsigned int total;                 // Pages managed
+    unsigned int free;                  // Pages free
+    unsigned int blocks[PAGE_ORDERS];   // Free blocks of each order
+    unsigned int allocs;                // Successful allocations
+    unsigned int frees;                 // Blocks freed
+    unsigned int splits;                // Blocks split to satisfy an allocation
+    unsigned int merges;                // Buddies merged on free
+    unsigned int failures;              // Allocations that could not be satisfied
+} page_stats_t;
+
+/**
+ * Finds the memory installed above 1 MB and hands everything past the end
+ * of the kernel image to the allocator
+ * Memory is sized from the CMOS, since the loader provides no memory map
+ * @return 0 on success, -1 on error
+ */
+int page_init(void);
+
+/**
+ * Sets up the allocator to manage a region of memory
+ * The bookkeeping for the region is stored at its start
+ * @param start - first byte of the region
+ * @param limit - first byte past the region
+ * @return 0 on success, -1 on error
+ */
+int page_init_region(void *start, void *limit);
+
+/**
+ * Allocates a block of 2^order contiguous pages aligned to its size
+ * @param order - block order (0 to PAGE_ORDER_MAX)
+ * @return address of the block, NULL if no block is available
+ */
+void *page_alloc(int order);
+
+/**
+ * Frees a block returned by page_alloc, merging it with its free buddies
+ * The block is freed whatever its reference count
+ * @param addr - address of the block
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_free(void *addr);
+
+/**
+ * Takes another reference to an allocated block
+ * A block starts with one reference when page_alloc returns it
+ * @param addr - address of the block
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_get(void *addr);
+
+/**
+ * Drops a reference to an allocated block, freeing it with the last one
+ * @param addr - address of the block
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_put(void *addr);
+
+/**
+ * Returns the number of references to an allocated block
+ * @param addr - address of the block
+ * @return reference count, 0 if addr is not an allocated block
+ */
+int page_refs(void *addr);
+
+/**
+ * Records the owner of every page of an allocated block, so the owner can
+ * be found from any address inside the block with page_owner
+ * @param addr - address of the block (as returned by page_alloc)
+ * @param owner - owner to record
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_set_owner(void *addr, void *owner);
+
+/**
+ * Returns the owner recorded for the page holding an address
+ * @param addr - any address inside an allocated block
+ * @return the owner, NULL if none was recorded or addr is not managed memory
+ */
+void *page_owner(void *addr);
+
+/**
+ * Returns the smallest order whose blocks can hold a number of bytes
+ * @param size - number of bytes
+ * @return block order, -1 if size is larger than PAGE_BLOCK_MAX
+ */
+int page_order(unsigned int size);
+
+/**
+ * Copies the allocator statistics
+ * @param stats - statistics to fill in
+ */
+void page_stats(page_stats_t *stats);
+
+/**
+ * Returns how much of the free memory can't be used for a block of the
+ * given order because it is split into smaller blocks
+ * @param order - block order
+ * @return percentage of free pages (0 when none are free)
+ */
+int page_fragmentation(int order);
+
+/**
+ * Prints the free block counts and fragmentation to the host console
+ */
+void page_stats_dump(void);
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Paging and per-process address spaces
+ */
+#ifndef PAGING_H
+#define PAGING_H
+
+// Page directory and page table entries
+typedef unsigned int pde_t;
+typedef unsigned int pte_t;
+
+// Entries per page directory / page table
+#define PAGING_ENTRIES 1024
+
+// Bytes mapped by one page directory entry (a 4 MB page or one page table)
+#define PAGING_DIR_SPAN 0x400000
+
+// Entry flags
+#define PAGING_PRESENT      0x001   // Mapping is valid
+#define PAGING_WRITE        0x002   // Writable
+#define PAGING_USER         0x004   // Accessible from ring 3
+#define PAGING_PWT          0x008   // Write-through
+#define PAGING_PCD          0x010   // Cache disabled
+#define PAGING_ACCESSED     0x020   // Set by the CPU on access
+#define PAGING_DIRTY        0x040   // Set by the CPU on write
+#define PAGING_LARGE        0x080   // 4 MB page (directory entries only)
+#define PAGING_GLOBAL       0x100   // Kept in the TLB across CR3 reloads
+#define PAGING_COW          0x200   // Copy on write (available to software)
+#define PAGING_SHARED       0x400   // Stays shared when forked (available to software)
+#define PAGING_FLAGS        0xfff
+
+// Per-process window: every address space has its own mappings between
+// PAGING_USER_BASE and PAGING_USER_LIMIT; everything else is the kernel's
+// identity mapping, shared by all address spaces
+#ifndef PAGING_USER_BASE
+#define PAGING_USER_BASE    0xc0000000
+#endif
+
+#ifndef PAGING_USER_LIMIT
+#define PAGING_USER_LIMIT   0xe0000000
+#endif
+
+// Paging statistics
+typedef struct paging_stats_t {
+    unsigned int dirs;                  // Address spaces in use (besides the kernel's)
+    unsigned int tables;                // Page tables in use
+    unsigned int cr3_loads;             // CR3 reloads on kernel exit
+    unsigned int cr3_avoided;           // Kernel exits that kept the loaded CR3
+    unsigned int forks;                 // Address spaces copied with paging_dir_fork
+    unsigned int cow_faults;            // Writes to copy-on-write pages
+    unsigned int cow_copies;            // Copy-on-write pages that had to be copied
+} paging_stats_t;
+
+/**
+ * Builds the kernel address space, identity mapping memory with 4 MB pages,
+ * and enables paging on the bootstrap CPU
+ * Must be called after the page allocator and interrupts have been
+ * initialized
+ * @return 0 on success, -1 on error (paging stays disabled and user
+ *         processes can't run, since their stacks are in the per-process window)
+ */
+int paging_init(void);
+
+/**
+ * Enables paging on an application processor with the kernel address space
+ */
+void paging_ap_init(void);
+
+/**
+ * Returns the kernel address space, used by kernel processes
+ * @return the kernel page directory
+ */
+pde_t *paging_kernel_dir(void);
+
+/**
+ * Creates an address space sharing the kernel mappings with an empty
+ * per-process window
+ * @return the page directory, NULL if no memory is available
+ */
+pde_t *paging_dir_create(void);
+
+/**
+ * Creates a copy of an address space that shares every page of the
+ * per-process window with it, copy on write
+ * Writable pages become read-only in both address spaces until one of them
+ * writes to the page (see paging_cow_break); PAGING_SHARED pages stay
+ * writable and shared
+ * @param src - the page directory to copy
+ * @return the new page directory, NULL if no memory is available
+ */
+pde_t *paging_dir_fork(pde_t *src);
+
+/**
+ * Destroys an address space created by paging_dir_create or paging_dir_fork
+ * The page tables of the per-process window are freed and the reference
+ * each mapping holds on its page is dropped
+ * @param dir - the page directory
+ */
+void paging_dir_destroy(pde_t *dir);
+
+/**
+ * Maps a page into the per-process window of an address space
+ * The mapping takes over the caller's reference to the page
+ * @param dir - the page directory
+ * @param addr - page aligned address in the per-process window
+ * @param page - page aligned memory to map
+ * @param flags - entry flags (PAGING_PRESENT is implied)
+ * @return 0 on success, -1 on error
+ */
+int paging_map(pde_t *dir, unsigned int addr, void *page, unsigned int flags);
+
+/**
+ * Removes a page from the per-process window of an address space
+ * The mapping's reference to the page is handed back to the caller
+ * @param dir - the page directory
+ * @param addr - page aligned address in the per-process window
+ * @return the page that was mapped, NULL if none was
+ */
+void *paging_unmap(pde_t *dir, unsigned int addr);
+
+/**
+ * Gives an address space its own writable copy of a copy-on-write page
+ * The page is only copied if another address space still shares it
+ * @param dir - the page directory
+ * @param addr - page aligned address in the per-process window
+ * @return 0 on success, -1 if the page isn't copy on write or no memory is available
+ */
+int paging_cow_break(pde_t *dir, unsigned int addr);
+
+/**
+ * Translates an address in the per-process window of an address space to
+ * the kernel's (identity mapped) address of the same byte
+ * @param dir - the page directory
+ * @param addr - address in the per-process window
+ * @return the kernel address, NULL if nothing is mapped at addr
+ */
+void *paging_lookup(pde_t *dir, unsigned int addr);
+
+/**
+ * Returns the page table entry for an address in the per-process window
+ * @param dir - the page directory
+ * @param addr - address in the per-process window
+ * @return pointer to the entry, NULL if no page table covers the address
+ */
+pte_t *paging_pte(pde_t *dir, unsigned int addr);
+
+/**
+ * Flushes the TLB entry for an address if the address space is loaded on
+ * the calling CPU
+ * @param dir - the page directory
+ * @param addr - address that was remapped
+ */
+void paging_invalidate(pde_t *dir, unsigned int addr);
+
+/**
+ * Page fault handler
+ * Resolves writes to copy-on-write pages of the loaded address space;
+ * any other page fault is a kernel bug
+ */
+void paging_fault_handler(void);
+
+/**
+ * Loads an address space on the calling CPU on the way out of the kernel
+ * CR3 is only reloaded (flushing the TLB) when the address space differs
+ * from the one already loaded
+ * @param dir - the page directory of the process about to run
+ */
+void paging_switch(pde_t *dir);
+
+/**
+ * Copies the paging statistics
+ * @param stats - statistics to fill in
+ */
+void paging_stats(paging_stats_t *stats);
+
+/**
+ * Prints the paging statistics to the host console
+ */
+void paging_stats_dump(void);
+
+#endif
@@ -3,61 +3,84 @@
  * California State University, Sacramento
  *
  * Simple circular queue implementation
+ *
+ * DEFINE_QUEUE(name, type, capacity) generates a queue type `name_t` that
+ * holds up to `capacity` items of `type`, along with inline functions:
+ *
+ *   int  name_init(name_t *queue);
+ *   int  name_in(name_t *queue, type item);
+ *   int  name_out(name_t *queue, type *item);
+ *   int  name_size(name_t *queue);
+ *   bool name_is_empty(name_t *queue);
+ *   bool name_is_full(name_t *queue);
+ *
+ * The capacity must be a power of two: head and tail count items taken
+ * out/put in and are never wrapped, so tail - head is the number of items
+ * and (index & (capacity - 1)) is the position in items[].
  */
 #ifndef QUEUE_H
 #define QUEUE_H
 
 #include <spede/stdbool.h>
 
+#define DEFINE_QUEUE(name, type, capacity)                                      \
+typedef char name##_capacity_check[                                             \
+    ((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0) ? 1 : -1];         \
+                                                                                \
+typedef struct name##_t {                                                       \
+    unsigned int head;          /* Total items taken out of the queue */        \
+    unsigned int tail;          /* Total items put into the queue */            \
+    type items[capacity];       /* Queued items */                              \
+} name##_t;                                                                     \
+                                                                                \
+/* Initializes an empty queue; returns -1 on error, 0 on success */             \
+static inline int name##_init(name##_t *queue) {                                \
+    if (!queue) {                                                               \
+        return -1;                                                              \
+    }                                                                           \
+    queue->head = 0;                                                            \
+    queue->tail = 0;                                                            \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+/* Adds an item to the end of the queue; returns -1 if full, 0 on success */    \
+static inline int name##_in(name##_t *queue, type item) {                       \
+    if (!queue || queue->tail - queue->head == (capacity)) {                    \
+        return -1;                                                              \
+    }                                                                           \
+    queue->items[queue->tail++ & ((capacity) - 1)] = item;                      \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+/* Pulls the item at the front of the queue; returns -1 if empty, 0 on success */ \
+static inline int name##_out(name##_t *queue, type *item) {                     \
+    if (!queue || !item || queue->tail == queue->head) {                        \
+        return -1;                                                              \
+    }                                                                           \
+    *item = queue->items[queue->head++ & ((capacity) - 1)];                     \
+    return 0;                                                                   \
+}                                                                               \
+                                                                                \
+/* Returns the number of items in the queue */                                  \
+static inline int name##_size(name##_t *queue) {                                \
+    return (int)(queue->tail - queue->head);                                    \
+}                                                                               \
+                                                                                \
+/* Indicates if the queue is empty */                                           \
+static inline bool name##_is_empty(name##_t *queue) {                           \
+    return queue->tail == queue->head;                                          \
+}                                                                               \
+                                                                                \
+/* Indicates if the queue is full */                                            \
+static inline bool name##_is_full(name##_t *queue) {                            \
+    return queue->tail - queue->head == (capacity);                             \
+}
+
+// General purpose queue of integers (queue_t, queue_init, queue_in, ...)
 #ifndef QUEUE_SIZE
 #define QUEUE_SIZE 32
 #endif
 
-typedef struct queue_t {
-    int head;
-    int tail;
-    int size;
-    int items[QUEUE_SIZE];
-} queue_t;
-
-/**
- * Initializes an empty queue
- * Sets the empty queue items to -1
- *
- * @param  queue - pointer to the queue
- * @return -1 on error; 0 on success
- */
-int queue_init(queue_t *queue);
-
-/**
- * Adds an item to the end of a queue
- * @param  queue - pointer to the queue
- * @param  item  - the item to add
- * @return -1 on error; 0 on success
- */
-int queue_in(queue_t *queue, int item);
-
-/**
- * Pulls an item from the specified queue
- * @param  queue - pointer to the queue
- * @param  item  - pointer to the memory to save item to
- * @return -1 on error; 0 on success
- */
-int queue_out(queue_t *queue, int *item);
-
-/**
- * Indicates if the queue is empty
- * @param queue - pointer to the queue structure
- * @return true if empty, false if not empty
- */
-bool queue_is_empty(queue_t *queue);
-
-/**
- * Indicates if the queue if full
- * @param queue - pointer to the queue structure
- * @return true if full, false if not full
- */
-bool queue_is_full(queue_t *queue);
-
+DEFINE_QUEUE(queue, int, QUEUE_SIZE)
 
 #endif
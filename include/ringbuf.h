@@ -11,25 +11,51 @@
 #include <spede/stdbool.h>    // For bool type
 #include <spede/stddef.h>     // For size_t
 
+// Default buffer capacity
 #ifndef RINGBUF_SIZE
 #define RINGBUF_SIZE 2048
 #endif
 
+// Smallest buffer capacity
+#define RINGBUF_SIZE_MIN 16
+
+// Capacities are rounded up to a power of two so indexes can be masked.
+// head and tail count bytes read/written since the buffer was initialized
+// and are never wrapped; tail - head is the number of bytes in the buffer
+// and (index & (size - 1)) is the position in data[]
+//
+// The buffer is safe for one producer and one consumer running at the same
+// time (e.g. an IRQ handler and a process, or two CPUs) without locks or
+// disabling interrupts: only the producer writes tail and only the consumer
+// writes head, and each side publishes its index after touching the data.
+// Additional producers or consumers, and ringbuf_flush from anywhere but
+// the consumer, must be serialized by the caller (the kernel lock with
+// interrupts disabled in the kernel).
 typedef struct ringbuf_t {
-    int head;                   // Head of the buffer
-    int tail;                   // Tail of the buffer
-    int size;                   // Current size of the buffer
-    char data[RINGBUF_SIZE];   // Data in buffer
+    volatile unsigned int head; // Total bytes read from the buffer (consumer)
+    volatile unsigned int tail; // Total bytes written to the buffer (producer)
+    unsigned int size;          // Capacity (power of two)
+    char *data;                 // Data in buffer
 } ringbuf_t;
 
 /**
  * Initializes an empty ring buffer
- * Sets the empty data to 0
+ * Allocates the data with kmalloc (power-of-two sizes fit the size classes
+ * exactly); the data isn't cleared since nothing is readable until written
  *
  * @param  buf - pointer to the ring buffer data structure
+ * @param  size - capacity in bytes (rounded up to a power of two),
+ *                0 for RINGBUF_SIZE
+ * @return -1 on error; 0 on success
+ */
+int ringbuf_init(ringbuf_t *buf, size_t size);
+
+/**
+ * Frees the data of a ring buffer
+ * @param  buf - pointer to the ring buffer data structure
  * @return -1 on error; 0 on success
  */
-int ringbuf_init(ringbuf_t *buf);
+int ringbuf_destroy(ringbuf_t *buf);
 
 /**
  * Writes a byte to the buffer
@@ -68,8 +94,62 @@ int ringbuf_write_mem(ringbuf_t *buf, char *mem, size_t size);
  */
 int ringbuf_read_mem(ringbuf_t *buf, char *mem, size_t size);
 
+/**
+ * Reserves the contiguous free space at the tail of the buffer
+ * The producer may fill the region in place and then publish it with
+ * ringbuf_commit(); nothing is visible to the consumer until then
+ * @param buf - pointer to the ring buffer structure
+ * @param mem - pointer to where the start of the region will be stored
+ * @return -1 on error, otherwise the number of bytes that may be written
+ *         (0 if the buffer is full)
+ */
+int ringbuf_reserve(ringbuf_t *buf, char **mem);
+
+/**
+ * Publishes bytes written into a region returned by ringbuf_reserve()
+ * @param buf - pointer to the ring buffer structure
+ * @param size - number of bytes written
+ * @return -1 on error, 0 on success
+ */
+int ringbuf_commit(ringbuf_t *buf, size_t size);
+
+/**
+ * Gets the contiguous readable data at the head of the buffer
+ * The consumer may use the region in place and then release it with
+ * ringbuf_consume(); the data may wrap, so a second peek may return more
+ * @param buf - pointer to the ring buffer structure
+ * @param mem - pointer to where the start of the region will be stored
+ * @return -1 on error, otherwise the number of bytes that may be read
+ *         (0 if the buffer is empty)
+ */
+int ringbuf_peek_contiguous(ringbuf_t *buf, char **mem);
+
+/**
+ * Releases bytes returned by ringbuf_peek_contiguous() back to the producer
+ * @param buf - pointer to the ring buffer structure
+ * @param size - number of bytes consumed
+ * @return -1 on error, 0 on success
+ */
+int ringbuf_consume(ringbuf_t *buf, size_t size);
+
+/**
+ * Returns the number of bytes in the buffer
+ * @param buf - pointer to the ring buffer structure
+ * @return number of bytes that can be read
+ */
+int ringbuf_size(ringbuf_t *buf);
+
+/**
+ * Returns the capacity of the buffer
+ * @param buf - pointer to the ring buffer structure
+ * @return number of bytes the buffer can hold
+ */
+int ringbuf_capacity(ringbuf_t *buf);
+
 /**
  * Flushes (empties) the buffer
+ * Discards everything written so far; this is a consumer operation, so it
+ * must not run at the same time as the consumer
  * @param buf - pointer to the ring buffer structure
  * @return -1 on error, 0 on success
  */
@@ -20,6 +20,12 @@
  */
 void scheduler_init(void);
 
+/**
+ * Per-CPU timer tick accounting
+ * Called by the timer IRQ handler on every CPU
+ */
+void scheduler_tick(void);
+
 /**
  * Executes the scheduler
  * Should ensure that `active_proc` is set to a valid process entry
@@ -34,6 +40,8 @@ void scheduler_add(proc_t *proc);
 
 /**
  * Removes a process from the scheduler
+ * Only the calling CPU's active process is cleared; the process must not be
+ * current on another CPU (see kproc_destroy)
  * @param proc - pointer to the process entry
  */
 void scheduler_remove(proc_t *proc);
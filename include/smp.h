@@ -0,0 +1,160 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Symmetric multiprocessing
+ */
+#ifndef SMP_H
+#define SMP_H
+
+// Maximum number of CPUs to support
+#ifndef CPU_MAX
+#define CPU_MAX 8
+#endif
+
+// Physical address the application processor startup code is copied to
+// (must be page aligned and below 1MB)
+#ifndef SMP_TRAMPOLINE_ADDR
+#define SMP_TRAMPOLINE_ADDR 0x8000
+#endif
+
+// Number of CPU-bound workers started by the scaling benchmark
+#ifndef SMP_BENCH_WORKERS
+#define SMP_BENCH_WORKERS 8
+#endif
+
+#ifndef ASSEMBLER
+#include <spede/machine/asmacros.h>
+
+#include "kproc.h"
+#include "queue.h"
+#include "spinlock.h"
+
+// Per-CPU data
+typedef struct cpu_t {
+    int id;                     // Logical CPU number (0 is the bootstrap CPU)
+    int apic_id;                // Local APIC id
+    volatile int online;        // CPU is running the scheduler
+
+    int irq_depth;              // Number of interrupt levels being handled
+    proc_t *current;            // Process running on this CPU
+    proc_t *idle_proc;          // Process to run when there is nothing else
+    pde_t *page_dir;            // Address space loaded in CR3 (NULL to reload)
+
+    pid_queue_t run_queue;      // Processes waiting to run on this CPU
+
+    unsigned int steals;        // Processes taken from other CPUs' run queues
+    unsigned int ticks;         // Timer ticks handled by this CPU
+    unsigned int idle_ticks;    // Timer ticks spent in the idle process
+} cpu_t;
+
+// Per-CPU data table
+extern cpu_t cpus[CPU_MAX];
+
+// Number of CPUs running
+extern volatile int smp_cpus_online;
+
+// Logical CPU number for each local APIC id
+extern unsigned char smp_apic_to_cpu[256];
+
+// Big kernel lock: held by the CPU executing kernel code
+extern spinlock_t kernel_lock;
+
+// Per-CPU kernel stacks (KSTACK_SIZE comes from kernel.h, which includes
+// this header)
+extern unsigned char cpu_kstack[CPU_MAX][KSTACK_SIZE];
+
+/**
+ * Returns the local APIC id of the calling CPU
+ * (declared here to avoid pulling apic.h into every file)
+ */
+int apic_id(void);
+
+/**
+ * Returns the per-CPU data of the calling CPU
+ * With a single CPU online no hardware access is needed. Kernel entries
+ * run on the per-CPU kernel stacks, so there the stack address tells the
+ * CPU apart; the local APIC id is only read on other stacks (such as a
+ * process' stack at kernel entry)
+ */
+static inline cpu_t *smp_cpu(void) {
+    unsigned char here;
+    unsigned long offset = (unsigned long)&here - (unsigned long)cpu_kstack;
+
+    if (smp_cpus_online == 1) {
+        return &cpus[0];
+    }
+
+    if (offset < sizeof(cpu_kstack)) {
+        return &cpus[offset / KSTACK_SIZE];
+    }
+
+    return &cpus[smp_apic_to_cpu[apic_id()]];
+}
+
+/**
+ * Returns the logical CPU number of the calling CPU
+ */
+static inline int smp_cpu_id(void) {
+    return smp_cpu()->id;
+}
+
+/**
+ * Sets up the per-CPU data for the bootstrap CPU
+ * Must run before any process or scheduler code
+ */
+void smp_init_boot(void);
+
+/**
+ * Starts all application processors described by ACPI
+ * Requires the local APIC; does nothing when the PIC is in use
+ */
+void smp_start_aps(void);
+
+/**
+ * Indicates if the process is one of the per-CPU idle processes
+ * @param proc - pointer to the process entry
+ * @return 1 if it is an idle process, 0 otherwise
+ */
+int smp_is_idle_proc(proc_t *proc);
+
+/**
+ * Takes the big kernel lock from a kernel process so it can call kernel
+ * functions; like a system call, the code runs with interrupts disabled
+ * until smp_kernel_unlock()
+ */
+void smp_kernel_lock(void);
+
+/**
+ * Releases the big kernel lock taken with smp_kernel_lock()
+ */
+void smp_kernel_unlock(void);
+
+/**
+ * Starts the scaling benchmark: runs the given number of CPU-bound
+ * workers and reports the elapsed time once all of them have exited
+ * @param workers - number of worker processes
+ * @return 0 on success, -1 on error
+ */
+int smp_bench_start(int workers);
+
+/**
+ * Kernel process that starts the scaling benchmark with SMP_BENCH_WORKERS
+ * workers and exits
+ */
+void smp_bench_proc(void);
+
+/**
+ * Prints per-CPU scheduling statistics to the host console
+ */
+void smp_stats_dump(void);
+
+__BEGIN_DECLS
+
+extern char smp_trampoline_start[];
+extern char smp_trampoline_gdtr[];
+extern char smp_trampoline_end[];
+
+__END_DECLS
+#endif
+#endif
@@ -0,0 +1,43 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Deferred interrupt work (softirqs)
+ */
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+// Softirq vectors, lower numbers run first
+typedef enum softirq_vector_t {
+    SOFTIRQ_TIMER,          // Deferred timer callbacks
+    SOFTIRQ_KEYBOARD,       // CTRL key commands
+    SOFTIRQ_MAX             // Number of softirq vectors (must be <= 32)
+} softirq_vector_t;
+
+/**
+ * Initializes softirq data structures
+ */
+void softirq_init(void);
+
+/**
+ * Registers the handler for a softirq vector
+ * @param nr - softirq vector
+ * @param handler - function to call when the vector has been raised
+ * @return 0 on success, -1 on error
+ */
+int softirq_register(int nr, void (*handler)());
+
+/**
+ * Marks a softirq vector as pending; safe to call from an IRQ handler
+ * @param nr - softirq vector
+ */
+void softirq_raise(int nr);
+
+/**
+ * Runs the handlers of all pending softirq vectors with interrupts enabled
+ * Called with interrupts disabled after the IRQ has been dismissed and
+ * before returning to the process; returns with interrupts disabled
+ */
+void softirq_run(void);
+
+#endif
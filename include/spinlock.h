@@ -0,0 +1,59 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Spinlocks
+ */
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+typedef struct spinlock_t {
+    volatile int locked;        // 1 while held
+    int owner;                  // CPU holding the lock (for debugging)
+} spinlock_t;
+
+#define SPINLOCK_INIT { 0, -1 }
+
+/**
+ * Acquires the spinlock, busy waiting until it is available
+ * @param lock - pointer to the spinlock
+ */
+static inline void spin_lock(spinlock_t *lock) {
+    int value = 1;
+
+    while (1) {
+        asm volatile("xchgl %0, %1" : "+r"(value), "+m"(lock->locked) : : "memory");
+        if (value == 0) {
+            return;
+        }
+
+        // Spin on a plain read so the cache line isn't bounced around
+        while (lock->locked) {
+            asm volatile("pause");
+        }
+        value = 1;
+    }
+}
+
+/**
+ * Attempts to acquire the spinlock without waiting
+ * @param lock - pointer to the spinlock
+ * @return 1 if the lock was acquired, 0 otherwise
+ */
+static inline int spin_trylock(spinlock_t *lock) {
+    int value = 1;
+
+    asm volatile("xchgl %0, %1" : "+r"(value), "+m"(lock->locked) : : "memory");
+    return value == 0;
+}
+
+/**
+ * Releases the spinlock
+ * @param lock - pointer to the spinlock
+ */
+static inline void spin_unlock(spinlock_t *lock) {
+    asm volatile("" : : : "memory");
+    lock->locked = 0;
+}
+
+#endif
@@ -15,6 +15,13 @@
  */
 int sys_get_time(void);
 
+/**
+ * Gets the time since boot from the monotonic nanosecond clock
+ * @param ns - pointer to where the number of nanoseconds will be copied
+ * @return 0 on success, -1 on error
+ */
+int sys_get_time_ns(unsigned long long *ns);
+
 /**
  * Gets the operating system name
  * @param name - pointer to a character buffer where the name will be copied
@@ -22,12 +29,36 @@ int sys_get_time(void);
  */
 int sys_get_name(char *name);
 
+/**
+ * Gets the interrupt statistics for the specified vector
+ * @param irq - interrupt vector number
+ * @param stats - pointer to the structure where the statistics will be copied
+ * @return 0 on success, -1 on error
+ */
+int sys_get_irq_stats(int irq, irq_stats_t *stats);
+
 /**
  * Gets the current process' id
  * @return process id
  */
 int proc_get_pid(void);
 
+/**
+ * Grows or shrinks the heap of the current process
+ * New heap memory is cleared
+ * @param increment - number of bytes to add to the heap (negative to shrink it)
+ * @return the previous end of the heap, (void *)-1 on error
+ */
+void *sbrk(int increment);
+
+/**
+ * Creates a copy of the current process
+ * The copy shares the memory of the process copy on write and resumes
+ * from the same point, so this returns twice
+ * @return process id of the copy in the parent, 0 in the copy, -1 on error
+ */
+int proc_fork(void);
+
 /**
  * Gets the current process' name
  * @param name - pointer to a character buffer where the name will be copied
@@ -72,6 +103,16 @@ int io_read(int io, char *buf, int n);
  */
 int io_flush(int io);
 
+/**
+ * Replaces the I/O buffers of the process' TTY with ones of the given sizes
+ * Anything still buffered is discarded, and every process attached to the
+ * TTY uses the new buffers
+ * @param input_size - input buffer capacity in bytes
+ * @param output_size - output buffer capacity in bytes
+ * @return -1 on error or 0 on success
+ */
+int io_resize(int input_size, int output_size);
+
 /**
  * Allocates a mutex from the kernel
  * @return -1 on error, all other values indicate the mutex id
@@ -99,6 +140,23 @@ int mutex_lock(int mutex);
  */
 int mutex_unlock(int mutex);
 
+/**
+ * Creates a timer that posts a semaphore when it expires
+ * A single sem_wait can then wait for the timeout or any other poster
+ * @param ms - milliseconds until the timer expires
+ * @param periodic - 0 to fire once, otherwise fire every ms milliseconds
+ * @param sem - semaphore id to post
+ * @return -1 on error, all other values indicate the timer id
+ */
+int timer_create(int ms, int periodic, int sem);
+
+/**
+ * Cancels a timer
+ * @param timer - timer id
+ * @return -1 on error, 0 on success
+ */
+int timer_cancel(int timer);
+
 /**
  * Allocates a semaphore from the kernel
  * @param value - initial semaphore value
@@ -127,4 +185,27 @@ int sem_wait(int sem);
  */
 int sem_post(int sem);
 
+/**
+ * Creates a shared memory segment and attaches it to the current process
+ * The segment is cleared; it is freed when the last process detaches it
+ * @param size - segment size in bytes
+ * @return -1 on error, all other values indicate the segment id
+ */
+int shm_create(int size);
+
+/**
+ * Attaches a shared memory segment to the current process
+ * The segment is at the same address in every process it is attached to
+ * @param shm - segment id
+ * @return address of the segment, NULL on error
+ */
+void *shm_attach(int shm);
+
+/**
+ * Detaches a shared memory segment from the current process
+ * @param shm - segment id
+ * @return -1 on error, 0 on success
+ */
+int shm_detach(int shm);
+
 #endif
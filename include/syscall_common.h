@@ -29,8 +29,29 @@ typedef enum {
     SYSCALL_SEM_INIT,
     SYSCALL_SEM_DESTROY,
     SYSCALL_SEM_WAIT,
-    SYSCALL_SEM_POST
+    SYSCALL_SEM_POST,
+    SYSCALL_SYS_IRQ_STATS,
+    SYSCALL_TIMER_CREATE,
+    SYSCALL_TIMER_CANCEL,
+    SYSCALL_SYS_GET_TIME_NS,
+    SYSCALL_PROC_FORK,
+    SYSCALL_SHM_CREATE,
+    SYSCALL_SHM_ATTACH,
+    SYSCALL_SHM_DETACH,
+    SYSCALL_PROC_SBRK,
+    SYSCALL_IO_RESIZE
 } syscall_t;
 
+// Number of interrupt vectors the kernel handles
+#define IRQ_VECTOR_MAX  0xf0
+
+// Per-vector interrupt statistics
+typedef struct irq_stats_t {
+    unsigned int count;             // Number of times the vector was handled
+    unsigned long long cycles;      // Total CPU cycles spent in its handlers
+    unsigned int max_cycles;        // Most expensive single occurrence
+    int handlers;                   // Number of handlers sharing the vector
+} irq_stats_t;
+
 #endif
 
@@ -124,7 +124,8 @@ void test_init(void) {
     timer_callback_register(&test_timer, 25, -1);
 
     // Register the process list to update at a rate of 10 times per second
-    timer_callback_register(&test_proc_list, 10, -1);
+    // Formatting the whole table is expensive, so run it outside the timer IRQ
+    timer_callback_register_deferred(&test_proc_list, 10, -1);
 }
 
 #endif
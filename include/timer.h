@@ -11,8 +11,26 @@
 #define TIMERS_MAX 32
 #endif
 
+// Number of timer ticks per second
+#define TIMER_HZ 100
+
+// Callbacks taking longer than this (in microseconds) are reported
+#ifndef TIMER_BUDGET_US
+#define TIMER_BUDGET_US 500
+#endif
+
+// Maximum number of timers a single process may own
+#ifndef TIMERS_PROC_MAX
+#define TIMERS_PROC_MAX 4
+#endif
+
+// Longest process timer (in milliseconds) whose tick count fits in an int
+#define TIMER_PROC_MS_MAX ((0x7fffffff - 999) / TIMER_HZ)
+
 /**
  * Registers a new callback to be called at the specified interval
+ * Repeating callbacks may have their first call delayed by up to one
+ * interval so they don't fire on the same ticks as existing timers
  * @param func_ptr - function pointer to be called
  * @param interval - number of ticks before the callback is performed
  * @param repeat   - Indicate how many intervals to repeat (-1 should repeat forever)
@@ -21,6 +39,21 @@
  */
 int timer_callback_register(void (*func_ptr)(), int interval, int repeat);
 
+/**
+ * Registers a new callback that is deferred out of the timer IRQ
+ *
+ * The callback is marked pending in the timer IRQ and run from the
+ * timer softirq once the IRQ has been dismissed. Use this for expensive
+ * callbacks (screen refreshes, table dumps, etc.)
+ *
+ * @param func_ptr - function pointer to be called
+ * @param interval - number of ticks before the callback is performed
+ * @param repeat   - Indicate how many intervals to repeat (-1 should repeat forever)
+ *
+ * @return the allocated timer id or -1 for errors
+ */
+int timer_callback_register_deferred(void (*func_ptr)(), int interval, int repeat);
+
 /**
  * Unregisters the specified callback
  * @param id
@@ -29,6 +62,31 @@ int timer_callback_register(void (*func_ptr)(), int interval, int repeat);
  */
 int timer_callback_unregister(int id);
 
+/**
+ * Creates a timer for a process that posts a semaphore when it expires
+ * @param pid - process id of the owner
+ * @param ms - milliseconds until the timer expires (rounded up to whole ticks),
+ *             1 to TIMER_PROC_MS_MAX
+ * @param periodic - 0 to fire once, otherwise fire every ms milliseconds
+ * @param sem - semaphore id to post
+ * @return the timer id or -1 on error
+ */
+int timer_proc_create(int pid, int ms, int periodic, int sem);
+
+/**
+ * Cancels a process timer
+ * @param pid - process id of the owner
+ * @param id - timer id
+ * @return 0 on success, -1 on error
+ */
+int timer_proc_cancel(int pid, int id);
+
+/**
+ * Cancels every timer owned by a process
+ * @param pid - process id
+ */
+void timer_proc_release(int pid);
+
 /**
  * Returns the number of ticks that have occurred since startup
  *
@@ -36,6 +94,11 @@ int timer_callback_unregister(int id);
  */
 int timer_get_ticks(void);
 
+/**
+ * Prints the per-callback cost counters to the host console
+ */
+void timer_stats_dump(void);
+
 /**
  * Initializes timer related data structures and variables
  */
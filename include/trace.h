@@ -0,0 +1,100 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel event recorder
+ *
+ * Records every kernel entry (interrupt number, tick, TSC, interrupted
+ * process, system call number and arguments) along with process creation
+ * and CPU bring-up, so the exact interleaving of IRQs and system calls
+ * can be dumped to the host console and replayed by the host simulator
+ * (see test/sim).
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "queue.h"
+#include "trapframe.h"
+
+// Number of events kept; recording stops once the buffer is full
+#ifndef TRACE_EVENTS_MAX
+#define TRACE_EVENTS_MAX 8192
+#endif
+
+// Record from boot (1) or only after trace_start() is called (0)
+#ifndef TRACE_BOOT
+#define TRACE_BOOT 0
+#endif
+
+// Number of events trace_dump_proc prints each time it takes the kernel lock
+#ifndef TRACE_DUMP_BATCH
+#define TRACE_DUMP_BATCH 64
+#endif
+
+// Event types
+typedef enum trace_type_t {
+    TRACE_IRQ,              // kernel_context_enter
+    TRACE_IRQ_NESTED,       // kernel_context_enter_nested
+    TRACE_PROC_CREATE,      // Process created, args[0] is the process type
+    TRACE_PROC_DESTROY,     // Process destroyed
+    TRACE_CPU_START,        // Application processor online, pid is its idle process
+    TRACE_TYPE_MAX
+} trace_type_t;
+
+// Recorded event
+typedef struct trace_event_t {
+    unsigned long long tsc; // Time-stamp counter of the CPU that recorded it
+    int tick;               // System tick
+    short type;             // trace_type_t
+    short cpu;              // CPU index
+    int pid;                // Interrupted (or created/destroyed) process, -1 for none
+    int irq;                // Interrupt number for IRQ events, IRQ depth for others
+    int args[4];            // System calls: eax (number), ebx, ecx, edx
+} trace_event_t;
+
+DEFINE_QUEUE(trace_queue, trace_event_t, TRACE_EVENTS_MAX)
+
+/**
+ * Initializes the recorder; starts recording if TRACE_BOOT is set
+ */
+void trace_init(void);
+
+/**
+ * Discards any recorded events and starts recording
+ */
+void trace_start(void);
+
+/**
+ * Stops recording; recorded events are kept until the next trace_start
+ */
+void trace_stop(void);
+
+/**
+ * Records a kernel entry
+ * @param trapframe - trapframe of the interrupted code
+ * @param nested - 1 if the kernel itself was interrupted
+ */
+void trace_irq(trapframe_t *trapframe, int nested);
+
+/**
+ * Records a process, CPU or other non-interrupt event
+ * @param type - event type
+ * @param pid - process the event applies to
+ * @param arg - event specific argument
+ */
+void trace_event(trace_type_t type, int pid, int arg);
+
+/**
+ * Prints the recorded events to the host console in the format read by
+ * the host simulator's replay mode
+ * Prints the whole recording at once; use trace_dump_proc in the kernel
+ */
+void trace_dump(void);
+
+/**
+ * Kernel process that stops recording and prints the recorded events in
+ * the same format as trace_dump, TRACE_DUMP_BATCH events at a time
+ */
+void trace_dump_proc(void);
+
+#endif
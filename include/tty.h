@@ -24,6 +24,15 @@
 
 #define TTY_BUF_SIZE (TTY_WIDTH * (TTY_HEIGHT + TTY_SCROLLBACK))
 
+// Default process I/O buffer capacities (processes may resize them with io_resize)
+#ifndef TTY_IO_INPUT_SIZE
+#define TTY_IO_INPUT_SIZE   256
+#endif
+
+#ifndef TTY_IO_OUTPUT_SIZE
+#define TTY_IO_OUTPUT_SIZE  2048
+#endif
+
 
 // TTY data structure
 // Describes the virtual TTY
@@ -74,6 +83,23 @@ int tty_get_active(void);
  */
 struct tty_t *tty_get(int tty);
 
+/**
+ * Replaces the process I/O buffers of a TTY with ones of the given sizes
+ * Anything still buffered is discarded
+ * @param tty - TTY number
+ * @param input_size - input buffer capacity in bytes
+ * @param output_size - output buffer capacity in bytes
+ * @return -1 on error, 0 on success
+ */
+int tty_io_resize(int tty, int input_size, int output_size);
+
+/**
+ * Returns the TTY number whose process I/O buffers include the given one
+ * @param io - pointer to a process I/O buffer
+ * @return TTY number, -1 if the buffer doesn't belong to a TTY
+ */
+int tty_find_io(ringbuf_t *io);
+
 /**
  * Write a character into the TTY process input buffer
  * If the echo flag is set, will also write the character into the TTY
@@ -0,0 +1,624 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Local APIC and IOAPIC interrupt controller
+ *
+ * The local APIC and IOAPIC are located through the ACPI MADT. When both
+ * are present the 8259 PIC is masked off: IRQ 0 is served by the local
+ * APIC timer and all other ISA IRQs are routed through the IOAPIC to the
+ * same vectors the PIC used (0x20 + IRQ).
+ *
+ * IRQs given a raised priority are moved to a higher block of vectors
+ * (APIC_IRQ_VECTOR). While such an IRQ is handled the local APIC task
+ * priority is raised to its block, so IRQs of equal or lower priority are
+ * held pending in the local APIC instead of being masked and lost.
+ */
+#include <spede/string.h>
+
+#include "apic.h"
+#include "clock.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "smp.h"
+
+// Model specific registers
+#define MSR_APIC_BASE           0x1b
+#define MSR_APIC_BASE_ENABLE    0x800
+#define MSR_TSC_DEADLINE        0x6e0
+
+// CPUID feature bits (leaf 1)
+#define CPUID_EDX_APIC          (1 << 9)
+#define CPUID_ECX_TSC_DEADLINE  (1 << 24)
+
+// Local APIC registers (offsets from the local APIC base)
+#define LAPIC_ID                0x020
+#define LAPIC_TPR               0x080
+#define LAPIC_EOI               0x0b0
+#define LAPIC_SVR               0x0f0
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_TIMER_INIT        0x380
+#define LAPIC_TIMER_CURRENT     0x390
+#define LAPIC_TIMER_DIVIDE      0x3e0
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_LVT_PERIODIC      0x20000
+#define LAPIC_LVT_TSC_DEADLINE  0x40000
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define LAPIC_ICR_INIT          0x00000500
+#define LAPIC_ICR_STARTUP       0x00000600
+#define LAPIC_ICR_ASSERT        0x00004000
+#define LAPIC_ICR_LEVEL         0x00008000
+#define LAPIC_ICR_PENDING       0x00001000
+
+// IOAPIC registers
+#define IOAPIC_REGSEL           0x00
+#define IOAPIC_WIN              0x10
+#define IOAPIC_REG_VER          0x01
+#define IOAPIC_REG_REDTBL       0x10
+
+#define IOAPIC_ACTIVE_LOW       0x2000
+#define IOAPIC_LEVEL            0x8000
+#define IOAPIC_MASKED           0x10000
+
+// MADT entry types
+#define MADT_LAPIC              0
+#define MADT_IOAPIC             1
+#define MADT_OVERRIDE           2
+
+// Length of the local APIC timer calibration against the PIT
+#define APIC_CALIBRATE_MS       10
+
+// Number of ISA IRQ lines
+#define APIC_IRQ_LINES          16
+
+/**
+ * Variables
+ */
+
+// Indicates if the APIC is delivering interrupts
+int apic_active = 0;
+
+// Memory mapped register bases
+volatile unsigned int *lapic_base = NULL;
+volatile unsigned int *ioapic_base = NULL;
+
+// Global system interrupt (IOAPIC pin) and trigger flags for each ISA IRQ
+int apic_irq_gsi[APIC_IRQ_LINES];
+unsigned int apic_irq_flags[APIC_IRQ_LINES];
+
+// Vector each ISA IRQ is delivered on (see APIC_IRQ_VECTOR)
+int apic_irq_vector[APIC_IRQ_LINES];
+
+// Local APIC ids of the enabled CPUs described by ACPI
+int apic_cpu_ids[CPU_MAX];
+int apic_cpus = 0;
+
+// Shadow of the IRQ mask so masking never needs an MMIO read
+unsigned int apic_mask = 0xffff;
+
+// Local APIC timer configuration
+int apic_timer_mode = APIC_TIMER_PERIODIC;
+unsigned int apic_timer_count;          // LAPIC counts per tick (periodic)
+unsigned long long apic_tsc_period;     // TSC cycles per tick (deadline)
+unsigned long long apic_tsc_deadline;   // Next TSC deadline
+
+/**
+ * CPU helpers
+ */
+static inline void apic_cpuid(unsigned int leaf, unsigned int *ecx, unsigned int *edx) {
+    unsigned int eax, ebx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+static inline unsigned long long apic_rdmsr(unsigned int msr) {
+    unsigned int lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+static inline void apic_wrmsr(unsigned int msr, unsigned long long value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((unsigned int)value), "d"((unsigned int)(value >> 32)));
+}
+
+/**
+ * Register access
+ */
+static inline unsigned int lapic_read(int reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(int reg, unsigned int value) {
+    lapic_base[reg / 4] = value;
+}
+
+static inline unsigned int ioapic_read(int reg) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    return ioapic_base[IOAPIC_WIN / 4];
+}
+
+static inline void ioapic_write(int reg, unsigned int value) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    ioapic_base[IOAPIC_WIN / 4] = value;
+}
+
+/**
+ * Compares an ACPI signature
+ * @return 1 if the signatures match
+ */
+static int acpi_signature(unsigned char *table, char *signature, int length) {
+    for (int i = 0; i < length; i++) {
+        if (table[i] != (unsigned char)signature[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Computes an ACPI table checksum
+ * @return 0 if the table is valid
+ */
+static unsigned char acpi_checksum(unsigned char *table, unsigned int length) {
+    unsigned char sum = 0;
+
+    for (unsigned int i = 0; i < length; i++) {
+        sum += table[i];
+    }
+
+    return sum;
+}
+
+/**
+ * Searches a memory range for the ACPI root system description pointer
+ * @return pointer to the RSDP or NULL if not found
+ */
+static unsigned char *acpi_find_rsdp(unsigned int start, unsigned int end) {
+    for (unsigned int addr = start; addr < end; addr += 16) {
+        unsigned char *rsdp = (unsigned char *)addr;
+
+        if (acpi_signature(rsdp, "RSD PTR ", 8) && acpi_checksum(rsdp, 20) == 0) {
+            return rsdp;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Locates the MADT ("APIC") table via the RSDP and RSDT
+ * @return pointer to the MADT or NULL if not found
+ */
+static unsigned char *acpi_find_madt(void) {
+    unsigned char *rsdp;
+    unsigned char *rsdt;
+    unsigned int ebda = (*(unsigned short *)0x40e) << 4;
+
+    // The RSDP is either in the first KB of the EBDA or in the BIOS area
+    rsdp = ebda ? acpi_find_rsdp(ebda, ebda + 1024) : NULL;
+    if (!rsdp) {
+        rsdp = acpi_find_rsdp(0xe0000, 0x100000);
+    }
+
+    if (!rsdp) {
+        return NULL;
+    }
+
+    rsdt = (unsigned char *)*(unsigned int *)(rsdp + 16);
+    if (!acpi_signature(rsdt, "RSDT", 4)) {
+        return NULL;
+    }
+
+    unsigned int length = *(unsigned int *)(rsdt + 4);
+    for (unsigned int offset = 36; offset + 4 <= length; offset += 4) {
+        unsigned char *table = (unsigned char *)*(unsigned int *)(rsdt + offset);
+
+        if (acpi_signature(table, "APIC", 4)) {
+            return table;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Parses the MADT for the local APIC, IOAPIC and ISA IRQ overrides
+ * @return 0 on success, -1 if no IOAPIC was described
+ */
+static int apic_parse_madt(unsigned char *madt) {
+    unsigned int length = *(unsigned int *)(madt + 4);
+    unsigned int offset = 44;
+
+    lapic_base = (volatile unsigned int *)*(unsigned int *)(madt + 36);
+
+    while (offset + 2 <= length) {
+        unsigned char type = madt[offset];
+        unsigned char entry_len = madt[offset + 1];
+
+        if (entry_len < 2) {
+            break;
+        }
+
+        if (type == MADT_LAPIC) {
+            // Only processors marked as enabled can be started
+            if ((*(unsigned int *)(madt + offset + 4) & 0x1) && apic_cpus < CPU_MAX) {
+                apic_cpu_ids[apic_cpus++] = madt[offset + 3];
+            }
+        } else if (type == MADT_IOAPIC && ioapic_base == NULL) {
+            // Only the IOAPIC serving GSI 0 (the ISA IRQs) is used
+            if (*(unsigned int *)(madt + offset + 8) == 0) {
+                ioapic_base = (volatile unsigned int *)*(unsigned int *)(madt + offset + 4);
+            }
+        } else if (type == MADT_OVERRIDE) {
+            unsigned char source = madt[offset + 3];
+            unsigned int gsi = *(unsigned int *)(madt + offset + 4);
+            unsigned short flags = *(unsigned short *)(madt + offset + 8);
+
+            if (source < APIC_IRQ_LINES) {
+                apic_irq_gsi[source] = gsi;
+                apic_irq_flags[source] = 0;
+
+                if ((flags & 0x3) == 0x3) {
+                    apic_irq_flags[source] |= IOAPIC_ACTIVE_LOW;
+                }
+
+                if (((flags >> 2) & 0x3) == 0x3) {
+                    apic_irq_flags[source] |= IOAPIC_LEVEL;
+                }
+
+                kernel_log_debug("apic: IRQ %d overridden to GSI %d flags=0x%04x", source, gsi, flags);
+            }
+        }
+
+        offset += entry_len;
+    }
+
+    return ioapic_base ? 0 : -1;
+}
+
+/**
+ * Measures how many local APIC timer counts and TSC cycles elapse in
+ * APIC_CALIBRATE_MS milliseconds using PIT channel 2
+ */
+static void apic_timer_calibrate(unsigned int *lapic_counts, unsigned long long *tsc_cycles) {
+    unsigned long long tsc_start;
+
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    // Start the PIT countdown and both counters together
+    clock_pit_start(APIC_CALIBRATE_MS);
+    lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+    tsc_start = kernel_rdtsc();
+
+    clock_pit_wait();
+
+    *tsc_cycles = kernel_rdtsc() - tsc_start;
+    *lapic_counts = 0xffffffff - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/**
+ * Local APIC spurious interrupt handler
+ * Spurious interrupts must not be acknowledged, so there is nothing to do
+ */
+void apic_spurious_handler(void) {
+}
+
+/**
+ * Detects and enables the local APIC and IOAPIC
+ * @return 0 if the APIC is in use, -1 if the PIC remains in use
+ */
+int apic_init(void) {
+    unsigned int ecx, edx;
+    unsigned char *madt;
+    int entries;
+
+    if (!APIC_ENABLE) {
+        kernel_log_info("apic: disabled at build time, using the PIC");
+        return -1;
+    }
+
+    apic_cpuid(1, &ecx, &edx);
+    if ((edx & CPUID_EDX_APIC) == 0) {
+        kernel_log_info("apic: no local APIC, using the PIC");
+        return -1;
+    }
+
+    for (int i = 0; i < APIC_IRQ_LINES; i++) {
+        apic_irq_gsi[i] = i;
+        apic_irq_flags[i] = 0;
+        apic_irq_vector[i] = APIC_IRQ_VECTOR(i, 0);
+    }
+    apic_cpus = 0;
+
+    madt = acpi_find_madt();
+    if (!madt || apic_parse_madt(madt) != 0) {
+        kernel_log_info("apic: no IOAPIC described by ACPI, using the PIC");
+        return -1;
+    }
+
+    // Make sure the local APIC is globally enabled at its reported base
+    apic_wrmsr(MSR_APIC_BASE, apic_rdmsr(MSR_APIC_BASE) | MSR_APIC_BASE_ENABLE);
+
+    // Mask off every line on both PICs; the IOAPIC takes over
+    pic_mask_set(0xffff);
+
+    // Software-enable the local APIC and accept all priorities
+    interrupts_irq_register(IRQ_APIC_SPURIOUS, isr_entry_apic_spurious, apic_spurious_handler);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IRQ_APIC_SPURIOUS);
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    // Start with all ISA IRQs masked, delivered to this CPU
+    entries = ((ioapic_read(IOAPIC_REG_VER) >> 16) & 0xff) + 1;
+    for (int i = 0; i < APIC_IRQ_LINES; i++) {
+        if (apic_irq_gsi[i] >= entries) {
+            continue;
+        }
+
+        ioapic_write(IOAPIC_REG_REDTBL + apic_irq_gsi[i] * 2 + 1, lapic_read(LAPIC_ID) & 0xff000000);
+        ioapic_write(IOAPIC_REG_REDTBL + apic_irq_gsi[i] * 2,
+                     IOAPIC_MASKED | apic_irq_flags[i] | apic_irq_vector[i]);
+    }
+
+    apic_mask = 0xffff;
+    apic_active = 1;
+
+    kernel_log_info("apic: local APIC at 0x%08x, IOAPIC at 0x%08x (%d pins)",
+                    (unsigned int)lapic_base, (unsigned int)ioapic_base, entries);
+    return 0;
+}
+
+/**
+ * Indicates if interrupts are being delivered through the APIC
+ * @return 1 if the APIC is in use, 0 if the PIC is in use
+ */
+int apic_enabled(void) {
+    return apic_active;
+}
+
+/**
+ * Returns the local APIC id of the calling CPU
+ * @return local APIC id
+ */
+int apic_id(void) {
+    if (!apic_active) {
+        return 0;
+    }
+
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+/**
+ * Returns the number of enabled CPUs described by ACPI
+ * @return number of CPUs (including the bootstrap CPU)
+ */
+int apic_cpu_count(void) {
+    return apic_active ? apic_cpus : 1;
+}
+
+/**
+ * Returns the local APIC id of the given CPU described by ACPI
+ * @param n - CPU index (0 to apic_cpu_count()-1)
+ * @return local APIC id or -1 on error
+ */
+int apic_cpu_apic_id(int n) {
+    if (n < 0 || n >= apic_cpus) {
+        return -1;
+    }
+
+    return apic_cpu_ids[n];
+}
+
+/**
+ * Sends an IPI and waits for the local APIC to accept it
+ */
+static void apic_ipi_send(int apic_id, unsigned int icr) {
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+
+    while (lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) {
+        asm volatile("pause");
+    }
+}
+
+/**
+ * Sends an INIT IPI followed by two startup IPIs to the given CPU
+ * (the INIT-SIPI-SIPI sequence from the MultiProcessor Specification)
+ *
+ * @param apic_id - local APIC id of the target CPU
+ * @param addr - physical address of the startup code (page aligned, below 1MB)
+ */
+void apic_cpu_start(int apic_id, unsigned int addr) {
+    apic_ipi_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    apic_ipi_send(apic_id, LAPIC_ICR_INIT | LAPIC_ICR_LEVEL);
+    udelay(10000);
+
+    for (int i = 0; i < 2; i++) {
+        apic_ipi_send(apic_id, LAPIC_ICR_STARTUP | ((addr >> 12) & 0xff));
+        udelay(200);
+    }
+}
+
+/**
+ * Enables the local APIC and its timer on an application processor
+ * Application processors always use periodic mode
+ */
+void apic_ap_init(void) {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IRQ_APIC_SPURIOUS);
+    lapic_write(LAPIC_TPR, 0);
+
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, apic_irq_vector[0] | LAPIC_LVT_PERIODIC);
+    lapic_write(LAPIC_TIMER_INIT, apic_timer_count);
+}
+
+/**
+ * Returns the mask of disabled IRQs
+ * @return - IRQ mask (bit n set if IRQ n is disabled)
+ */
+unsigned int apic_mask_get(void) {
+    return apic_mask;
+}
+
+/**
+ * Sets the mask of disabled IRQs, only touching lines that change
+ * @param mask - IRQ mask (bit n set if IRQ n is disabled)
+ */
+void apic_mask_set(unsigned int mask) {
+    unsigned int changed = (apic_mask ^ mask) & 0xffff;
+
+    for (int irq = 0; changed; irq++, changed >>= 1) {
+        if ((changed & 1) == 0) {
+            continue;
+        }
+
+        int masked = (mask & (1 << irq)) ? IOAPIC_MASKED : 0;
+
+        if (irq == 0) {
+            // IRQ 0 is the local APIC timer; LAPIC_LVT_MASKED == IOAPIC_MASKED
+            lapic_write(LAPIC_LVT_TIMER, (lapic_read(LAPIC_LVT_TIMER) & ~LAPIC_LVT_MASKED) | masked);
+        } else {
+            int reg = IOAPIC_REG_REDTBL + apic_irq_gsi[irq] * 2;
+            ioapic_write(reg, masked | apic_irq_flags[irq] | apic_irq_vector[irq]);
+        }
+    }
+
+    apic_mask = mask & 0xffff;
+}
+
+/**
+ * Moves an IRQ to the vector block of its priority
+ * @param irq - IRQ number
+ * @param priority - IRQ_PRIORITY_NONE or a higher priority level
+ */
+void apic_irq_priority_set(int irq, int priority) {
+    irq &= 0xf;
+    apic_irq_vector[irq] = APIC_IRQ_VECTOR(irq, priority);
+
+    if (!apic_active) {
+        return;
+    }
+
+    if (irq == 0) {
+        lapic_write(LAPIC_LVT_TIMER, (lapic_read(LAPIC_LVT_TIMER) & ~0xff) | apic_irq_vector[0]);
+    } else {
+        int masked = (apic_mask & (1 << irq)) ? IOAPIC_MASKED : 0;
+        int reg = IOAPIC_REG_REDTBL + apic_irq_gsi[irq] * 2;
+
+        ioapic_write(reg, masked | apic_irq_flags[irq] | apic_irq_vector[irq]);
+    }
+}
+
+/**
+ * Raises the task priority of the calling CPU's local APIC so only IRQs of
+ * a higher priority are delivered; the others stay pending in the local
+ * APIC until the task priority is restored
+ * @param priority - priority of the IRQ being handled
+ * @return the previous task priority
+ */
+unsigned int apic_priority_raise(int priority) {
+    unsigned int tpr = lapic_read(LAPIC_TPR);
+
+    // Blocks every vector block up to and including the one of the priority
+    lapic_write(LAPIC_TPR, APIC_IRQ_VECTOR(0, priority));
+    return tpr;
+}
+
+/**
+ * Restores the task priority returned by apic_priority_raise()
+ * @param tpr - the previous task priority
+ */
+void apic_priority_restore(unsigned int tpr) {
+    lapic_write(LAPIC_TPR, tpr);
+}
+
+/**
+ * Enables the specified IRQ
+ * @param irq - IRQ number
+ */
+void apic_irq_enable(int irq) {
+    apic_mask_set(apic_mask & ~(1 << (irq & 0xf)));
+}
+
+/**
+ * Disables the specified IRQ
+ * @param irq - IRQ number
+ */
+void apic_irq_disable(int irq) {
+    apic_mask_set(apic_mask | (1 << (irq & 0xf)));
+}
+
+/**
+ * Dismisses the current IRQ with a single write to the EOI register
+ * In TSC-deadline mode the timer is re-armed for the next tick
+ * @param irq - IRQ number
+ */
+void apic_irq_dismiss(int irq) {
+    if ((irq & 0xf) == 0 && apic_timer_mode == APIC_TIMER_TSC_DEADLINE && smp_cpu_id() == 0) {
+        unsigned long long now = kernel_rdtsc();
+
+        apic_tsc_deadline += apic_tsc_period;
+        if (apic_tsc_deadline <= now) {
+            // Ticks were missed; don't try to catch up with a burst
+            apic_tsc_deadline = now + apic_tsc_period;
+        }
+
+        apic_wrmsr(MSR_TSC_DEADLINE, apic_tsc_deadline);
+    }
+
+    lapic_write(LAPIC_EOI, 0);
+}
+
+/**
+ * Starts the local APIC timer on IRQ 0 at the given rate
+ * @param hz - number of timer interrupts per second
+ * @return 0 on success, -1 on error
+ */
+int apic_timer_start(int hz) {
+    unsigned int lapic_counts;
+    unsigned long long tsc_cycles;
+    unsigned int ecx, edx;
+    unsigned int lvt;
+
+    if (!apic_active || hz <= 0) {
+        return -1;
+    }
+
+    apic_timer_calibrate(&lapic_counts, &tsc_cycles);
+
+    // Divide first so everything stays in 32-bit arithmetic
+    apic_timer_count = lapic_counts / hz * (1000 / APIC_CALIBRATE_MS);
+    apic_tsc_period = (unsigned int)tsc_cycles / hz * (1000 / APIC_CALIBRATE_MS);
+
+    apic_cpuid(1, &ecx, &edx);
+    apic_timer_mode = APIC_TIMER_MODE;
+    if (apic_timer_mode == APIC_TIMER_TSC_DEADLINE && (ecx & CPUID_ECX_TSC_DEADLINE) == 0) {
+        kernel_log_warn("apic: TSC-deadline mode not supported, using periodic mode");
+        apic_timer_mode = APIC_TIMER_PERIODIC;
+    }
+
+    // Keep the current mask state of IRQ 0
+    lvt = apic_irq_vector[0] | (apic_mask & 1 ? LAPIC_LVT_MASKED : 0);
+
+    if (apic_timer_mode == APIC_TIMER_TSC_DEADLINE) {
+        lapic_write(LAPIC_LVT_TIMER, lvt | LAPIC_LVT_TSC_DEADLINE);
+        apic_tsc_deadline = kernel_rdtsc() + apic_tsc_period;
+        apic_wrmsr(MSR_TSC_DEADLINE, apic_tsc_deadline);
+    } else {
+        lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+        lapic_write(LAPIC_LVT_TIMER, lvt | LAPIC_LVT_PERIODIC);
+        lapic_write(LAPIC_TIMER_INIT, apic_timer_count);
+    }
+
+    kernel_log_info("apic: timer started at %d Hz (%s, %u counts, %u TSC cycles per tick)", hz,
+                    apic_timer_mode == APIC_TIMER_TSC_DEADLINE ? "tsc-deadline" : "periodic",
+                    apic_timer_count, (unsigned int)apic_tsc_period);
+    return 0;
+}
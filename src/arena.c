@@ -0,0 +1,241 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * User heap arenas (allocator library for user programs)
+ *
+ * An arena cuts blocks from chunks of heap memory it takes from the kernel
+ * with sbrk. Every block has a small header with its size. Freed blocks of
+ * up to ARENA_SMALL_MAX bytes go on the free list of their size class and
+ * come back in O(1); larger blocks go on a single list that is searched
+ * first fit. Only when no freed block fits is a new block cut from the
+ * current chunk, and only when the chunks are used up is the kernel asked
+ * for more.
+ *
+ * arena_reset drops every block at once by emptying the free lists and
+ * cutting from the first chunk again, so a program that builds up data and
+ * throws it all away never frees blocks one by one or calls the kernel.
+ */
+#include "arena.h"
+#include "syscall.h"
+
+// Header word of an allocated / free block
+#define ARENA_MAGIC_USED 0xa110c8ed
+#define ARENA_MAGIC_FREE 0xf4eeb10c
+
+// Chunk of heap memory; blocks follow the header
+typedef struct arena_chunk_t {
+    struct arena_chunk_t *next;         // Next chunk, in the order they were taken
+    unsigned int size;                  // Bytes after the header
+} arena_chunk_t;
+
+// Block header, in front of the memory handed out
+typedef struct arena_block_t {
+    unsigned int size;                  // Bytes after the header
+    unsigned int magic;                 // ARENA_MAGIC_USED or ARENA_MAGIC_FREE
+} arena_block_t;
+
+#define ARENA_ALIGN(n) (((n) + 7) / 8 * 8)
+#define ARENA_CHUNK_HEADER ARENA_ALIGN(sizeof(arena_chunk_t))
+
+/**
+ * Takes memory from the heap, 8 byte aligned
+ * @return pointer to the memory, NULL if the heap can't grow
+ */
+static void *arena_sbrk(unsigned int size) {
+    char *mem = sbrk(size + 7);
+
+    if (mem == (char *)-1) {
+        return 0;
+    }
+
+    return (void *)ARENA_ALIGN((unsigned long)mem);
+}
+
+/**
+ * Makes a chunk the one new blocks are cut from
+ */
+static void arena_use(arena_t *arena, arena_chunk_t *chunk) {
+    arena->current = chunk;
+    arena->next = (char *)chunk + ARENA_CHUNK_HEADER;
+    arena->limit = arena->next + chunk->size;
+}
+
+/**
+ * Cuts a new block from the chunks, taking another chunk from the heap if
+ * none of the remaining ones has room
+ * @return pointer to the block header, NULL if the heap can't grow
+ */
+static arena_block_t *arena_cut(arena_t *arena, unsigned int size) {
+    unsigned int need = sizeof(arena_block_t) + size;
+    arena_chunk_t *chunk;
+    arena_block_t *block;
+
+    // Chunks left over from before a reset are used again, in order
+    while (arena->current && (unsigned int)(arena->limit - arena->next) < need && arena->current->next) {
+        arena_use(arena, arena->current->next);
+    }
+
+    if (!arena->current || (unsigned int)(arena->limit - arena->next) < need) {
+        unsigned int chunk_size = need > ARENA_CHUNK_SIZE ? need : ARENA_CHUNK_SIZE;
+
+        if (!(chunk = arena_sbrk(ARENA_CHUNK_HEADER + chunk_size))) {
+            return 0;
+        }
+
+        chunk->next = 0;
+        chunk->size = chunk_size;
+        arena->heap += ARENA_CHUNK_HEADER + chunk_size;
+
+        if (arena->current) {
+            arena->current->next = chunk;
+        } else {
+            arena->chunks = chunk;
+        }
+
+        arena_use(arena, chunk);
+    }
+
+    block = (arena_block_t *)arena->next;
+    block->size = size;
+    arena->next += need;
+
+    return block;
+}
+
+/**
+ * Creates an arena in the heap of the current process
+ * @return pointer to the arena, NULL if the heap can't grow
+ */
+arena_t *arena_create(void) {
+    arena_t *arena = arena_sbrk(sizeof(arena_t));
+
+    if (!arena) {
+        return 0;
+    }
+
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        arena->free[i] = 0;
+    }
+
+    arena->large = 0;
+    arena->chunks = 0;
+    arena->current = 0;
+    arena->next = 0;
+    arena->limit = 0;
+    arena->in_use = 0;
+    arena->heap = 0;
+
+    return arena;
+}
+
+/**
+ * Allocates memory from an arena
+ * The memory is 8 byte aligned and not cleared
+ * @param arena - the arena
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if the heap can't grow
+ */
+void *arena_alloc(arena_t *arena, unsigned int size) {
+    arena_block_t *block = 0;
+    void **link;
+    int class = 0;
+
+    if (!arena || size == 0 || size > 0x7fffffff) {
+        return 0;
+    }
+
+    if (size <= ARENA_SMALL_MAX) {
+        while ((ARENA_SMALL_MIN << class) < (int)size) {
+            class++;
+        }
+
+        size = ARENA_SMALL_MIN << class;
+
+        if (arena->free[class]) {
+            block = (arena_block_t *)arena->free[class] - 1;
+            arena->free[class] = *(void **)arena->free[class];
+        }
+    } else {
+        size = ARENA_ALIGN(size);
+
+        // First fit; the block keeps its size, so it is freed whole
+        for (link = &arena->large; *link; link = (void **)*link) {
+            if (((arena_block_t *)*link - 1)->size >= size) {
+                block = (arena_block_t *)*link - 1;
+                *link = *(void **)*link;
+                break;
+            }
+        }
+    }
+
+    if (!block && !(block = arena_cut(arena, size))) {
+        return 0;
+    }
+
+    block->magic = ARENA_MAGIC_USED;
+    arena->in_use += sizeof(arena_block_t) + block->size;
+
+    return block + 1;
+}
+
+/**
+ * Returns memory to its arena
+ * @param arena - the arena the memory was allocated from
+ * @param ptr - pointer to the memory (NULL is ignored)
+ * @return 0 on success, -1 on error (e.g. a double free)
+ */
+int arena_free(arena_t *arena, void *ptr) {
+    arena_block_t *block;
+    void **list;
+    int class = 0;
+
+    if (!ptr) {
+        return 0;
+    }
+
+    block = (arena_block_t *)ptr - 1;
+
+    if (!arena || ((unsigned long)ptr & 7) || block->magic != ARENA_MAGIC_USED) {
+        return -1;
+    }
+
+    if (block->size <= ARENA_SMALL_MAX) {
+        while ((unsigned int)(ARENA_SMALL_MIN << class) < block->size) {
+            class++;
+        }
+
+        list = &arena->free[class];
+    } else {
+        list = &arena->large;
+    }
+
+    block->magic = ARENA_MAGIC_FREE;
+    *(void **)ptr = *list;
+    *list = ptr;
+    arena->in_use -= sizeof(arena_block_t) + block->size;
+
+    return 0;
+}
+
+/**
+ * Frees everything allocated from an arena at once
+ * The arena keeps its heap memory, so refilling it doesn't call the kernel
+ * @param arena - the arena
+ */
+void arena_reset(arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        arena->free[i] = 0;
+    }
+
+    arena->large = 0;
+    arena->in_use = 0;
+
+    if (arena->chunks) {
+        arena_use(arena, arena->chunks);
+    }
+}
@@ -0,0 +1,305 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel micro-benchmarks
+ *
+ * Results are printed to the host console. Each benchmark keeps a copy of
+ * the implementation it replaced so both can be measured on the same build.
+ *
+ * Benchmarks run as kernel processes rather than from the keyboard IRQ, so
+ * the system keeps running while they are timed. The kernel lock is only
+ * taken around allocations and console output.
+ */
+#include <spede/string.h>
+
+#include "bench.h"
+#include "bit.h"
+#include "bitmap.h"
+#include "clock.h"
+#include "kernel.h"
+#include "ringbuf.h"
+#include "smp.h"
+
+/**
+ * Reports a throughput measurement
+ * @param name - name of the implementation
+ * @param size - transfer size in bytes
+ * @param bytes - total number of bytes moved
+ * @param cycles - TSC cycles taken
+ */
+static void bench_report(char *name, int size, unsigned int bytes, unsigned long long cycles) {
+    // Runs are kept well under 2^32 cycles so 32-bit arithmetic is enough
+    unsigned int c = (unsigned int)cycles;
+    unsigned int us = (unsigned int)clock_cycles_to_ns(cycles) / 1000;
+
+    smp_kernel_lock();
+    kernel_log_info("bench: %-6s %5d bytes/transfer: %4u.%02u cycles/byte, %6u MB/s",
+                    name, size, c / bytes, (c % bytes) * 100 / bytes,
+                    us ? bytes / us : 0);
+    smp_kernel_unlock();
+}
+
+/**
+ * Ring buffer transfers as they were before the bulk-copy rewrite:
+ * one ringbuf_write/ringbuf_read call per byte with a wraparound branch
+ */
+typedef struct bench_ringbuf_old_t {
+    int head;
+    int tail;
+    int size;
+    char data[RINGBUF_SIZE];
+} bench_ringbuf_old_t;
+
+static int bench_ringbuf_old_write(bench_ringbuf_old_t *buf, char byte) {
+    if (!buf) {
+        return -1;
+    }
+
+    if (buf->size == RINGBUF_SIZE) {
+        return -1;
+    }
+
+    buf->data[buf->tail] = byte;
+
+    buf->tail++;
+
+    if (buf->tail == RINGBUF_SIZE) {
+        buf->tail = 0;
+    }
+
+    buf->size++;
+
+    return 0;
+}
+
+static int bench_ringbuf_old_read(bench_ringbuf_old_t *buf, char *byte) {
+    if (!buf || !byte) {
+        return -1;
+    }
+
+    if (buf->size == 0) {
+        return -1;
+    }
+
+    *byte = buf->data[buf->head];
+
+    buf->head++;
+
+    if (buf->head == RINGBUF_SIZE) {
+        buf->head = 0;
+    }
+
+    buf->size--;
+
+    return 0;
+}
+
+static int bench_ringbuf_old_write_mem(bench_ringbuf_old_t *buf, char *mem, size_t size) {
+    if (!buf) {
+        return -1;
+    }
+
+    if (buf->size + size > RINGBUF_SIZE) {
+        return -1;
+    }
+
+    while (size-- && buf->size != RINGBUF_SIZE) {
+        bench_ringbuf_old_write(buf, *mem++);
+    }
+
+    return 0;
+}
+
+static int bench_ringbuf_old_read_mem(bench_ringbuf_old_t *buf, char *mem, size_t size) {
+    int count = 0;
+
+    if (!buf) {
+        return -1;
+    }
+
+    while (size-- && buf->size != 0) {
+        bench_ringbuf_old_read(buf, mem++);
+        count++;
+    }
+
+    return count;
+}
+
+// Buffers are static; they are too large for the kernel stack
+static bench_ringbuf_old_t bench_old;
+static ringbuf_t bench_new;
+static char bench_src[RINGBUF_SIZE];
+static char bench_dst[RINGBUF_SIZE];
+
+/**
+ * Compares the byte-at-a-time and bulk-copy ring buffer transfers
+ *
+ * For each transfer size, BENCH_RINGBUF_BYTES are written and read back
+ * in transfers of that size. The buffers start part-way through so the
+ * larger transfers also exercise the wraparound.
+ *
+ * Runs as a kernel process (see kproc_create)
+ */
+void bench_ringbuf(void) {
+    int sizes[] = { 1, 64, 2048 };
+    unsigned long long start;
+    unsigned long long cycles;
+
+    for (int i = 0; i < RINGBUF_SIZE; i++) {
+        bench_src[i] = (char)i;
+    }
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s];
+        int transfers = BENCH_RINGBUF_BYTES / size;
+
+        memset(&bench_old, 0, sizeof(bench_old));
+        bench_old.head = bench_old.tail = RINGBUF_SIZE / 3;
+
+        start = kernel_rdtsc();
+        for (int t = 0; t < transfers; t++) {
+            bench_ringbuf_old_write_mem(&bench_old, bench_src, size);
+            bench_ringbuf_old_read_mem(&bench_old, bench_dst, size);
+        }
+        cycles = kernel_rdtsc() - start;
+        bench_report("old", size, transfers * size, cycles);
+
+        smp_kernel_lock();
+        ringbuf_init(&bench_new, RINGBUF_SIZE);
+        smp_kernel_unlock();
+        bench_new.head = bench_new.tail = RINGBUF_SIZE / 3;
+
+        start = kernel_rdtsc();
+        for (int t = 0; t < transfers; t++) {
+            ringbuf_write_mem(&bench_new, bench_src, size);
+            ringbuf_read_mem(&bench_new, bench_dst, size);
+        }
+        cycles = kernel_rdtsc() - start;
+        bench_report("new", size, transfers * size, cycles);
+
+        smp_kernel_lock();
+        ringbuf_destroy(&bench_new);
+        smp_kernel_unlock();
+
+        for (int i = 0; i < size; i++) {
+            if (bench_src[i] != bench_dst[i]) {
+                smp_kernel_lock();
+                kernel_log_error("bench: ring buffer data mismatch at %d bytes/transfer", size);
+                smp_kernel_unlock();
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Reports the cost of a single operation
+ * @param name - name of the implementation
+ * @param ops - number of operations performed
+ * @param cycles - TSC cycles taken
+ */
+static void bench_report_ops(char *name, unsigned int ops, unsigned long long cycles) {
+    // Runs are kept well under 2^32 cycles so 32-bit arithmetic is enough
+    unsigned int c = (unsigned int)cycles;
+    unsigned int ns = (unsigned int)clock_cycles_to_ns(cycles);
+
+    smp_kernel_lock();
+    kernel_log_info("bench: %-16s %6u.%02u cycles/op, %6u.%02u ns/op",
+                    name, c / ops, (c % ops) * 100 / ops,
+                    ns / ops, (ns % ops) * 100 / ops);
+    smp_kernel_unlock();
+}
+
+/**
+ * bit_count as it was before the bitmap library: one call per bit position
+ */
+static unsigned int bench_bit_count_old(unsigned int value) {
+    if (value == 0) {
+        return 0;
+    }
+    if ((value & 1) == 1) {
+        return 1 + bench_bit_count_old(value >> 1);
+    } else {
+        return bench_bit_count_old(value >> 1);
+    }
+}
+
+/**
+ * First set bit of a bitmap using only the single-bit helpers
+ */
+static int bench_bit_first_set_old(unsigned int *map, int bits) {
+    for (int i = 0; i < bits; i++) {
+        if (bit_test(map[i / 32], i % 32)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Bitmap searched by the find-first-set benchmark
+#define BENCH_BIT_MAP_BITS 256
+static unsigned int bench_bit_map[BITMAP_WORDS(BENCH_BIT_MAP_BITS)];
+
+/**
+ * Compares the recursive/bit-at-a-time bit helpers with the word-at-a-time
+ * bit and bitmap functions
+ *
+ * Population counts are taken over a spread of values; the searches look
+ * for a single bit that moves across the whole bitmap.
+ *
+ * Runs as a kernel process (see kproc_create)
+ */
+void bench_bit(void) {
+    volatile unsigned int sink = 0;
+    unsigned long long start;
+    unsigned long long cycles;
+    unsigned int value;
+
+    start = kernel_rdtsc();
+    value = 0x9e3779b9;
+    for (int i = 0; i < BENCH_BIT_OPS; i++) {
+        sink += bench_bit_count_old(value);
+        value = value * 1664525 + 1013904223;
+    }
+    cycles = kernel_rdtsc() - start;
+    bench_report_ops("count old", BENCH_BIT_OPS, cycles);
+
+    start = kernel_rdtsc();
+    value = 0x9e3779b9;
+    for (int i = 0; i < BENCH_BIT_OPS; i++) {
+        sink += bit_count(value);
+        value = value * 1664525 + 1013904223;
+    }
+    cycles = kernel_rdtsc() - start;
+    bench_report_ops("count new", BENCH_BIT_OPS, cycles);
+
+    start = kernel_rdtsc();
+    for (int i = 0; i < BENCH_BIT_OPS; i++) {
+        int bit = i % BENCH_BIT_MAP_BITS;
+
+        bitmap_set(bench_bit_map, bit);
+        sink += bench_bit_first_set_old(bench_bit_map, BENCH_BIT_MAP_BITS);
+        bitmap_clear(bench_bit_map, bit);
+    }
+    cycles = kernel_rdtsc() - start;
+    bench_report_ops("first set old", BENCH_BIT_OPS, cycles);
+
+    start = kernel_rdtsc();
+    for (int i = 0; i < BENCH_BIT_OPS; i++) {
+        int bit = i % BENCH_BIT_MAP_BITS;
+
+        bitmap_set(bench_bit_map, bit);
+        sink += bitmap_first_set(bench_bit_map, BENCH_BIT_MAP_BITS);
+        bitmap_clear(bench_bit_map, bit);
+    }
+    cycles = kernel_rdtsc() - start;
+    bench_report_ops("first set new", BENCH_BIT_OPS, cycles);
+
+    if (bit_count(0xf0f0f0f1) != bench_bit_count_old(0xf0f0f0f1)) {
+        smp_kernel_lock();
+        kernel_log_error("bench: bit_count mismatch");
+        smp_kernel_unlock();
+    }
+}
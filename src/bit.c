@@ -7,7 +7,7 @@
 //d
 /** Ahoy! //f
  * The following code assumes zero indexing
- * The following code assumes 16 bit values
+ * The following code assumes 32 bit values
  */
 //d
 #include "bit.h"
@@ -18,12 +18,13 @@ unsigned int bit_count(unsigned int value) {//f
  * @return number of bits that are set
  */
 //d
-    if(value == 0){return 0;}
-    if((value & 1) == 1){
-        return 1 + bit_count(value >> 1);
-    }else{
-        return bit_count(value >> 1);
-    }
+    // Add up neighbouring bits in parallel: 2-bit sums, then 4-bit sums,
+    // then let the multiply add the four byte sums into the top byte.
+    // (__builtin_popcount would need popcnt or a libgcc call)
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+    value = (value + (value >> 4)) & 0x0f0f0f0f;
+    return (value * 0x01010101) >> 24;
 }
 //d
 unsigned int bit_test(unsigned int value, int bit) {//f
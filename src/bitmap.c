@@ -0,0 +1,201 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Multi-word bitmaps
+ *
+ * Bit n lives in bit (n % 32) of word (n / 32). Searches look at a whole
+ * word at a time and use bsf/bsr on the first interesting one, so they
+ * cost one step per 32 bits instead of one per bit. Bits past the end of
+ * the bitmap in its last word are ignored.
+ */
+#include "bitmap.h"
+
+/**
+ * Returns the mask of bits in a word from the given bit upwards
+ * @param bit - bit number within the word (0 - 31)
+ */
+static inline unsigned int bitmap_mask_from(int bit) {
+    return ~0U << bit;
+}
+
+/**
+ * Returns the mask of the bits in the last word that belong to the bitmap
+ * @param bits - number of bits in the bitmap
+ */
+static inline unsigned int bitmap_mask_last(int bits) {
+    return (bits % 32) ? ~(~0U << (bits % 32)) : ~0U;
+}
+
+/**
+ * Applies a mask to every word covered by a range of bits
+ * @param map - pointer to the bitmap words
+ * @param start - first bit of the range
+ * @param count - number of bits in the range
+ * @param set - 1 to set the bits, 0 to clear them
+ */
+static void bitmap_range(unsigned int *map, int start, int count, int set) {
+    int end = start + count;
+
+    while (start < end) {
+        int bit = start % 32;
+        int n = (end - start < 32 - bit) ? end - start : 32 - bit;
+        unsigned int mask = (n == 32) ? ~0U : ((1U << n) - 1) << bit;
+
+        if (set) {
+            map[start / 32] |= mask;
+        } else {
+            map[start / 32] &= ~mask;
+        }
+
+        start += n;
+    }
+}
+
+/**
+ * Sets a range of bits
+ * @param map - pointer to the bitmap words
+ * @param start - first bit to set
+ * @param count - number of bits to set
+ */
+void bitmap_set_range(unsigned int *map, int start, int count) {
+    bitmap_range(map, start, count, 1);
+}
+
+/**
+ * Clears a range of bits
+ * @param map - pointer to the bitmap words
+ * @param start - first bit to clear
+ * @param count - number of bits to clear
+ */
+void bitmap_clear_range(unsigned int *map, int start, int count) {
+    bitmap_range(map, start, count, 0);
+}
+
+/**
+ * Counts the number of bits that are set
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return number of bits that are set
+ */
+int bitmap_count(unsigned int *map, int bits) {
+    int words = BITMAP_WORDS(bits);
+    int count = 0;
+
+    for (int w = 0; w < words; w++) {
+        unsigned int word = map[w];
+
+        if (w == words - 1) {
+            word &= bitmap_mask_last(bits);
+        }
+
+        count += bit_count(word);
+    }
+
+    return count;
+}
+
+/**
+ * Finds the next bit at or after start that is set in (map ^ invert)
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @param start - first bit to look at
+ * @param invert - 0 to find set bits, ~0 to find clear bits
+ * @return bit number, -1 if there is none
+ */
+static int bitmap_next(unsigned int *map, int bits, int start, unsigned int invert) {
+    int words = BITMAP_WORDS(bits);
+    int w;
+    unsigned int word;
+
+    if (start < 0) {
+        start = 0;
+    }
+
+    if (start >= bits) {
+        return -1;
+    }
+
+    w = start / 32;
+    word = (map[w] ^ invert) & bitmap_mask_from(start % 32);
+
+    while (1) {
+        if (w == words - 1) {
+            word &= bitmap_mask_last(bits);
+        }
+
+        if (word) {
+            return w * 32 + bit_ffs(word);
+        }
+
+        if (++w == words) {
+            return -1;
+        }
+
+        word = map[w] ^ invert;
+    }
+}
+
+/**
+ * Finds the next set bit at or after the given bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @param start - first bit to look at
+ * @return bit number, -1 if there are no more set bits
+ */
+int bitmap_next_set(unsigned int *map, int bits, int start) {
+    return bitmap_next(map, bits, start, 0);
+}
+
+/**
+ * Finds the next clear bit at or after the given bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @param start - first bit to look at
+ * @return bit number, -1 if there are no more clear bits
+ */
+int bitmap_next_clear(unsigned int *map, int bits, int start) {
+    return bitmap_next(map, bits, start, ~0U);
+}
+
+/**
+ * Finds the lowest set bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return bit number, -1 if no bits are set
+ */
+int bitmap_first_set(unsigned int *map, int bits) {
+    return bitmap_next(map, bits, 0, 0);
+}
+
+/**
+ * Finds the lowest clear bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return bit number, -1 if every bit is set
+ */
+int bitmap_first_clear(unsigned int *map, int bits) {
+    return bitmap_next(map, bits, 0, ~0U);
+}
+
+/**
+ * Finds the highest set bit
+ * @param map - pointer to the bitmap words
+ * @param bits - number of bits in the bitmap
+ * @return bit number, -1 if no bits are set
+ */
+int bitmap_last_set(unsigned int *map, int bits) {
+    for (int w = BITMAP_WORDS(bits) - 1; w >= 0; w--) {
+        unsigned int word = map[w];
+
+        if (w == BITMAP_WORDS(bits) - 1) {
+            word &= bitmap_mask_last(bits);
+        }
+
+        if (word) {
+            return w * 32 + bit_fls(word);
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,171 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Monotonic clock based on the CPU time-stamp counter
+ *
+ * The TSC is calibrated once against PIT channel 2. TSC cycles are turned
+ * into nanoseconds with a multiply and a shift (ns = cycles * mult >> shift)
+ * so no 64-bit division is needed after calibration. All CPUs are assumed
+ * to share a synchronized, constant-rate TSC.
+ */
+#include <spede/machine/io.h>
+
+#include "clock.h"
+#include "kernel.h"
+
+// PIT channel 2 is used as the calibration reference
+#define PIT_FREQ                1193182
+#define PIT_CH2_DATA            0x42
+#define PIT_CMD                 0x43
+#define PIT_CH2_GATE            0x61
+
+/**
+ * Variables
+ */
+
+// Calibrated TSC frequency (cycles per millisecond)
+unsigned int clock_khz;
+
+// TSC value at which the clock started
+unsigned long long clock_tsc_base;
+
+// Cycle to nanosecond conversion factors
+unsigned int clock_mult;
+int clock_shift;
+
+/**
+ * Divides a 64-bit value by a 32-bit value with two 32-bit divides
+ * (avoids pulling in the compiler's 64-bit division helpers)
+ * @param n - dividend
+ * @param d - divisor
+ * @return quotient
+ */
+static unsigned long long clock_div(unsigned long long n, unsigned int d) {
+    unsigned int hi = (unsigned int)(n >> 32);
+    unsigned int lo = (unsigned int)n;
+    unsigned int rem = hi % d;
+    unsigned int qhi = hi / d;
+    unsigned int qlo;
+
+    asm("divl %4" : "=a"(qlo), "=d"(rem) : "a"(lo), "d"(rem), "rm"(d));
+
+    return ((unsigned long long)qhi << 32) | qlo;
+}
+
+/**
+ * Starts a one-shot countdown on PIT channel 2
+ * @param ms - length of the countdown in milliseconds (at most 54)
+ */
+void clock_pit_start(unsigned int ms) {
+    unsigned int count = PIT_FREQ * ms / 1000;
+    unsigned char gate;
+
+    // Enable the channel 2 gate with the speaker disconnected
+    gate = (inportb(PIT_CH2_GATE) & ~0x02) | 0x01;
+    outportb(PIT_CH2_GATE, gate & ~0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outportb(PIT_CMD, 0xb0);
+    outportb(PIT_CH2_DATA, count & 0xff);
+    outportb(PIT_CH2_DATA, (count >> 8) & 0xff);
+
+    // Start the countdown
+    outportb(PIT_CH2_GATE, gate);
+}
+
+/**
+ * Busy waits until the countdown started by clock_pit_start() expires
+ */
+void clock_pit_wait(void) {
+    // Output 2 goes high once the count is reached
+    while ((inportb(PIT_CH2_GATE) & 0x20) == 0);
+}
+
+/**
+ * Measures how many TSC cycles elapse in CLOCK_CALIBRATE_MS milliseconds
+ * @return number of TSC cycles
+ */
+static unsigned long long clock_calibrate(void) {
+    unsigned long long start;
+
+    clock_pit_start(CLOCK_CALIBRATE_MS);
+    start = kernel_rdtsc();
+    clock_pit_wait();
+
+    return kernel_rdtsc() - start;
+}
+
+/**
+ * Calibrates the time-stamp counter against the PIT and starts the clock
+ */
+void clock_init(void) {
+    unsigned long long mult;
+
+    kernel_log_info("Initializing clock");
+
+    clock_khz = (unsigned int)clock_div(clock_calibrate(), CLOCK_CALIBRATE_MS);
+    if (clock_khz == 0) {
+        kernel_panic("clock: unable to calibrate the TSC");
+        return;
+    }
+
+    // Use the largest shift that keeps the multiplier within 32 bits
+    for (clock_shift = 32; clock_shift > 0; clock_shift--) {
+        mult = clock_div(1000000ULL << clock_shift, clock_khz);
+        if (mult <= 0xffffffffULL) {
+            break;
+        }
+    }
+    clock_mult = (unsigned int)mult;
+
+    clock_tsc_base = kernel_rdtsc();
+
+    kernel_log_info("clock: TSC running at %u kHz (mult=%u, shift=%d)", clock_khz, clock_mult, clock_shift);
+}
+
+/**
+ * Converts a number of TSC cycles to nanoseconds
+ * @param cycles - number of TSC cycles
+ * @return nanoseconds
+ */
+unsigned long long clock_cycles_to_ns(unsigned long long cycles) {
+    unsigned int hi = (unsigned int)(cycles >> 32);
+    unsigned int lo = (unsigned int)cycles;
+
+    // (hi * 2^32 + lo) * mult >> shift, without a 96-bit intermediate
+    return (((unsigned long long)hi * clock_mult) << (32 - clock_shift)) +
+           (((unsigned long long)lo * clock_mult) >> clock_shift);
+}
+
+/**
+ * Returns the number of nanoseconds since clock_init()
+ * @return nanoseconds since boot
+ */
+unsigned long long clock_now_ns(void) {
+    if (clock_khz == 0) {
+        return 0;
+    }
+
+    return clock_cycles_to_ns(kernel_rdtsc() - clock_tsc_base);
+}
+
+/**
+ * Returns the calibrated TSC frequency
+ * @return TSC cycles per millisecond
+ */
+unsigned int clock_tsc_khz(void) {
+    return clock_khz;
+}
+
+/**
+ * Busy waits for the given number of microseconds
+ * @param us - number of microseconds
+ */
+void udelay(unsigned int us) {
+    unsigned long long end = kernel_rdtsc() + clock_div((unsigned long long)us * clock_khz, 1000);
+
+    while (kernel_rdtsc() < end) {
+        asm volatile("pause");
+    }
+}
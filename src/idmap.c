@@ -0,0 +1,89 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Bitmap ID allocator
+ *
+ * Allocation looks for the first word that is not full and takes its
+ * lowest clear bit with a single bsf, so for tables of up to 32 entries
+ * it is one compare and one instruction. Freed ids are handed out again
+ * lowest first, which keeps the busy part of each table compact.
+ */
+#include <spede/string.h>
+
+#include "bitmap.h"
+#include "idmap.h"
+
+/**
+ * Initializes an allocator with every id free
+ * @param map - pointer to the allocator
+ * @param size - number of ids to manage (at most IDMAP_MAX)
+ * @return -1 on error, 0 on success
+ */
+int idmap_init(idmap_t *map, int size) {
+    if (!map || size <= 0 || size > IDMAP_MAX) {
+        return -1;
+    }
+
+    memset(map, 0, sizeof(idmap_t));
+    map->size = size;
+
+    // Mark the ids past the end of the last word as allocated so that
+    // idmap_alloc never has to range check
+    bitmap_set_range(map->bits, size, IDMAP_WORDS * 32 - size);
+
+    return 0;
+}
+
+/**
+ * Allocates the lowest free id
+ * @param map - pointer to the allocator
+ * @return -1 if every id is in use, otherwise the allocated id
+ */
+int idmap_alloc(idmap_t *map) {
+    if (!map || map->used == map->size) {
+        return -1;
+    }
+
+    for (int w = 0; w < IDMAP_WORDS; w++) {
+        int bit = bit_ffz(map->bits[w]);
+
+        if (bit >= 0) {
+            map->bits[w] |= 1U << bit;
+            map->used++;
+            return w * 32 + bit;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Frees an id
+ * @param map - pointer to the allocator
+ * @param id - the id to free
+ * @return -1 if the id is out of range or not allocated, 0 on success
+ */
+int idmap_free(idmap_t *map, int id) {
+    if (!idmap_test(map, id)) {
+        return -1;
+    }
+
+    bitmap_clear(map->bits, id);
+    map->used--;
+    return 0;
+}
+
+/**
+ * Indicates if an id is allocated
+ * @param map - pointer to the allocator
+ * @param id - the id to check
+ * @return 1 if allocated, 0 if free or out of range
+ */
+int idmap_test(idmap_t *map, int id) {
+    if (!map || id < 0 || id >= map->size) {
+        return 0;
+    }
+
+    return bitmap_test(map->bits, id);
+}
@@ -9,11 +9,12 @@
 #include <spede/machine/seg.h>
 #include <spede/string.h>
 
+#include "apic.h"
 #include "kernel.h"
 #include "interrupts.h"
 
 // Maximum number of ISR handlers
-#define IRQ_MAX      0xf0
+#define IRQ_MAX      IRQ_VECTOR_MAX
 
 // PIC Definitions
 #define PIC1_BASE   0x20            // base address for PIC primary controller
@@ -29,9 +30,85 @@
 struct i386_gate *idt = NULL;
 
 // Interrupt handler table
-// Contains an array of function pointers associated with
-// the various interrupts to be handled
-void (*irq_handlers[IRQ_MAX])();
+// Contains a chain of function pointers associated with
+// each of the various interrupts to be handled
+void (*irq_handlers[IRQ_MAX][IRQ_HANDLERS_MAX])();
+
+// Interrupt statistics table
+irq_stats_t irq_stats[IRQ_MAX];
+
+// IRQ priority table
+int irq_priority[IRQ_MAX];
+
+// PIC lines to mask while an IRQ of the given PIC line is being handled
+// (every line with an equal or lower priority)
+unsigned int irq_priority_mask[16];
+
+// Interrupt flag bit in EFLAGS
+#define EFLAGS_IF   0x200
+
+/**
+ * Interrupt controller helpers
+ * Dispatch to the local APIC/IOAPIC when it is in use, otherwise the PIC
+ */
+static void irq_enable(int irq) {
+    if (apic_enabled()) {
+        apic_irq_enable(irq);
+    } else {
+        pic_irq_enable(irq);
+    }
+}
+
+static void irq_dismiss(int irq) {
+    if (apic_enabled()) {
+        apic_irq_dismiss(irq);
+    } else {
+        pic_irq_dismiss(irq);
+    }
+}
+
+/**
+ * Holds back IRQs of equal and lower priority than the given one
+ * The local APIC keeps them pending through its task priority; the PIC
+ * masks their lines, which still latches their requests
+ * @return state to pass to irq_priority_restore()
+ */
+static unsigned int irq_priority_raise(int irq) {
+    unsigned int mask;
+
+    if (apic_enabled()) {
+        return apic_priority_raise(irq_priority[irq]);
+    }
+
+    mask = pic_mask_get();
+    pic_mask_set(mask | irq_priority_mask[irq - 0x20]);
+    return mask;
+}
+
+/**
+ * Lets the IRQs held back by irq_priority_raise() through again
+ * @param state - value returned by irq_priority_raise()
+ */
+static void irq_priority_restore(unsigned int state) {
+    if (apic_enabled()) {
+        apic_priority_restore(state);
+    } else {
+        pic_mask_set(state);
+    }
+}
+
+/**
+ * Points the vector the APIC delivers an IRQ on at the IRQ's IDT entry
+ * IRQs with a raised priority arrive on a vector above 0x2f (see
+ * APIC_IRQ_VECTOR); their entries still report the IRQ number itself
+ */
+static void irq_vector_sync(int irq) {
+    int vector = APIC_IRQ_VECTOR(irq - 0x20, irq_priority[irq]);
+
+    if (apic_enabled() && vector != irq && irq_handlers[irq][0] != NULL) {
+        idt[vector] = idt[irq];
+    }
+}
 
 /**
  * Enable interrupts with the CPU
@@ -50,25 +127,198 @@ void interrupts_disable(void) {
 }
 
 /**
- * Handles the specified interrupt by dispatching to the registered function
+ * Disables interrupts with the CPU and returns the previous state
+ * @return - the previous EFLAGS value
+ */
+unsigned int interrupts_save_disable(void) {
+    unsigned int flags;
+
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+/**
+ * Restores the interrupt state returned by interrupts_save_disable()
+ * @param flags - the previous EFLAGS value
+ */
+void interrupts_restore(unsigned int flags) {
+    if (flags & EFLAGS_IF) {
+        asm volatile("sti" : : : "memory");
+    }
+}
+
+/**
+ * Sets the priority of the specified IRQ and recomputes the PIC masks
+ * used while handling each PIC IRQ; with the APIC the IRQ is moved to the
+ * vector block of its priority
+ *
+ * @param irq - IRQ number
+ * @param priority - IRQ_PRIORITY_NONE or a higher priority level
+ */
+void interrupts_irq_priority_set(int irq, int priority) {
+    if (irq < 0 || irq >= IRQ_MAX) {
+        kernel_panic("interrupts: Invalid IRQ %d (0x%02x)", irq, irq);
+        return;
+    }
+
+    irq_priority[irq] = priority;
+
+    for (int line = 0; line < 16; line++) {
+        irq_priority_mask[line] = 0;
+
+        for (int other = 0; other < 16; other++) {
+            if (irq_priority[0x20 + other] <= irq_priority[0x20 + line]) {
+                irq_priority_mask[line] |= (1 << other);
+            }
+        }
+    }
+
+    if (irq >= 0x20 && irq <= 0x2F && apic_enabled()) {
+        apic_irq_priority_set(irq - 0x20, priority);
+        irq_vector_sync(irq);
+    }
+
+    kernel_log_debug("interrupts: IRQ %d (0x%02x) priority set to %d", irq, irq, priority);
+}
+
+/**
+ * Calls every handler registered for the specified interrupt
+ * @param irq - interrupt number
+ */
+static void irq_handlers_run(int irq) {
+    for (int i = 0; i < IRQ_HANDLERS_MAX && irq_handlers[irq][i] != NULL; i++) {
+        irq_handlers[irq][i]();
+    }
+}
+
+/**
+ * Records the time spent handling the specified interrupt
+ * Must be called with interrupts disabled
+ *
+ * @param irq - interrupt number
+ * @param start - time-stamp counter value when handling started
+ */
+static void irq_stats_update(int irq, unsigned long long start) {
+    unsigned long long cycles = kernel_rdtsc() - start;
+
+    irq_stats[irq].count++;
+    irq_stats[irq].cycles += cycles;
+
+    if (cycles > irq_stats[irq].max_cycles) {
+        irq_stats[irq].max_cycles = cycles > 0xffffffffULL ? 0xffffffff : (unsigned int)cycles;
+    }
+}
+
+/**
+ * Handles the specified interrupt by dispatching to the registered functions
+ *
+ * PIC/IOAPIC IRQs with a priority above IRQ_PRIORITY_NONE are dismissed first and
+ * handled with interrupts enabled while every IRQ of equal or lower priority
+ * is held back (by the local APIC task priority or the PIC mask), so only
+ * more important IRQs can preempt the handler.
+ * The time spent in preemptible handlers includes any IRQs that preempted them.
+ *
  * @param interrupt - interrupt number
  */
 void interrupts_irq_handler(int irq) {
+    unsigned long long start;
+    unsigned int state;
+
     if (irq < 0 || irq >= IRQ_MAX) {
         kernel_panic("interrupts: Invalid IRQ %d (0x%02x)", irq, irq);
         return;
     }
 
-    if (irq_handlers[irq] == NULL) {
+    if (irq_handlers[irq][0] == NULL) {
         kernel_panic("interrupts: No handler registered for IRQ %d (0x%02x)", irq, irq);
         return;
     }
 
-    irq_handlers[irq]();
+    start = kernel_rdtsc();
 
-    /* If the IRQ originates from the PIC, dismiss the IRQ */
-    if (irq >= 0x20 && irq <= 0x2F) {
-        pic_irq_dismiss(irq - 0x20);
+    /* Non-PIC and non-preemptible IRQs run with interrupts disabled */
+    if (irq < 0x20 || irq > 0x2F || irq_priority[irq] == IRQ_PRIORITY_NONE) {
+        irq_handlers_run(irq);
+
+        /* If the IRQ originates from the PIC/IOAPIC, dismiss the IRQ */
+        if (irq >= 0x20 && irq <= 0x2F) {
+            irq_dismiss(irq - 0x20);
+        }
+
+        irq_stats_update(irq, start);
+        return;
+    }
+
+    /* Hold back equal and lower priorities, then let the controller deliver the rest */
+    state = irq_priority_raise(irq);
+    irq_dismiss(irq - 0x20);
+
+    asm volatile("sti" : : : "memory");
+    irq_handlers_run(irq);
+    asm volatile("cli" : : : "memory");
+
+    irq_priority_restore(state);
+    irq_stats_update(irq, start);
+}
+
+/**
+ * Gets the statistics for the specified IRQ
+ *
+ * @param irq - IRQ number
+ * @param stats - pointer to the structure to copy the statistics to
+ * @return 0 on success, -1 on error
+ */
+int interrupts_irq_stats_get(int irq, irq_stats_t *stats) {
+    unsigned int flags;
+
+    // The arguments come straight from user processes (SYSCALL_SYS_IRQ_STATS),
+    // so bad ones are refused without filling the kernel log
+    if (irq < 0 || irq >= IRQ_MAX || !stats) {
+        return -1;
+    }
+
+    flags = interrupts_save_disable();
+    *stats = irq_stats[irq];
+    interrupts_restore(flags);
+
+    stats->handlers = 0;
+    while (stats->handlers < IRQ_HANDLERS_MAX && irq_handlers[irq][stats->handlers] != NULL) {
+        stats->handlers++;
+    }
+
+    return 0;
+}
+
+/**
+ * Computes the average cycles per occurrence without 64-bit division
+ * @param stats - pointer to the IRQ statistics
+ * @return average number of cycles
+ */
+static unsigned int irq_stats_avg(irq_stats_t *stats) {
+    if (stats->cycles <= 0xffffffffULL) {
+        return (unsigned int)stats->cycles / stats->count;
+    }
+
+    return ((unsigned int)(stats->cycles >> 10) / stats->count) << 10;
+}
+
+/**
+ * Prints the statistics of every IRQ that has occurred to the host console
+ */
+void interrupts_stats_dump(void) {
+    irq_stats_t stats;
+
+    kernel_log_info("interrupts: irq   handlers       count     kcycles  avg cycles  max cycles");
+
+    for (int irq = 0; irq < IRQ_MAX; irq++) {
+        if (interrupts_irq_stats_get(irq, &stats) != 0 || stats.count == 0) {
+            continue;
+        }
+
+        kernel_log_info("interrupts: 0x%02x  %8d  %10u  %10u  %10u  %10u", irq, stats.handlers,
+                        stats.count, (unsigned int)(stats.cycles >> 10),
+                        irq_stats_avg(&stats),
+                        stats.max_cycles);
     }
 }
 
@@ -81,6 +331,8 @@ void interrupts_irq_handler(int irq) {
  * @param handler - the function to be called to process the the interrupt
  */
 void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
+    int slot;
+
     if (irq < 0 || irq >= IRQ_MAX) {
         kernel_panic("interrupts: Invalid IRQ %d (0x%02x)", irq, irq);
         return;
@@ -96,17 +348,37 @@ void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
         return;
     }
 
+    // The IDT isn't known (and the handler table would be cleared) until
+    // interrupts_init has run
+    if (!idt) {
+        kernel_panic("interrupts: IRQ %d (0x%02x) registered before interrupts_init", irq, irq);
+        return;
+    }
+
     // Add the entry to the IDT
     fill_gate(&idt[irq], (int)entry, get_cs(), ACC_INTR_GATE, 0);
     kernel_log_debug("interrupts: IRQ %d (0x%02x) IDT entry added", irq, irq);
 
-    /* Add the ISR handler to the table */
-    irq_handlers[irq]=handler;
-    kernel_log_debug("interrupts: IRQ %d (0x%02x) handler added", irq, irq);
+    /* Append the ISR handler to the IRQ's handler chain */
+    for (slot = 0; slot < IRQ_HANDLERS_MAX && irq_handlers[irq][slot] != NULL; slot++) {
+        if (irq_handlers[irq][slot] == handler) {
+            kernel_log_warn("interrupts: IRQ %d (0x%02x) handler already registered", irq, irq);
+            return;
+        }
+    }
 
-    /* If the interrupt originates from the PIC, enable IRQs */
+    if (slot == IRQ_HANDLERS_MAX) {
+        kernel_panic("interrupts: Too many handlers for IRQ %d (0x%02x)", irq, irq);
+        return;
+    }
+
+    irq_handlers[irq][slot] = handler;
+    kernel_log_debug("interrupts: IRQ %d (0x%02x) handler %d added", irq, irq, slot);
+
+    /* If the interrupt originates from the PIC/IOAPIC, enable IRQs */
     if (irq >= 0x20 && irq <= 0x2F) {
-        pic_irq_enable(irq);
+        irq_vector_sync(irq);
+        irq_enable(irq);
     }
 
     kernel_log_info("interrupts: IRQ %d (0x%02x) registered)", irq, irq);
@@ -202,6 +474,25 @@ int pic_irq_enabled(int irq) {
     return (mask & (1 << irq)) ? 0 : 1;
 }
 
+/**
+ * Reads the combined mask of both PICs
+ *
+ * @return - IRQ mask (bit n set if IRQ n is disabled)
+ */
+unsigned int pic_mask_get(void) {
+    return inportb(PIC1_DATA) | (inportb(PIC2_DATA) << 8);
+}
+
+/**
+ * Writes the combined mask of both PICs
+ *
+ * @param mask - IRQ mask (bit n set if IRQ n is disabled)
+ */
+void pic_mask_set(unsigned int mask) {
+    outportb(PIC1_DATA, mask & 0xff);
+    outportb(PIC2_DATA, (mask >> 8) & 0xff);
+}
+
 /**
  * Dismisses an interrupt by sending the EOI command to the appropriate
  * PIC device(s). If the IRQ is assosciated with the secondary PIC, the
@@ -233,5 +524,11 @@ void interrupts_init() {
     idt = get_idt_base();
 
     memset(irq_handlers, 0, sizeof(irq_handlers));
+    memset(irq_stats, 0, sizeof(irq_stats));
+    memset(irq_priority, 0, sizeof(irq_priority));
+    memset(irq_priority_mask, 0xff, sizeof(irq_priority_mask));
+
+    // Prefer the local APIC/IOAPIC; the PIC stays in use if not found
+    apic_init();
 }
 
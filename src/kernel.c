@@ -16,7 +16,11 @@
 #include "keyboard.h"
 #include "trapframe.h"
 #include "interrupts.h"
+#include "paging.h"
 #include "scheduler.h"
+#include "smp.h"
+#include "softirq.h"
+#include "trace.h"
 //d
 //f set detault log level
 // this feels like it should be in the header but ok
@@ -35,6 +39,8 @@ void kernel_init(void) { //f
     // Display a welcome message on the host
     kernel_log_info("Welcome to %s!", OS_NAME);
     kernel_log_info("Initializing kernel...");
+    // Per-CPU data is needed before anything touches active_proc
+    smp_init_boot();
 }
 //d
 //f log_level_function_body macro 
@@ -148,6 +154,15 @@ void kernel_panic(char *msg, ...) { //f
 //d
 void kernel_context_enter(trapframe_t *trapframe){ //f
     //called to deal with every possible interrupt
+    //f only one CPU runs kernel code at a time
+    spin_lock(&kernel_lock);
+    //d
+    //f record the entry for offline replay
+    trace_irq(trapframe, 0);
+    //d
+    //f mark the kernel as running so nested IRQs stay on the kernel stack
+    kernel_irq_depth = 1;
+    //d
     //f save the previous process
     if(active_proc){
         active_proc->trapframe = trapframe;
@@ -156,6 +171,9 @@ void kernel_context_enter(trapframe_t *trapframe){ //f
     //f handle the interrupt
     interrupts_irq_handler(trapframe->interrupt);
     //d
+    //f run deferred work now that the IRQ has been dismissed
+    softirq_run();
+    //d
     //f decide what to run next
     scheduler_run();
     //d
@@ -165,10 +183,23 @@ void kernel_context_enter(trapframe_t *trapframe){ //f
     }
     //d
     //f run the process that was selected
-    kernel_context_exit(active_proc->trapframe);
+    trapframe = active_proc->trapframe;
+    paging_switch(active_proc->page_dir);
+    kernel_irq_depth = 0;
+    spin_unlock(&kernel_lock);
+    kernel_context_exit(trapframe);
     //d
 }
 //d
+void kernel_context_enter_nested(trapframe_t *trapframe){ //f
+    // the trapframe belongs to the interrupted kernel code, not to
+    // active_proc, so it is not saved and nothing is rescheduled here
+    kernel_irq_depth++;
+    trace_irq(trapframe, 1);
+    interrupts_irq_handler(trapframe->interrupt);
+    kernel_irq_depth--;
+}
+//d
 int kernel_get_log_level(void) { //f
     /**
      * Returns the current log level
@@ -2,10 +2,18 @@
 #include <spede/stdio.h>
 #include <spede/machine/io.h>
 
+#include "bench.h"
 #include "interrupts.h"
 #include "kernel.h"
 #include "keyboard.h"
+#include "kmem.h"
 #include "kproc.h"
+#include "page.h"
+#include "paging.h"
+#include "smp.h"
+#include "softirq.h"
+#include "timer.h"
+#include "trace.h"
 #include "tty.h"
 
 // Keyboard data port
@@ -58,6 +66,12 @@
 static unsigned int kbd_status = 0x0;
 static unsigned int esc_status = 0;
 
+// Keys that run a command when pressed with CTRL
+static const char keyboard_command_keys[] = "deikmnpqrstvw";
+
+// CTRL key commands waiting for the keyboard softirq, one bit per letter
+volatile unsigned int keyboard_commands;
+
 // Primary keymap
 static const char keyboard_map_primary[] = {
     KEY_NULL,           /* 0x00 - Null */
@@ -237,6 +251,105 @@ static const char keyboard_map_secondary[] = {
 };
 
 
+/**
+ * Runs a CTRL key command
+ * @param c - command key (lower case)
+ */
+static void keyboard_command_run(char c) {
+    switch (c) {
+    case 'n':
+        kproc_create(kproc_test, "test", PROC_TYPE_USER);
+        break;
+    case 'q':
+        kproc_destroy(active_proc);
+        break;
+    case 't':
+        timer_stats_dump();
+        break;
+    case 'p':
+        page_stats_dump();
+        break;
+    case 'k':
+        kmem_stats_dump();
+        break;
+    case 'v':
+        paging_stats_dump();
+        break;
+    case 'e':
+        trace_start();
+        break;
+    case 'd':
+        kproc_create(trace_dump_proc, "trace dump", PROC_TYPE_KERNEL);
+        break;
+    case 'r':
+        kproc_create(bench_ringbuf, "bench ringbuf", PROC_TYPE_KERNEL);
+        break;
+    case 'm':
+        kproc_create(bench_bit, "bench bit", PROC_TYPE_KERNEL);
+        break;
+    case 'i':
+        interrupts_stats_dump();
+        break;
+    case 'w':
+        kproc_create(smp_bench_proc, "smp bench", PROC_TYPE_KERNEL);
+        break;
+    case 's':
+        smp_stats_dump();
+        break;
+    }
+}
+
+/**
+ * Queues a CTRL key command for the keyboard softirq
+ * @param c - key pressed with CTRL
+ * @return 0 if the key is a command, -1 otherwise
+ */
+static int keyboard_command_post(char c) {
+    unsigned int bit;
+
+    if (c >= 'A' && c <= 'Z') {
+        c += 'a' - 'A';
+    }
+
+    for (int i = 0; keyboard_command_keys[i]; i++) {
+        if (keyboard_command_keys[i] == c) {
+            bit = 1U << (c - 'a');
+            asm volatile("lock orl %1, %0" : "+m"(keyboard_commands) : "r"(bit) : "memory");
+            softirq_raise(SOFTIRQ_KEYBOARD);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Keyboard softirq handler; runs the queued CTRL key commands
+ *
+ * Commands create and destroy processes, which changes the process table,
+ * the allocators and the run queues. None of those can be changed from the
+ * keyboard IRQ, which may interrupt softirqs halfway through changing them,
+ * and the timer IRQ may change the run queues, so the commands run here
+ * with interrupts disabled.
+ */
+static void keyboard_softirq(void) {
+    unsigned int pending = 0;
+    unsigned int flags;
+
+    // Atomically take every command queued so far
+    asm volatile("xchgl %0, %1" : "+r"(pending), "+m"(keyboard_commands) : : "memory");
+
+    flags = interrupts_save_disable();
+
+    for (int i = 0; i < 26; i++) {
+        if (pending & (1U << i)) {
+            keyboard_command_run('a' + i);
+        }
+    }
+
+    interrupts_restore(flags);
+}
+
 /*
  *
  */
@@ -258,6 +371,15 @@ void keyboard_init() {
     // No status keys pressed by default
     kbd_status = 0x0;
 
+    // Keystrokes may preempt deferred work (softirqs), so the keyboard IRQ
+    // may only touch state that is safe to change halfway through someone
+    // else's update: the TTY ring buffers (one producer against the
+    // consumer), the active TTY and the status bits here. Anything else is
+    // queued for the keyboard softirq.
+    interrupts_irq_priority_set(IRQ_KEYBOARD, IRQ_PRIORITY_HIGH);
+    softirq_register(SOFTIRQ_KEYBOARD, keyboard_softirq);
+    keyboard_commands = 0;
+
     // Register the keyboard ISR
     interrupts_irq_register(IRQ_KEYBOARD, isr_entry_keyboard, keyboard_irq_handler);
 }
@@ -440,13 +562,8 @@ unsigned int keyboard_decode(unsigned int c) {
                     return KEY_NULL;
                 }
 
-                if (c == 'n' || c == 'N') {
-                    kproc_create(kproc_test, "test", PROC_TYPE_USER);
-                    return KEY_NULL;
-                }
-
-                if (c == 'q' || c == 'Q') {
-                    kproc_destroy(active_proc);
+                // Commands are run from the keyboard softirq (see keyboard_softirq)
+                if (keyboard_command_post(c) == 0) {
                     return KEY_NULL;
                 }
 
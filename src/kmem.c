@@ -0,0 +1,317 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel object caches (slab allocator) and kmalloc
+ *
+ * Each cache hands out objects of one size from slabs: blocks of pages
+ * from the page allocator with a small header followed by the objects.
+ * Free objects of a cache are kept on a single list, so allocation and
+ * free are O(1); a new slab is only needed when the list is empty.
+ *
+ * The free list link is kept in a word after each object rather than in
+ * the object itself. Objects keep their constructed state while free, so
+ * the constructor runs once per object when its slab is created and
+ * allocation doesn't have to clear or rebuild the object. While an object
+ * is allocated the link word holds KMEM_MAGIC_USED, which catches double
+ * frees.
+ *
+ * Every page of a slab is tagged with the slab header (page_set_owner), so
+ * kfree finds the cache of any kmalloc pointer without a size header.
+ */
+#include <spede/stdio.h>
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "kmem.h"
+#include "page.h"
+
+// Link word of an allocated object
+#define KMEM_MAGIC_USED 0xa110c8ed
+
+// Number of kmalloc size classes (KMEM_KMALLOC_MIN to KMEM_KMALLOC_MAX)
+#define KMEM_KMALLOC_CLASSES 8
+
+// Slab header, at the start of each slab
+typedef struct kmem_slab_t {
+    struct kmem_slab_t *next;       // Next slab of the cache
+    kmem_cache_t *cache;            // Cache the slab belongs to
+} kmem_slab_t;
+
+// Slab header size, keeping the objects 8 byte aligned
+#define KMEM_SLAB_HEADER ((sizeof(kmem_slab_t) + 7) & ~7U)
+
+// Table of all caches
+kmem_cache_t kmem_caches[KMEM_CACHES_MAX];
+
+// kmalloc size class caches
+kmem_cache_t *kmem_kmalloc[KMEM_KMALLOC_CLASSES];
+
+/**
+ * Returns the free list link word of an object
+ */
+static inline void **kmem_link(kmem_cache_t *cache, void *obj) {
+    return (void **)((char *)obj + cache->stride - sizeof(void *));
+}
+
+/**
+ * Allocates a slab for a cache, constructs its objects and puts them on
+ * the cache's free list
+ * @return 0 on success, -1 if no memory is available
+ */
+static int kmem_cache_grow(kmem_cache_t *cache) {
+    kmem_slab_t *slab = page_alloc(cache->order);
+    char *obj;
+
+    if (!slab) {
+        return -1;
+    }
+
+    page_set_owner(slab, slab);
+    slab->cache = cache;
+    slab->next = cache->slabs;
+    cache->slabs = slab;
+    cache->slab_count++;
+
+    // Push the objects in reverse so they are handed out in address order
+    obj = (char *)slab + KMEM_SLAB_HEADER + (cache->per_slab - 1) * cache->stride;
+    for (unsigned int i = 0; i < cache->per_slab; i++, obj -= cache->stride) {
+        if (cache->ctor) {
+            cache->ctor(obj);
+        }
+
+        *kmem_link(cache, obj) = cache->free;
+        cache->free = obj;
+    }
+
+    return 0;
+}
+
+/**
+ * Initializes the cache table and creates the kmalloc caches
+ * Must be called after the page allocator has been initialized
+ * @return 0 on success, -1 on error
+ */
+int kmem_init(void) {
+    char name[KMEM_NAME_LEN];
+    unsigned int size = KMEM_KMALLOC_MIN;
+
+    kernel_log_info("Initializing kernel object caches");
+
+    memset(kmem_caches, 0, sizeof(kmem_caches));
+
+    for (int i = 0; i < KMEM_KMALLOC_CLASSES; i++, size <<= 1) {
+        snprintf(name, sizeof(name), "kmalloc-%u", size);
+
+        if (!(kmem_kmalloc[i] = kmem_cache_create(name, size, NULL))) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Creates a cache of fixed-size objects
+ * @param name - cache name (for statistics)
+ * @param size - object size in bytes
+ * @param ctor - object constructor (NULL for none)
+ * @return pointer to the cache, NULL on error
+ */
+kmem_cache_t *kmem_cache_create(char *name, unsigned int size, void (*ctor)(void *)) {
+    kmem_cache_t *cache = NULL;
+    unsigned int stride;
+    int order = 0;
+
+    if (size == 0 || size > PAGE_BLOCK_MAX / 2) {
+        kernel_log_error("kmem: invalid object size %u for cache %s", size, name);
+        return NULL;
+    }
+
+    for (int i = 0; i < KMEM_CACHES_MAX; i++) {
+        if (!kmem_caches[i].active) {
+            cache = &kmem_caches[i];
+            break;
+        }
+    }
+
+    if (!cache) {
+        kernel_log_error("kmem: unable to create cache %s, all %d caches in use", name, KMEM_CACHES_MAX);
+        return NULL;
+    }
+
+    // Room for the object and its free list link, 8 byte aligned
+    stride = (size + sizeof(void *) + 7) & ~7U;
+
+    // The smallest slab that holds enough objects to amortize the header
+    while (order < PAGE_ORDER_MAX &&
+           ((PAGE_SIZE << order) - KMEM_SLAB_HEADER) / stride < KMEM_SLAB_OBJECTS_MIN) {
+        order++;
+    }
+
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, KMEM_NAME_LEN - 1);
+    cache->size = size;
+    cache->stride = stride;
+    cache->order = order;
+    cache->per_slab = ((PAGE_SIZE << order) - KMEM_SLAB_HEADER) / stride;
+    cache->ctor = ctor;
+    cache->active = 1;
+
+    return cache;
+}
+
+/**
+ * Destroys a cache and gives its slabs back to the page allocator
+ * @param cache - the cache
+ * @return 0 on success, -1 on error (or if objects are still allocated)
+ */
+int kmem_cache_destroy(kmem_cache_t *cache) {
+    if (!cache || !cache->active) {
+        kernel_log_error("kmem: destroy of a cache that doesn't exist");
+        return -1;
+    }
+
+    if (cache->in_use) {
+        kernel_log_error("kmem: cache %s still has %u objects allocated", cache->name, cache->in_use);
+        return -1;
+    }
+
+    while (cache->slabs) {
+        kmem_slab_t *slab = cache->slabs;
+
+        cache->slabs = slab->next;
+        page_free(slab);
+    }
+
+    cache->active = 0;
+    return 0;
+}
+
+/**
+ * Allocates an object from a cache
+ * @param cache - the cache
+ * @return pointer to the constructed object, NULL if no memory is available
+ */
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    void *obj;
+
+    if (!cache || !cache->active) {
+        kernel_log_error("kmem: allocation from a cache that doesn't exist");
+        return NULL;
+    }
+
+    if (!cache->free && kmem_cache_grow(cache) != 0) {
+        cache->failures++;
+        return NULL;
+    }
+
+    obj = cache->free;
+    cache->free = *kmem_link(cache, obj);
+    *kmem_link(cache, obj) = (void *)KMEM_MAGIC_USED;
+
+    cache->in_use++;
+    cache->allocs++;
+
+    return obj;
+}
+
+/**
+ * Returns an object to its cache
+ * @param cache - the cache the object was allocated from
+ * @param obj - the object
+ * @return 0 on success, -1 on error
+ */
+int kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    kmem_slab_t *slab = page_owner(obj);
+    unsigned long offset = (unsigned long)obj - (unsigned long)slab - KMEM_SLAB_HEADER;
+
+    if (!cache || !slab || slab->cache != cache || (unsigned long)obj < (unsigned long)slab + KMEM_SLAB_HEADER ||
+        offset % cache->stride || offset / cache->stride >= cache->per_slab) {
+        kernel_log_error("kmem: free of 0x%08x which is not an object of cache %s",
+                         (unsigned int)(unsigned long)obj, cache ? cache->name : "(null)");
+        return -1;
+    }
+
+    if (*kmem_link(cache, obj) != (void *)KMEM_MAGIC_USED) {
+        kernel_log_error("kmem: double free of 0x%08x in cache %s",
+                         (unsigned int)(unsigned long)obj, cache->name);
+        return -1;
+    }
+
+    *kmem_link(cache, obj) = cache->free;
+    cache->free = obj;
+
+    cache->in_use--;
+    cache->frees++;
+
+    return 0;
+}
+
+/**
+ * Allocates memory from the smallest kmalloc size class that fits
+ * The memory is not cleared
+ * @param size - number of bytes
+ * @return pointer to the memory, NULL if no memory is available
+ */
+void *kmalloc(unsigned int size) {
+    unsigned int class_size = KMEM_KMALLOC_MIN;
+    int order;
+
+    if (size > KMEM_KMALLOC_MAX) {
+        if ((order = page_order(size)) < 0) {
+            kernel_log_error("kmem: kmalloc of %u bytes is too large", size);
+            return NULL;
+        }
+
+        // Whole blocks have no owner, which is how kfree tells them apart
+        return page_alloc(order);
+    }
+
+    for (int i = 0; i < KMEM_KMALLOC_CLASSES; i++, class_size <<= 1) {
+        if (size <= class_size) {
+            return kmem_cache_alloc(kmem_kmalloc[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Frees memory returned by kmalloc
+ * @param ptr - pointer to the memory (NULL is ignored)
+ * @return 0 on success, -1 on error
+ */
+int kfree(void *ptr) {
+    kmem_slab_t *slab;
+
+    if (!ptr) {
+        return 0;
+    }
+
+    if (!(slab = page_owner(ptr))) {
+        return page_free(ptr);
+    }
+
+    return kmem_cache_free(slab->cache, ptr);
+}
+
+/**
+ * Prints the occupancy of every cache to the host console
+ */
+void kmem_stats_dump(void) {
+    kernel_log_info("kmem: cache             size  order  slabs   in use    total     allocs      frees  failures");
+
+    for (int i = 0; i < KMEM_CACHES_MAX; i++) {
+        kmem_cache_t *cache = &kmem_caches[i];
+
+        if (!cache->active) {
+            continue;
+        }
+
+        kernel_log_info("kmem: %-16s %5u  %5d  %5u  %7u  %7u  %9u  %9u  %8u",
+                        cache->name, cache->size, cache->order, cache->slab_count, cache->in_use,
+                        cache->slab_count * cache->per_slab, cache->allocs, cache->frees,
+                        cache->failures);
+    }
+}
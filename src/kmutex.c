@@ -7,16 +7,33 @@
 
 #include <spede/string.h>
 
+#include "idmap.h"
 #include "kernel.h"
+#include "kmem.h"
 #include "kmutex.h"
 #include "queue.h"
 #include "scheduler.h"
 
-// Table of all mutexes
-mutex_t mutexes[MUTEX_MAX];
+// Table of all mutexes (NULL for ids that aren't allocated)
+mutex_t *mutexes[MUTEX_MAX];
+
+// Cache the mutexes are allocated from
+kmem_cache_t *mutex_cache;
 
 // Mutex ids to be allocated
-queue_t mutex_queue;
+idmap_t mutex_allocator;
+
+/**
+ * Mutex constructor; mutexes are freed unlocked with an empty wait queue
+ * @param obj - the mutex
+ */
+static void kmutex_ctor(void *obj) {
+    mutex_t *mutex = obj;
+
+    mutex->locks = 0;       // No locks held
+    mutex->owner = NULL;    // No owner
+    pid_queue_init(&mutex->wait_queue); // Initialize wait queue
+}
 
 /**
  * Initializes kernel mutex data structures
@@ -26,21 +43,15 @@ int kmutexes_init() {
     kernel_log_info("Initializing kernel mutexes");
 
     // Initialize the mutex table
-    for (int i = 0; i < MUTEX_MAX; ++i) {
-        mutexes[i].allocated = 0;  // Not allocated
-        mutexes[i].locks = 0;      // No locks held
-        mutexes[i].owner = NULL;   // No owner
-        queue_init(&mutexes[i].wait_queue); // Initialize wait queue
-    }
-
-    // Initialize the mutexkmutex_init queue
-    queue_init(&mutex_queue);
+    memset(mutexes, 0, sizeof(mutexes));
 
-    // Fill the mutex queue with available mutex IDs
-    for (int i = 0; i < MUTEX_MAX; ++i) {
-        queue_in(&mutex_queue, i);
+    if (!(mutex_cache = kmem_cache_create("mutex_t", sizeof(mutex_t), kmutex_ctor))) {
+        return -1;
     }
 
+    // Initialize the mutex allocator with every mutex id available
+    idmap_init(&mutex_allocator, MUTEX_MAX);
+
     return 0;
 }
 
@@ -51,8 +62,8 @@ int kmutexes_init() {
 int kmutex_init(void) {
     int id;
 
-    // Obtain a mutex id from the mutex queue
-    if (queue_out(&mutex_queue, &id) == -1){
+    // Obtain a mutex id from the mutex allocator
+    if ((id = idmap_alloc(&mutex_allocator)) == -1){
         kernel_log_error("Unable to allocate mutex kmutex_init");
         return -1;
     }
@@ -63,14 +74,12 @@ int kmutex_init(void) {
         return -1;
     }
 
-    // Pointer to the mutex table entry
-    mutex_t *mutex = &mutexes[id];
-
-    // Initialize the mutex data structure
-    mutex->allocated = 1;   // Allocated
-    mutex->locks = 0;       // No locks held
-    mutex->owner = NULL;    // No owner
-    queue_init(&mutex->wait_queue); // Initialize wait queue
+    // Take a constructed mutex (unlocked, empty wait queue) from the cache
+    if (!(mutexes[id] = kmem_cache_alloc(mutex_cache))) {
+        idmap_free(&mutex_allocator, id);
+        kernel_log_error("Out of memory for mutex kmutex_init");
+        return -1;
+    }
 
     kernel_log_trace("Mutex allocated %d kmutex_init", id);
 
@@ -90,23 +99,27 @@ int kmutex_destroy(int id) {
         kernel_log_error("Attempted to destroy out of range mutex %d kmutex_destroy", id);
         return -1;
     }
-    if (!mutexes[id].allocated){
+    if (mutexes[id] == NULL){
         kernel_log_error("Attempted to destroy unallocated mutex %d kmutex_destroy", id);
         return -1;
     }
 
     // If the mutex is locked, prevent it from being destroyed (return error)
-    if (mutexes[id].locks > 0){
+    if (mutexes[id]->locks > 0){
         kernel_log_error("Attempted to destroy locked mutex mutex id: %d kmutex_destroy", id);
-        kernel_log_error("Attempted to destroy locked mutex owner pid: %d kmutex_destroy", mutexes[id].owner->pid);
+        kernel_log_error("Attempted to destroy locked mutex owner pid: %d kmutex_destroy", mutexes[id]->owner->pid);
         return -1;
     }
 
-    // Add the id back into the mutex queue to be re-used later
-    queue_in(&mutex_queue, id);
+    // The mutex is unlocked, so it goes back to the cache as constructed
+    kmem_cache_free(mutex_cache, mutexes[id]);
+    mutexes[id] = NULL;
 
-    // Clear the memory for the data structure
-    mutexes[id].allocated = 0;
+    // Give the id back to the allocator to be re-used later
+    if (idmap_free(&mutex_allocator, id) != 0) {
+        kernel_log_error("Mutex %d was not allocated kmutex_destroy", id);
+        return -1;
+    }
 
     return 0;
 }
@@ -123,7 +136,7 @@ int kmutex_lock(int id) {
         kernel_log_error("Attempted to lock out of range mutex %d kmutex_lock", id);
         return -1;
     }
-    if (!mutexes[id].allocated){
+    if (mutexes[id] == NULL){
         kernel_log_error("Attempted to lock unallocated mutex %d kmutex_lock", id);
         return -1;
     }
@@ -133,22 +146,22 @@ int kmutex_lock(int id) {
     //      the mutex when it is unlocked)
     //   3. Remove the process from the scheduler, allow another
     //      process to be scheduled
-    if(mutexes[id].locks > 0){
-        queue_in(&(mutexes[id].wait_queue), active_proc->pid);
+    if(mutexes[id]->locks > 0){
+        pid_queue_in(&(mutexes[id]->wait_queue), active_proc->pid);
         active_proc->state = WAITING;
         scheduler_remove(active_proc);
     }
     // If the mutex is not locked
     //   1. set the mutex owner to the active process
     else{
-        mutexes[id].owner = active_proc;
+        mutexes[id]->owner = active_proc;
     }
 
     // Increment the lock count
-    ++mutexes[id].locks;
+    ++mutexes[id]->locks;
 
     // Return the mutex lock count
-    return mutexes[id].locks;
+    return mutexes[id]->locks;
 }
 
 /**
@@ -162,29 +175,29 @@ int kmutex_unlock(int id) {
         kernel_log_error("Attempted to unlock out of range mutex %d kmutex_unlock", id);
         return -1;
     }
-    if (!mutexes[id].allocated){
+    if (mutexes[id] == NULL){
         kernel_log_error("Attempted to unlock unallocated mutex %d kmutex_unlock", id);
         return -1;
     }
     // If the mutex is not locked, there is nothing to do
     // making this just silently return a success feels OMINOUS but ok - Hannah
-    if(mutexes[id].locks == 0){
+    if(mutexes[id]->locks == 0){
         return 0;
     }
     // Decrement the lock count
-    --mutexes[id].locks;
+    --mutexes[id]->locks;
     // If there are no more locks held:
     //    1. clear the owner of the mutex
-    if(mutexes[id].locks == 0){
-        mutexes[id].owner = NULL;
+    if(mutexes[id]->locks == 0){
+        mutexes[id]->owner = NULL;
     }else{
         // if there are other locks retrieve the next process and have it take ownership
         int processID = -1;
         proc_t* process;
-        if(queue_out(&(mutexes[id].wait_queue), &processID) != -1){
+        if(pid_queue_out(&(mutexes[id]->wait_queue), &processID) != -1){
             process = pid_to_proc(processID);
             scheduler_add(process);
-            mutexes[id].owner = process;
+            mutexes[id]->owner = process;
         }
         else{
             kernel_log_error("Mutex queue read failure kmutex_unlock");
@@ -197,6 +210,6 @@ int kmutex_unlock(int id) {
 
     // return the mutex lock count
 
-    return mutexes[id].locks;
+    return mutexes[id]->locks;
 }
 
@@ -11,30 +11,38 @@
 #include <spede/machine/proc_reg.h>
 
 #include "prog_user.h"
+#include "idmap.h"
 #include "kernel.h"
+#include "kmem.h"
+#include "page.h"
+#include "paging.h"
 #include "trapframe.h"
 #include "kproc.h"
+#include "kshm.h"
 #include "scheduler.h"
+#include "smp.h"
+#include "syscall.h"
 #include "timer.h"
+#include "trace.h"
 #include "queue.h"
 #include "vga.h"
 //d
 //f declare static variables
 // Next available process id to be assigned
 int next_pid;
+// Process table (NULL for entries that aren't in use)
+proc_t *proc_table[PROC_MAX];
 // Process table allocator
-queue_t proc_allocator;
-// Process table
-proc_t proc_table[PROC_MAX];
-// Process stacks
-unsigned char proc_stack[PROC_MAX][PROC_STACK_SIZE];
+idmap_t proc_allocator;
+// Cache the process control blocks (and kernel process stacks) are allocated from
+kmem_cache_t *proc_cache;
 //d
 proc_t *pid_to_proc_no_validity_check(int pid) { //f
     proc_t * return_value = NULL;
     int i;
     for(i=0; i<PROC_MAX; i-=-1){
-        if(proc_table[i].pid == pid){
-            return_value = &(proc_table[i]);
+        if(proc_table[i] != NULL && proc_table[i]->pid == pid){
+            return_value = proc_table[i];
             break;
         }
     }
@@ -71,7 +79,7 @@ int proc_to_entry_no_validity_check(proc_t *proc) { //f
     //f find the corresponding index!
     int i;
     for(i=0; i<PROC_MAX; i-=-1){
-        if(&(proc_table[i]) == proc){
+        if(proc_table[i] == proc){
             index = i;
             break;
         }
@@ -114,11 +122,11 @@ proc_t * entry_to_proc_no_validity_check(int entry) { //f
     //d
     // For the given entry number, return a pointer to the process table entry
     // Ensure that the process control block actually refers to a valid process
-    if((entry<0)||(entry>PROC_MAX)){
+    if((entry<0)||(entry>=PROC_MAX)){
         kernel_log_trace("invalid entry number %d requested from entry_to_proc_no_validity_check", entry);
         return NULL;
     }
-    proc_t * return_value = proc_table + entry;
+    proc_t * return_value = proc_table[entry];
     //kernel_log_trace("proc: %x vs %x entry_to_proc_no_validity_check", return_value, proc_table);
     return return_value;
 }
@@ -126,7 +134,6 @@ proc_t * entry_to_proc_no_validity_check(int entry) { //f
 proc_t * entry_to_proc(int entry) { //f
     proc_t* proc = entry_to_proc_no_validity_check(entry);
     if(proc == NULL){
-        kernel_log_trace("invalid entry number %d requested from entry_to_proc", entry);
         return NULL;
     }
     if(proc->state == NONE){
@@ -135,6 +142,114 @@ proc_t * entry_to_proc(int entry) { //f
     return proc;
 }
 //d
+static void kproc_kernel_exit(void) { //f
+    /** //f
+     * Return address of a kernel process' function
+     * A kernel process that returns ends itself like a user process would
+     */
+    //d
+    proc_exit(0);
+}
+//d
+static int kproc_kernel_stack(proc_t *proc) { //f
+    /** //f
+     * Points a kernel process' trapframe at the bottom of its stack
+     * The stack is allocated the first time the control block is used for a
+     * kernel process; it stays with the block while it is in the cache
+     * @return 0 on success, -1 if no memory is available
+     */
+    //d
+    unsigned int *ret;
+    if(proc->stack == NULL && (proc->stack = page_alloc(page_order(PROC_STACK_SIZE))) == NULL){
+        return -1;
+    }
+    // Past the trapframe, where the stack pointer is once the trapframe has
+    // been popped, is what a call would have pushed: the return address
+    // (kproc_kernel_exit) and room for an argument
+    ret = (unsigned int *)&proc->stack[PROC_STACK_SIZE - 2 * sizeof(unsigned int)];
+    ret[0] = (unsigned int)kproc_kernel_exit;
+    ret[1] = 0;
+    proc->trapframe = (trapframe_t *)((char *)ret - sizeof(trapframe_t));
+    return 0;
+}
+//d
+static trapframe_t *kproc_user_stack(proc_t *proc) { //f
+    /** //f
+     * Maps a new stack at the top of a user process' address space
+     * The stack is at the same address in every address space, so a forked
+     * copy of the process finds its stack (and every pointer into it) where
+     * the parent had it
+     * @return the kernel's view of the trapframe, NULL if no memory is available
+     */
+    //d
+    trapframe_t *frame = NULL;
+    for(unsigned int addr = PROC_USER_STACK; addr < PAGING_USER_LIMIT; addr += PAGE_SIZE){
+        char *page = page_alloc(0);
+        if(page == NULL || paging_map(proc->page_dir, addr, page, PAGING_WRITE) != 0){
+            if(page != NULL){
+                page_free(page);
+            }
+            return NULL;
+        }
+        // The trapframe is at the bottom of the last page
+        frame = (trapframe_t *)(page + PAGE_SIZE - sizeof(trapframe_t));
+    }
+    // The process itself sees its trapframe through its address space
+    proc->trapframe = (trapframe_t *)(PAGING_USER_LIMIT - sizeof(trapframe_t));
+    return frame;
+}
+//d
+void kproc_ctor(void *obj) { //f
+    /** //f
+     * Process control block constructor
+     * Kernel process stacks are allocated on first use and stay with the
+     * block while it is in the cache (see kproc_kernel_stack)
+     */
+    //d
+    proc_t *proc = obj;
+    proc->state = NONE;
+    proc->stack = NULL;
+    proc->trapframe = NULL;
+    proc->page_dir = NULL;
+}
+//d
+static int kproc_slot_alloc(proc_t **proc_out, char *proc_name) { //f
+    /** //f
+     * Allocates a process table entry and a process control block for it
+     * @return the process table index, -1 on error
+     */
+    //d
+    int process_index = -1;
+    proc_t *proc = NULL;
+    if((process_index = idmap_alloc(&proc_allocator)) == -1){
+        kernel_log_error("kernel attempted to create process when no process blocks were avaliable");
+        return -1;
+    }
+    if((proc = kmem_cache_alloc(proc_cache)) == NULL){
+        idmap_free(&proc_allocator, process_index);
+        kernel_log_error("out of memory for process %s kproc_create", proc_name);
+        return -1;
+    }
+    proc_table[process_index] = proc;
+    *proc_out = proc;
+    return process_index;
+}
+//d
+static void kproc_slot_free(int process_index) { //f
+    /** //f
+     * Gives back a process table entry (and its control block and address
+     * space) for a process that could not be created
+     */
+    //d
+    proc_t *proc = proc_table[process_index];
+    // The kernel address space is never destroyed
+    paging_dir_destroy(proc->page_dir);
+    proc->page_dir = NULL;
+    proc_table[process_index] = NULL;
+    kmem_cache_free(proc_cache, proc);
+    idmap_free(&proc_allocator, process_index);
+}
+//d
 int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type) { //f
     /** //f
      * Creates a new process
@@ -147,23 +262,34 @@ int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type) { //f
     //f declare variables
     int process_index = -1;
     proc_t *proc = NULL;
+    trapframe_t *frame = NULL;
     //d
     //f Allocate an entry in the process table via the process allocator
-    if(queue_out(&proc_allocator, &process_index)){
-        kernel_log_error("kernel attempted to create process when no process blocks were avaliable");
+    if((process_index = kproc_slot_alloc(&proc, proc_name)) == -1){
         return -1;
     }
     //kernel_log_trace("process slot %d allocated kproc_create", process_index);
     //d
-    //f locate corresponding process
-    proc = entry_to_proc_no_validity_check(process_index);
-    //d
-    // Initialize the process control block
-    memset(proc,0,sizeof(proc_t));
-    // Initialize the process stack via proc_stack
-    proc->stack = (unsigned char*)proc_stack[process_index];
-    // Initialize the trapframe pointer at the bottom of the stack
-    proc->trapframe = (trapframe_t *)(&proc->stack[PROC_STACK_SIZE - sizeof(trapframe_t)]);
+    // User processes get an address space of their own with the stack mapped
+    // into it; kernel processes share the kernel's and use the block's stack
+    if(proc_type == PROC_TYPE_USER){
+        proc->page_dir = paging_dir_create();
+        if(proc->page_dir == NULL || (frame = kproc_user_stack(proc)) == NULL){
+            kproc_slot_free(process_index);
+            kernel_log_error("no address space for process %s kproc_create", proc_name);
+            return -1;
+        }
+    }else{
+        proc->page_dir = paging_kernel_dir();
+        if(kproc_kernel_stack(proc) != 0){
+            kproc_slot_free(process_index);
+            kernel_log_error("out of memory for process %s kproc_create", proc_name);
+            return -1;
+        }
+        frame = proc->trapframe;
+    }
+    // Only the trapframe needs clearing; every other member is set below
+    memset(frame,0,sizeof(trapframe_t));
 
     // Set each of the process control block structure members to the initial starting values
     // as each new process is created, increment next_pid
@@ -178,31 +304,157 @@ int kproc_create(void *proc_ptr, char *proc_name, proc_type_t proc_type) { //f
     proc->sleep_time = 0;
     proc->start_time = timer_get_ticks();
     proc->scheduler_queue = NULL;
-    //I forgot the star on the next line the first time through and caused a segfault. whoops! -Hannah
-    memset(proc->io,0,sizeof(ringbuf_t*)*PROC_IO_MAX);
+    proc->shm_attached = 0;
+    proc->heap_end = PROC_HEAP_BASE;
+    for(int i=0; i<PROC_IO_MAX; i++){
+        proc->io[i] = NULL;
+    }
     // Copy the passed-in name to the name buffer in the process control block
     strcpy(proc->name, proc_name);
 
     // Set the instruction pointer in the trapframe
-    proc->trapframe->eip = (unsigned int)proc_ptr;
+    frame->eip = (unsigned int)proc_ptr;
 
     // Set INTR flag
-    proc->trapframe->eflags = EF_DEFAULT_VALUE | EF_INTR;
+    frame->eflags = EF_DEFAULT_VALUE | EF_INTR;
 
     // Set each segment in the trapframe
-    proc->trapframe->cs = get_cs();
-    proc->trapframe->ds = get_ds();
-    proc->trapframe->es = get_es();
-    proc->trapframe->fs = get_fs();
-    proc->trapframe->gs = get_gs();
+    frame->cs = get_cs();
+    frame->ds = get_ds();
+    frame->es = get_es();
+    frame->fs = get_fs();
+    frame->gs = get_gs();
 
     // Add the process to the scheduler
     scheduler_add(proc);
+    trace_event(TRACE_PROC_CREATE, proc->pid, proc_type);
 
     kernel_log_info("Created process %s (%d) entry=%d", proc->name, proc->pid, process_index);
     return proc->pid;
 }
 //d
+int kproc_fork(proc_t *parent) { //f
+    /** //f
+     * Creates a copy of a user process that shares its pages copy on write
+     * The child resumes from the same trapframe as the parent, with 0 as the
+     * return value of the system call
+     * @param parent - process to copy (the active process)
+     * @return process id of the child, -1 on error
+     */
+    //d
+    int process_index = -1;
+    proc_t *child = NULL;
+    int *child_eax = NULL;
+    if(parent == NULL || parent->type != PROC_TYPE_USER){
+        kernel_log_error("only user processes can be forked kproc_fork");
+        return -1;
+    }
+    if((process_index = kproc_slot_alloc(&child, parent->name)) == -1){
+        return -1;
+    }
+    // The stacks are copied right away: interrupts are taken on the process
+    // stack (there is no ring change), so it must never be read-only.
+    // The child copies first so the parent keeps its pages.
+    child->page_dir = paging_dir_fork(parent->page_dir);
+    for(unsigned int addr = PROC_USER_STACK; child->page_dir != NULL && addr < PAGING_USER_LIMIT; addr += PAGE_SIZE){
+        if(paging_cow_break(child->page_dir, addr) != 0){
+            paging_dir_destroy(child->page_dir);
+            child->page_dir = NULL;
+        }
+    }
+    // Even if the copy failed, the parent's stack may have been write protected
+    for(unsigned int addr = PROC_USER_STACK; addr < PAGING_USER_LIMIT; addr += PAGE_SIZE){
+        paging_cow_break(parent->page_dir, addr);
+    }
+    if(child->page_dir == NULL){
+        kproc_slot_free(process_index);
+        kernel_log_error("no address space for a copy of process %d kproc_fork", parent->pid);
+        return -1;
+    }
+    // The trapframe is at the same address in the child's stack copy
+    child->trapframe = parent->trapframe;
+    child_eax = paging_lookup(child->page_dir, (unsigned int)&child->trapframe->eax);
+    *child_eax = 0;
+
+    child->pid = next_pid;
+    next_pid++;
+    child->state = IDLE;
+    child->type = parent->type;
+    child->run_time = 0;
+    child->cpu_time = 0;
+    child->sleep_time = 0;
+    child->start_time = timer_get_ticks();
+    child->scheduler_queue = NULL;
+    // The child shares the parent's TTY
+    for(int i=0; i<PROC_IO_MAX; i++){
+        child->io[i] = parent->io[i];
+    }
+    strcpy(child->name, parent->name);
+    // The heap pages were shared copy on write with the rest of the window
+    child->heap_end = parent->heap_end;
+    // Shared memory segments were mapped shared, so the child is attached too
+    kshm_fork(parent, child);
+
+    scheduler_add(child);
+    trace_event(TRACE_PROC_CREATE, child->pid, child->type);
+
+    kernel_log_info("Forked process %s (%d) from %d entry=%d", child->name, child->pid, parent->pid, process_index);
+    return child->pid;
+}
+//d
+int kproc_sbrk(proc_t *proc, int increment) { //f
+    /** //f
+     * Grows or shrinks the heap of a user process
+     * Pages are mapped (cleared) or unmapped as the break crosses page boundaries
+     * @param proc - the process
+     * @param increment - number of bytes to add to the heap (negative to shrink it)
+     * @return the previous break, -1 on error
+     */
+    //d
+    unsigned int old_end;
+    unsigned int new_end;
+    unsigned int start;
+    unsigned int addr;
+    if(proc == NULL || proc->type != PROC_TYPE_USER){
+        kernel_log_error("only user processes have a heap kproc_sbrk");
+        return -1;
+    }
+    old_end = proc->heap_end;
+    new_end = old_end + increment;
+    if((increment > 0 && (new_end < old_end || new_end > PROC_HEAP_LIMIT)) ||
+       (increment < 0 && (new_end > old_end || new_end < PROC_HEAP_BASE))){
+        kernel_log_error("heap of process %d can't move by %d bytes kproc_sbrk", proc->pid, increment);
+        return -1;
+    }
+    // Map the pages the heap grows into
+    start = (old_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    for(addr = start; addr < new_end; addr += PAGE_SIZE){
+        char *page = page_alloc(0);
+        if(page == NULL || paging_map(proc->page_dir, addr, page, PAGING_WRITE) != 0){
+            if(page != NULL){
+                page_free(page);
+            }
+            // Give back what was mapped so far
+            while(addr > start){
+                addr -= PAGE_SIZE;
+                page_put(paging_unmap(proc->page_dir, addr));
+            }
+            kernel_log_error("out of memory for the heap of process %d kproc_sbrk", proc->pid);
+            return -1;
+        }
+        memset(page, 0, PAGE_SIZE);
+    }
+    // Unmap the pages the heap no longer reaches
+    for(addr = (new_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1); addr < old_end; addr += PAGE_SIZE){
+        void *page = paging_unmap(proc->page_dir, addr);
+        if(page != NULL){
+            page_put(page);
+        }
+    }
+    proc->heap_end = new_end;
+    return old_end;
+}
+//d
 int kproc_destroy(proc_t *proc) { //f
     /** //f
      * Destroys a process
@@ -211,22 +463,45 @@ int kproc_destroy(proc_t *proc) { //f
      * @return 0 on success, -1 on error
      */
     //d
-    if(proc->pid==0){
+    if(proc->pid==0 || smp_is_idle_proc(proc)){
         kernel_log_trace("User attempted to shut down idle process. get noped :P");
         return -1;
     }
+    // A process that is current on another CPU is running there (or waiting
+    // for the kernel lock) on its own page directory; there is no IPI to make
+    // that CPU switch away, so its address space can't be freed from here
+    for(int i = 0; i < CPU_MAX; i++){
+        if(cpus[i].current == proc && &cpus[i] != smp_cpu()){
+            kernel_log_error("Process %d is running on CPU %d, not destroying it kproc_destroy", proc->pid, i);
+            return -1;
+        }
+    }
+    trace_event(TRACE_PROC_DESTROY, proc->pid, 0);
     // Remove the process from the scheduler
     scheduler_remove(proc);
+    // Cancel any timers the process left behind
+    timer_proc_release(proc->pid);
     //can if our proc is the active proc be sure to clear that out too!
     if(proc == active_proc){
         active_proc = NULL;
     }
-    // Clear/Reset all process data (process control block, stack, etc) related to the process
+    // Detach shared memory segments (freeing those nobody else has attached)
+    kshm_release(proc);
+    // Release the address space (switching away from it if it is loaded);
+    // a user process' stack and any pages it still shares go with it
+    paging_dir_destroy(proc->page_dir);
+    proc->page_dir = NULL;
+    // Mark the process gone; anything still holding the pointer sees NONE
     proc->state = NONE;
-    memset(proc,0,sizeof(proc_t)); // boop :)
-    // Add the process entry/index value back into the process allocator
-    // also deal with queue full error condition
-    int success = queue_in(&proc_allocator, proc_to_entry_no_validity_check(proc));
+    // Give the process entry back to the process allocator
+    // (fails if the entry was already free)
+    int entry = proc_to_entry_no_validity_check(proc);
+    int success = idmap_free(&proc_allocator, entry);
+    if(success == 0){
+        // The control block keeps a kernel stack in the cache for the next process
+        proc_table[entry] = NULL;
+        kmem_cache_free(proc_cache, proc);
+    }
     return success;
 }
 //d
@@ -235,10 +510,8 @@ void kproc_idle(void) { //f
      * Idle Process
      */
     //d
-    // fun fact this is actually never run at all. Like ever. watch:
-    proc_t * something = NULL;
-    something->state = IDLE;
-    // watch the program not segfault here because it literally never comes here. The kernel is never placed in this context because the kernel context of the starting kernel is the initial state of the machine. when the first interrupt is called the initial kernel state is stored in the trapframe, at which point the trapframe is the only place pointing to this kproc_idle function. so essentially the pointer of this function gets set up just to be overridden. The kernel will not exit into it without an interrupt and an interrupt will always overwrite where the pointer to this function is written in the trapframe. so this function will literally never be run. cool right?
+    // The bootstrap CPU's idle process is just the boot context from main(), but each
+    // application processor starts its idle process here, so this really does run.
     while (1) {
         // Ensure interrupts are enabled
         asm("sti");
@@ -271,21 +544,17 @@ void kproc_init(void) { //f
     //   - process allocator DONE
     //   - process stack DONE
     //f init the objects!
-    memset(proc_table,0,sizeof(proc_t)*PROC_MAX);
-    queue_init(&proc_allocator);
-    memset(proc_stack,0,sizeof(char)*PROC_MAX*PROC_STACK_SIZE);
-    //d
-    //f fill the queue with its avaliable entry slots!
-    int i;
-    for(i=0; i<PROC_MAX; i-=-1){
-        queue_in(&proc_allocator, i);
-    }
+    memset(proc_table,0,sizeof(proc_table));
+    proc_cache = kmem_cache_create("proc_t", sizeof(proc_t), kproc_ctor);
     //d
+    // every entry slot starts out avaliable!
+    idmap_init(&proc_allocator, PROC_MAX);
     // Create the idle process (kproc_idle) as a kernel process DONE
     // this makes no sense. kproc create relies on the scheduler which is not intialized until after kproc hannah moved this to the scheduler init because that at least makes some more sense
     // ok I think i figured it out. scheduler_init is supposed to be run before the kproc_init because it actually has no dependency on kproc weird right?
     //char * idle = "idle";
     kproc_create(kproc_idle, "idle", PROC_TYPE_KERNEL);
+    cpus[0].idle_proc = pid_to_proc(0);
     scheduler_run();
     int pid = kproc_create(prog_shell, "shell", PROC_TYPE_USER);
     kproc_attach_tty(pid, 1);
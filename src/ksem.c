@@ -7,16 +7,32 @@
 
 #include <spede/string.h>
 
+#include "idmap.h"
 #include "kernel.h"
+#include "kmem.h"
 #include "ksem.h"
 #include "queue.h"
 #include "scheduler.h"
 
-// Table of all semephores
-sem_t semaphores[SEM_MAX];
+// Table of all semephores (NULL for ids that aren't allocated)
+sem_t *semaphores[SEM_MAX];
+
+// Cache the semaphores are allocated from
+kmem_cache_t *sem_cache;
 
 // semaphore ids to be allocated
-queue_t sem_queue;
+idmap_t sem_allocator;
+
+/**
+ * Semaphore constructor; semaphores are freed with an empty wait queue
+ * @param obj - the semaphore
+ */
+static void ksem_ctor(void *obj) {
+    sem_t *semaphore = obj;
+
+    semaphore->count = 0;
+    pid_queue_init(&semaphore->wait_queue);
+}
 
 /**
  * Initializes kernel semaphore data structures
@@ -26,16 +42,15 @@ int ksemaphores_init() {
     kernel_log_info("Initializing kernel semaphores");
 
     // Initialize the semaphore table
-    memset(semaphores, 0, sizeof(sem_t)*SEM_MAX);
+    memset(semaphores, 0, sizeof(semaphores));
 
-    // Initialize the semaphore queue
-    queue_init(&sem_queue);
-
-    // Fill the semaphore queue
-    for(int i = 0; i<SEM_MAX; i-=-1){
-        queue_in(&sem_queue, i);
+    if (!(sem_cache = kmem_cache_create("sem_t", sizeof(sem_t), ksem_ctor))) {
+        return -1;
     }
 
+    // Initialize the semaphore allocator with every semaphore id available
+    idmap_init(&sem_allocator, SEM_MAX);
+
     return 0;
 }
 
@@ -45,10 +60,9 @@ int ksemaphores_init() {
  * @return -1 on error, otherwise the semaphore id that was allocated
  */
 int ksem_init(int value) {
-    // Obtain a semaphore id from the semaphore queue
-    int allocated_semaphore = -1;
-    int success = queue_out(&sem_queue, &allocated_semaphore);
-    if(success==-1){
+    // Obtain a semaphore id from the semaphore allocator
+    int allocated_semaphore = idmap_alloc(&sem_allocator);
+    if(allocated_semaphore==-1){
         kernel_log_error("Semaphore allocation failed ksem_init");
         return -1;
     }
@@ -59,13 +73,14 @@ int ksem_init(int value) {
         return -1;
     }
 
-    // Initialize the semaphore data structure
-    memset(&(semaphores[allocated_semaphore]), 0, sizeof(sem_t));
-    // semaphore table + all members (wait queue, allocated, count)
-    semaphores[allocated_semaphore].allocated = 1;
-    queue_init(&(semaphores[allocated_semaphore].wait_queue));
+    // Take a constructed semaphore (empty wait queue) from the cache
+    if (!(semaphores[allocated_semaphore] = kmem_cache_alloc(sem_cache))) {
+        idmap_free(&sem_allocator, allocated_semaphore);
+        kernel_log_error("Out of memory for semaphore ksem_init");
+        return -1;
+    }
     // set count to initial value
-    semaphores[allocated_semaphore].count = value;
+    semaphores[allocated_semaphore]->count = value;
     kernel_log_trace("Semaphore allocated: %d ksem_init", allocated_semaphore);
     return allocated_semaphore;
 }
@@ -76,16 +91,17 @@ int ksem_init(int value) {
  * @return 0 on success, -1 on error
  */
 int ksem_destroy(int id) {
-
-    // look up the sempaphore in the semaphore table
-    sem_t * semaphore = &(semaphores[id]);
+    sem_t * semaphore;
 
     //validate id
     if((id<0)||(id>=SEM_MAX)){
         kernel_log_error("Attempted to destroy out of range semaphore ksem_destroy");
         return -1;
     }
-    if(semaphore->allocated == 0){
+
+    // look up the sempaphore in the semaphore table
+    semaphore = semaphores[id];
+    if(semaphore == NULL){
         kernel_log_error("Attempted to destroy an inactive semaphore ksem_destroy");
         kernel_break();
         return -1;
@@ -97,11 +113,15 @@ int ksem_destroy(int id) {
         return -1;
     }
 
-    // Add the id back into the semaphore queue to be re-used later
-    queue_in(&sem_queue,id);
+    // Nobody is waiting, so the semaphore goes back to the cache as constructed
+    semaphores[id] = NULL;
+    kmem_cache_free(sem_cache, semaphore);
 
-    // Clear the memory for the data structure
-    memset(semaphore, 0, sizeof(sem_t));
+    // Give the id back to the allocator to be re-used later
+    if (idmap_free(&sem_allocator, id) != 0) {
+        kernel_log_error("Semaphore %d was not allocated ksem_destroy", id);
+        return -1;
+    }
 
     return -1;
 }
@@ -112,15 +132,17 @@ int ksem_destroy(int id) {
  * @return -1 on error, otherwise the current semaphore count
  */
 int ksem_wait(int id) {
-    // look up the sempaphore in the semaphore table
-    sem_t * semaphore = &(semaphores[id]);
+    sem_t * semaphore;
 
     //validate id
     if((id<0)||(id>=SEM_MAX)){
         kernel_log_error("Attempted to wait on out of range semaphore ksem_wait");
         return -1;
     }
-    if(semaphore->allocated == 0){
+
+    // look up the sempaphore in the semaphore table
+    semaphore = semaphores[id];
+    if(semaphore == NULL){
         kernel_log_error("Attempted to wait on inactive semaphore: %d ksem_wait", id);
         kernel_break();
         return -1;
@@ -132,7 +154,7 @@ int ksem_wait(int id) {
         // Set the state to WAITING
         proc->state = WAITING;
         // add to the semaphore's wait queue
-        queue_in(&(semaphore->wait_queue), proc->pid);
+        pid_queue_in(&(semaphore->wait_queue), proc->pid);
         // remove from the scheduler
         scheduler_remove(proc);
         return 0;
@@ -152,15 +174,17 @@ int ksem_wait(int id) {
  * @return -1 on error, otherwise the current semaphore count
  */
 int ksem_post(int id) {
-    // look up the sempaphore in the semaphore table
-    sem_t * semaphore = &(semaphores[id]);
+    sem_t * semaphore;
 
     //validate id
     if((id<0)||(id>=SEM_MAX)){
         kernel_log_error("Attempted to post to out of range semaphore ksem_post");
         return -1;
     }
-    if(semaphore->allocated == 0){
+
+    // look up the sempaphore in the semaphore table
+    semaphore = semaphores[id];
+    if(semaphore == NULL){
         kernel_log_error("Attempted to post to inactive semaphore: %d ksem_post", id);
         kernel_break();
         return -1;
@@ -170,10 +194,10 @@ int ksem_post(int id) {
     semaphore->count++;
 
     // check if any processes are waiting on the semaphore (semaphore wait queue)
-    if(!queue_is_empty(&(semaphore->wait_queue))){
+    if(!pid_queue_is_empty(&(semaphore->wait_queue))){
         // if so, queue out and add to the scheduler
         int pid_to_reactivate = -1;
-        int success = queue_out(&(semaphore->wait_queue), &pid_to_reactivate);
+        int success = pid_queue_out(&(semaphore->wait_queue), &pid_to_reactivate);
         if(success==-1){
             kernel_log_error("queue read failure ksem_post");
             return -1;
@@ -0,0 +1,271 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel Shared Memory Segments
+ *
+ * A segment is a set of pages mapped into the per-process window of every
+ * process that attaches it, at the same address in each. The segment holds
+ * one reference to each of its pages and every mapping holds another, so a
+ * page outlives the segment only while some address space still maps it.
+ * The segment itself is freed when the last process detaches it, either
+ * explicitly or by exiting.
+ *
+ * Shared pages are marked PAGING_SHARED so that a forked copy of a process
+ * keeps writing to the same pages instead of getting copies of them.
+ */
+
+#include <spede/string.h>
+
+#include "idmap.h"
+#include "kernel.h"
+#include "kmem.h"
+#include "kshm.h"
+#include "page.h"
+#include "paging.h"
+
+#if SHM_MAX > 32
+#error "SHM_MAX must fit in proc_t's shm_attached mask"
+#endif
+
+#if SHM_LIMIT > PROC_HEAP_BASE
+#error "Shared memory segments overlap the process heap"
+#endif
+
+// Table of all segments (NULL for ids that aren't allocated)
+shm_t *shm_segments[SHM_MAX];
+
+// Cache the segments are allocated from
+kmem_cache_t *shm_cache;
+
+// Segment ids to be allocated
+idmap_t shm_allocator;
+
+/**
+ * Returns the address segment id is mapped at
+ */
+static unsigned int kshm_addr(int id) {
+    return SHM_BASE + (unsigned int)id * SHM_SIZE_MAX;
+}
+
+/**
+ * Looks up a segment, logging an error if the id isn't valid
+ */
+static shm_t *kshm_get(int id, char *caller) {
+    if (id < 0 || id >= SHM_MAX || !shm_segments[id]) {
+        kernel_log_error("kshm: %s of segment %d which doesn't exist", caller, id);
+        return NULL;
+    }
+
+    return shm_segments[id];
+}
+
+/**
+ * Frees a segment and the segment's references to its pages
+ */
+static void kshm_free(int id) {
+    shm_t *shm = shm_segments[id];
+
+    for (unsigned int i = 0; i < shm->size / PAGE_SIZE; i++) {
+        if (shm->pages[i]) {
+            page_put(shm->pages[i]);
+        }
+    }
+
+    kfree(shm->pages);
+    shm_segments[id] = NULL;
+    kmem_cache_free(shm_cache, shm);
+    idmap_free(&shm_allocator, id);
+}
+
+/**
+ * Removes the first count pages of a segment from an address space,
+ * dropping the mappings' references
+ */
+static void kshm_unmap(pde_t *dir, int id, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        void *page = paging_unmap(dir, kshm_addr(id) + i * PAGE_SIZE);
+
+        if (page) {
+            page_put(page);
+        }
+    }
+}
+
+/**
+ * Initializes kernel shared memory data structures
+ * @return -1 on error, 0 on success
+ */
+int kshm_init(void) {
+    kernel_log_info("Initializing shared memory segments");
+
+    memset(shm_segments, 0, sizeof(shm_segments));
+
+    if (!(shm_cache = kmem_cache_create("shm_t", sizeof(shm_t), NULL))) {
+        return -1;
+    }
+
+    idmap_init(&shm_allocator, SHM_MAX);
+
+    return 0;
+}
+
+/**
+ * Creates a shared memory segment and attaches it to a process
+ * The segment is cleared and lives until the last process detaches it
+ * @param proc - the creating (user) process
+ * @param size - segment size in bytes, rounded up to whole pages
+ * @return -1 on error, otherwise the segment id
+ */
+int kshm_create(proc_t *proc, unsigned int size) {
+    unsigned int count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    shm_t *shm;
+    int id;
+
+    if (size == 0 || size > SHM_SIZE_MAX) {
+        kernel_log_error("kshm: invalid segment size %u", size);
+        return -1;
+    }
+
+    if ((id = idmap_alloc(&shm_allocator)) < 0) {
+        kernel_log_error("kshm: all %d segments are in use", SHM_MAX);
+        return -1;
+    }
+
+    if (!(shm = kmem_cache_alloc(shm_cache))) {
+        idmap_free(&shm_allocator, id);
+        kernel_log_error("kshm: out of memory for a segment");
+        return -1;
+    }
+
+    shm->size = count * PAGE_SIZE;
+    shm->refs = 0;
+    shm_segments[id] = shm;
+
+    if (!(shm->pages = kmalloc(count * sizeof(void *)))) {
+        shm_segments[id] = NULL;
+        kmem_cache_free(shm_cache, shm);
+        idmap_free(&shm_allocator, id);
+        kernel_log_error("kshm: out of memory for a segment");
+        return -1;
+    }
+
+    memset(shm->pages, 0, count * sizeof(void *));
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (!(shm->pages[i] = page_alloc(0))) {
+            kshm_free(id);
+            kernel_log_error("kshm: out of memory for a %u byte segment", shm->size);
+            return -1;
+        }
+
+        memset(shm->pages[i], 0, PAGE_SIZE);
+    }
+
+    // Nothing references a segment that isn't attached anywhere
+    if (kshm_attach(proc, id) == 0) {
+        kshm_free(id);
+        return -1;
+    }
+
+    return id;
+}
+
+/**
+ * Maps a shared memory segment into a process' address space
+ * Attaching a segment that is already attached just returns its address
+ * @param proc - the (user) process
+ * @param id - the segment id
+ * @return address of the segment in the process, 0 (NULL) on error
+ */
+unsigned int kshm_attach(proc_t *proc, int id) {
+    shm_t *shm = kshm_get(id, "attach");
+
+    if (!shm) {
+        return 0;
+    }
+
+    if (!proc || proc->type != PROC_TYPE_USER) {
+        kernel_log_error("kshm: only user processes can attach segments");
+        return 0;
+    }
+
+    if (proc->shm_attached & (1U << id)) {
+        return kshm_addr(id);
+    }
+
+    for (unsigned int i = 0; i < shm->size / PAGE_SIZE; i++) {
+        // The mapping takes a reference of its own
+        page_get(shm->pages[i]);
+
+        if (paging_map(proc->page_dir, kshm_addr(id) + i * PAGE_SIZE, shm->pages[i],
+                       PAGING_WRITE | PAGING_SHARED) != 0) {
+            page_put(shm->pages[i]);
+            kshm_unmap(proc->page_dir, id, i);
+            return 0;
+        }
+    }
+
+    proc->shm_attached |= 1U << id;
+    shm->refs++;
+
+    return kshm_addr(id);
+}
+
+/**
+ * Unmaps a shared memory segment from a process' address space
+ * The segment is freed when its last process detaches it
+ * @param proc - the process
+ * @param id - the segment id
+ * @return 0 on success, -1 on error
+ */
+int kshm_detach(proc_t *proc, int id) {
+    shm_t *shm = kshm_get(id, "detach");
+
+    if (!shm) {
+        return -1;
+    }
+
+    if (!proc || !(proc->shm_attached & (1U << id))) {
+        kernel_log_error("kshm: detach of segment %d which isn't attached", id);
+        return -1;
+    }
+
+    kshm_unmap(proc->page_dir, id, shm->size / PAGE_SIZE);
+    proc->shm_attached &= ~(1U << id);
+
+    if (--shm->refs == 0) {
+        kshm_free(id);
+    }
+
+    return 0;
+}
+
+/**
+ * Gives a forked process the parent's attachments
+ * The pages were already shared by paging_dir_fork; only the references
+ * of the segments are taken
+ * @param parent - the forked process
+ * @param child - its copy
+ */
+void kshm_fork(proc_t *parent, proc_t *child) {
+    child->shm_attached = parent->shm_attached;
+
+    for (int id = 0; id < SHM_MAX; id++) {
+        if (child->shm_attached & (1U << id)) {
+            shm_segments[id]->refs++;
+        }
+    }
+}
+
+/**
+ * Detaches every segment a process still has attached (on exit)
+ * @param proc - the process
+ */
+void kshm_release(proc_t *proc) {
+    for (int id = 0; id < SHM_MAX && proc->shm_attached; id++) {
+        if (proc->shm_attached & (1U << id)) {
+            kshm_detach(proc, id);
+        }
+    }
+}
@@ -8,6 +8,7 @@
 #include <spede/string.h>
 #include <spede/stdio.h>
 
+#include "clock.h"
 #include "kernel.h"
 #include "kproc.h"
 #include "ksyscall.h"
@@ -16,6 +17,8 @@
 #include "timer.h"
 #include "ksem.h"
 #include "kmutex.h"
+#include "kshm.h"
+#include "tty.h"
 
 /**
  * System call IRQ handler
@@ -58,6 +61,15 @@ void ksyscall_irq_handler(void) {
     case SYSCALL_PROC_EXIT:
         ksyscall_proc_exit();
         return;
+    case SYSCALL_PROC_SBRK:
+        rc = ksyscall_proc_sbrk(arg1);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_PROC_FORK:
+        // The child's copy of the trapframe already holds 0
+        rc = ksyscall_proc_fork();
+        proc->trapframe->eax = rc;
+        return;
     case SYSCALL_IO_WRITE:
         rc = ksyscall_io_write(arg1,(char*)arg2, arg3);
         proc->trapframe->eax = rc;
@@ -70,6 +82,10 @@ void ksyscall_irq_handler(void) {
         rc = ksyscall_io_flush(arg1);
         proc->trapframe->eax = rc;
         return;
+    case SYSCALL_IO_RESIZE:
+        rc = ksyscall_io_resize(arg1, arg2);
+        proc->trapframe->eax = rc;
+        return;
     case SYSCALL_PROC_SLEEP:
         rc = ksyscall_proc_sleep(arg1);
         return;
@@ -105,6 +121,34 @@ void ksyscall_irq_handler(void) {
         rc = ksyscall_sem_post(arg1);
         proc->trapframe->eax = rc;
         return;
+    case SYSCALL_TIMER_CREATE:
+        rc = ksyscall_timer_create(arg1, arg2, arg3);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_TIMER_CANCEL:
+        rc = ksyscall_timer_cancel(arg1);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_SYS_GET_TIME_NS:
+        rc = ksyscall_sys_get_time_ns((unsigned long long *)arg1);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_SHM_CREATE:
+        rc = ksyscall_shm_create(arg1);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_SHM_ATTACH:
+        rc = ksyscall_shm_attach(arg1);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_SHM_DETACH:
+        rc = ksyscall_shm_detach(arg1);
+        proc->trapframe->eax = rc;
+        return;
+    case SYSCALL_SYS_IRQ_STATS:
+        rc = ksyscall_sys_irq_stats(arg1, (irq_stats_t *)arg2);
+        proc->trapframe->eax = rc;
+        return;
     }
 
     if (proc->trapframe->eax == SYSCALL_SYS_GET_TIME) {
@@ -151,10 +195,27 @@ int ksyscall_io_write(int io, char *buf, int size) {
     // Ensure that the active process has valid io
     // If not active_proc->....
     if(active_proc->io[io]){
-        ringbuf_write_mem(active_proc->io[io], buf, size);
-        return size;
+        int written = 0;
+
+        // Copy straight into the free space of the ring; if it wraps this
+        // takes two passes, and whatever does not fit is dropped
+        while (written < size) {
+            char *dest;
+            int count = ringbuf_reserve(active_proc->io[io], &dest);
+
+            if (count <= 0) {
+                break;
+            }
+            if (count > size - written) {
+                count = size - written;
+            }
+
+            memcpy(dest, buf + written, count);
+            ringbuf_commit(active_proc->io[io], count);
+            written += count;
+        }
+        return written;
     }
-    // Using ringbuf_write_mem - Write size bytes from buf to active_proc->io...
     return -1;
 }
 
@@ -193,6 +254,8 @@ int ksyscall_io_flush(int io) {
         return -1;
     }
     if(active_proc->io[io]){
+        // Flushing moves the consumer's head; the kernel lock keeps the
+        // consumer (tty_refresh) and the other producers out meanwhile
         ringbuf_flush(active_proc->io[io]);
         return 0;
     }
@@ -200,6 +263,24 @@ int ksyscall_io_flush(int io) {
     return -1;
 }
 
+/**
+ * Replaces the I/O buffers of the active process' TTY with ones of the
+ * given sizes
+ * @param input_size - input buffer capacity in bytes
+ * @param output_size - output buffer capacity in bytes
+ * @return -1 on error or 0 on success
+ */
+int ksyscall_io_resize(int input_size, int output_size) {
+    int tty = tty_find_io(active_proc->io[PROC_IO_OUT]);
+
+    if (tty < 0) {
+        kernel_log_error("Process %d is not attached to a TTY, ksyscall_io_resize", active_proc->pid);
+        return -1;
+    }
+
+    return tty_io_resize(tty, input_size, output_size);
+}
+
 /**
  * Gets the current system time (in seconds)
  * @return system time in seconds
@@ -208,6 +289,20 @@ int ksyscall_sys_get_time(void) {
     return timer_get_ticks() / 100;
 }
 
+/**
+ * Gets the time since boot from the monotonic nanosecond clock
+ * @param ns - pointer to where the number of nanoseconds will be copied
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_sys_get_time_ns(unsigned long long *ns) {
+    if (!ns) {
+        return -1;
+    }
+
+    *ns = clock_now_ns();
+    return 0;
+}
+
 /**
  * Gets the operating system name
  * @param name - pointer to a character buffer where the name will be copied
@@ -222,6 +317,16 @@ int ksyscall_sys_get_name(char *name) {
     return 0;
 }
 
+/**
+ * Gets the interrupt statistics for the specified vector
+ * @param irq - interrupt vector number
+ * @param stats - pointer to the structure where the statistics will be copied
+ * @return 0 on success, -1 on error
+ */
+int ksyscall_sys_irq_stats(int irq, irq_stats_t *stats) {
+    return interrupts_irq_stats_get(irq, stats);
+}
+
 /**
  * Puts the active process to sleep for the specified number of seconds
  * @param seconds - number of seconds the process should sleep
@@ -244,6 +349,23 @@ int ksyscall_proc_exit(void) {
     return -1;
 }
 
+/**
+ * Creates a copy of the active process that shares its pages copy on write
+ * @return process id of the child (0 is returned in the child), -1 on error
+ */
+int ksyscall_proc_fork(void) {
+    return kproc_fork(active_proc);
+}
+
+/**
+ * Grows or shrinks the heap of the active process
+ * @param increment - number of bytes to add to the heap (negative to shrink it)
+ * @return the previous end of the heap, -1 on error
+ */
+int ksyscall_proc_sbrk(int increment) {
+    return kproc_sbrk(active_proc, increment);
+}
+
 /**
  * Gets the active process pid
  * @return process id or -1 on error
@@ -338,3 +460,53 @@ int ksyscall_mutex_unlock(int mutex) {
     return kmutex_unlock(mutex);
 }
 
+/**
+ * Creates a timer for the active process that posts a semaphore when it expires
+ * @param ms - milliseconds until the timer expires
+ * @param periodic - 0 to fire once, otherwise fire every ms milliseconds
+ * @param sem - semaphore id to post
+ * @return -1 on error, all other values indicate the timer id
+ */
+int ksyscall_timer_create(int ms, int periodic, int sem) {
+    return timer_proc_create(active_proc->pid, ms, periodic, sem);
+}
+
+/**
+ * Cancels a timer owned by the active process
+ * @param timer - timer id
+ * @return -1 on error, 0 on success
+ */
+int ksyscall_timer_cancel(int timer) {
+    return timer_proc_cancel(active_proc->pid, timer);
+}
+
+/**
+ * Creates a shared memory segment and attaches it to the active process
+ * @param size - segment size in bytes
+ * @return -1 on error, all other values indicate the segment id
+ */
+int ksyscall_shm_create(int size) {
+    if (size <= 0) {
+        return -1;
+    }
+
+    return kshm_create(active_proc, size);
+}
+
+/**
+ * Attaches a shared memory segment to the active process
+ * @param shm - segment id
+ * @return address of the segment, 0 (NULL in the process) on error
+ */
+int ksyscall_shm_attach(int shm) {
+    return kshm_attach(active_proc, shm);
+}
+
+/**
+ * Detaches a shared memory segment from the active process
+ * @param shm - segment id
+ * @return -1 on error, 0 on success
+ */
+int ksyscall_shm_detach(int shm) {
+    return kshm_detach(active_proc, shm);
+}
@@ -6,29 +6,60 @@
  */
 
 #include <spede/stdbool.h>
+#include "clock.h"
 #include "interrupts.h"
 #include "kernel.h"
 #include "keyboard.h"
+#include "kmem.h"
 #include "timer.h"
 #include "tty.h"
 #include "vga.h"
 #include "scheduler.h"
 #include "kproc.h"
+#include "page.h"
+#include "paging.h"
 #include "test.h"
 #include "ksyscall.h"
 #include "kmutex.h"
 #include "ksem.h"
+#include "kshm.h"
+#include "smp.h"
+#include "softirq.h"
+#include "trace.h"
 
 int main(void) {
     // Always iniialize the kernel
     kernel_init();
 
+    // Calibrate the TSC clock (needed for udelay and latency measurements)
+    clock_init();
+
+    // Hand the memory past the kernel image to the page allocator
+    page_init();
+
+    // Set up the object caches and kmalloc on top of the page allocator
+    kmem_init();
+
     // Initialize interrupts
     interrupts_init();
 
+    // Identity map the kernel with 4 MB pages and turn on paging
+    // (registers the page fault handler, so it needs the IDT)
+    // User stacks and trapframes live in the per-process window, which only
+    // exists with paging, so there is no running without it
+    if (paging_init() != 0) {
+        kernel_panic("Unable to enable paging");
+    }
+
+    // Initialize deferred interrupt work
+    softirq_init();
+
     // Initialize timers
     timer_init();
 
+    // Start recording kernel events (before any process is created)
+    trace_init();
+
     // Initialize the TTY
     tty_init();
 
@@ -51,6 +82,8 @@ int main(void) {
 
     kmutexes_init();
 
+    kshm_init();
+
     // Test initialization
     test_init();
 
@@ -64,6 +97,9 @@ int main(void) {
     // Clear the screen
     vga_clear();
 
+    // Start the other CPUs
+    smp_start_aps();
+
     // Enable interrupts
     interrupts_enable();
 
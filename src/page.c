@@ -0,0 +1,508 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Physical page-frame allocator (buddy system)
+ *
+ * Memory is handed out in blocks of 2^order pages. Each order keeps a
+ * doubly linked list of free blocks so a block can be taken off its list
+ * in O(1); allocation splits the smallest large-enough block and free
+ * merges a block with its buddy (the block at index ^ 2^order) for as
+ * long as the buddy is free, so both are O(PAGE_ORDER_MAX).
+ *
+ * Frame indexes are counted from a PAGE_BLOCK_MAX aligned base, so blocks
+ * are aligned to their size in physical memory as well (4 MB blocks can be
+ * mapped with 4 MB pages). The per-frame bookkeeping is kept outside the
+ * free memory, at the start of the managed region.
+ *
+ * An allocated block can be shared (e.g. a copy-on-write page mapped by
+ * two address spaces): page_get takes another reference and page_put
+ * frees the block when the last one is dropped.
+ *
+ * Installed memory is found with the CMOS, not a memory map. The kernel is
+ * loaded by the SPEDE monitor, which doesn't pass multiboot information
+ * and has already left real mode, so there is no e820 map to read. The
+ * CMOS gives the size of one range starting at 1 MB, which has limits:
+ *  - memory above 4 GB isn't counted (nor managed: see PAGE_MEMORY_LIMIT)
+ *  - holes (the 15-16 MB ISA hole, PCI and other MMIO ranges below the top
+ *    of memory) aren't reported and are assumed absent
+ *  - the ACPI tables and NVS kept at the top of memory aren't reported, so
+ *    PAGE_TOP_RESERVE is left unused there instead
+ * page_init_region is where a real memory map would plug in.
+ */
+#include <spede/machine/io.h>
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "page.h"
+
+// CMOS registers holding the amount of installed memory
+#define CMOS_PORT_INDEX         0x70
+#define CMOS_PORT_DATA          0x71
+#define CMOS_EXT_MEM_LOW        0x30    // KB between 1 MB and 16 MB
+#define CMOS_EXT_MEM_HIGH       0x31
+#define CMOS_HIGH_MEM_LOW       0x34    // 64 KB units above 16 MB
+#define CMOS_HIGH_MEM_HIGH      0x35
+
+// Frame states
+#define PAGE_RESERVED   0       // Not managed (below the region or bookkeeping)
+#define PAGE_TAIL       1       // Inside a block, but not its first frame
+#define PAGE_FREE       2       // First frame of a free block
+#define PAGE_USED       3       // First frame of an allocated block
+
+// Per-frame bookkeeping
+typedef struct page_t {
+    union {
+        int next;               // Next free block of the same order (-1 for none)
+        void *owner;            // Owner of an allocated frame (see page_set_owner)
+    };
+    int prev;                   // Previous free block of the same order (-1 for none)
+    unsigned char state;        // Frame state
+    unsigned char order;        // Order of the block starting at this frame
+    unsigned short refs;        // References to an allocated block (see page_get)
+} page_t;
+
+// End of the kernel image (defined by the linker)
+extern char end[];
+
+// Address of frame 0, aligned to PAGE_BLOCK_MAX
+char *page_base;
+
+// Bookkeeping for every frame from page_base to the end of the region
+page_t *page_table;
+int page_count;
+
+// First free block of each order (-1 for none)
+int page_free_list[PAGE_ORDERS];
+
+page_stats_t page_counters;
+
+/**
+ * Adds a free block to the front of its order's list
+ */
+static void page_list_add(int index, int order) {
+    page_t *page = &page_table[index];
+
+    page->state = PAGE_FREE;
+    page->order = order;
+    page->prev = -1;
+    page->next = page_free_list[order];
+
+    if (page->next >= 0) {
+        page_table[page->next].prev = index;
+    }
+
+    page_free_list[order] = index;
+    page_counters.blocks[order]++;
+}
+
+/**
+ * Takes a free block off its order's list
+ */
+static void page_list_remove(int index) {
+    page_t *page = &page_table[index];
+
+    if (page->prev >= 0) {
+        page_table[page->prev].next = page->next;
+    } else {
+        page_free_list[page->order] = page->next;
+    }
+
+    if (page->next >= 0) {
+        page_table[page->next].prev = page->prev;
+    }
+
+    page->state = PAGE_TAIL;
+    page_counters.blocks[page->order]--;
+}
+
+/**
+ * Frees a block at a frame index, merging it with its free buddies
+ */
+static void page_release(int index, int order) {
+    page_counters.free += 1U << order;
+
+    // No longer a used block; if it merges into its lower buddy it stays a
+    // tail, so a second free of the same address is refused
+    page_table[index].state = PAGE_TAIL;
+
+    while (order < PAGE_ORDER_MAX) {
+        int buddy = index ^ (1 << order);
+
+        if (buddy >= page_count || page_table[buddy].state != PAGE_FREE ||
+            page_table[buddy].order != order) {
+            break;
+        }
+
+        page_list_remove(buddy);
+        page_counters.merges++;
+
+        index &= ~(1 << order);
+        order++;
+    }
+
+    page_list_add(index, order);
+}
+
+/**
+ * Sets up the allocator to manage a region of memory
+ * The bookkeeping for the region is stored at its start
+ * @param start - first byte of the region
+ * @param limit - first byte past the region
+ * @return 0 on success, -1 on error
+ */
+int page_init_region(void *start, void *limit) {
+    unsigned long first = ((unsigned long)start + PAGE_SIZE - 1) & ~(unsigned long)(PAGE_SIZE - 1);
+    unsigned long last = (unsigned long)limit & ~(unsigned long)(PAGE_SIZE - 1);
+    unsigned long base = first & ~(unsigned long)(PAGE_BLOCK_MAX - 1);
+    unsigned int table_pages;
+    int index;
+
+    if (last <= first) {
+        kernel_log_error("page: invalid region 0x%08x-0x%08x",
+                         (unsigned int)(unsigned long)start, (unsigned int)(unsigned long)limit);
+        return -1;
+    }
+
+    page_base = (char *)base;
+    page_count = (int)((last - base) >> PAGE_SHIFT);
+    page_table = (page_t *)first;
+    table_pages = (page_count * sizeof(page_t) + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+    if (first + ((unsigned long)table_pages << PAGE_SHIFT) >= last) {
+        kernel_log_error("page: region too small for its %u pages of bookkeeping", table_pages);
+        page_count = 0;
+        return -1;
+    }
+
+    memset(page_table, 0, page_count * sizeof(page_t));
+    memset(&page_counters, 0, sizeof(page_counters));
+    for (int order = 0; order < PAGE_ORDERS; order++) {
+        page_free_list[order] = -1;
+    }
+
+    // Hand the rest of the region over in the largest aligned blocks that fit
+    index = (int)((first - base) >> PAGE_SHIFT) + table_pages;
+    page_counters.total = page_count - index;
+
+    // Every managed frame starts out inside a block; splits and frees only
+    // change the state of block heads, so frames of an allocated block other
+    // than its first are always tails and page_owner finds them
+    for (int i = index; i < page_count; i++) {
+        page_table[i].state = PAGE_TAIL;
+    }
+
+    while (index < page_count) {
+        int order = PAGE_ORDER_MAX;
+
+        while ((index & ((1 << order) - 1)) != 0 || index + (1 << order) > page_count) {
+            order--;
+        }
+
+        page_release(index, order);
+        index += 1 << order;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads a CMOS register
+ */
+static unsigned int page_cmos_read(unsigned char reg) {
+    outportb(CMOS_PORT_INDEX, reg);
+    return inportb(CMOS_PORT_DATA);
+}
+
+/**
+ * Finds the memory installed above 1 MB and hands everything past the end
+ * of the kernel image to the allocator
+ * Memory is sized from the CMOS, since the loader provides no memory map
+ * (see the limits at the top of this file)
+ * @return 0 on success, -1 on error
+ */
+int page_init(void) {
+    unsigned int ext_kb = page_cmos_read(CMOS_EXT_MEM_LOW) | (page_cmos_read(CMOS_EXT_MEM_HIGH) << 8);
+    unsigned int high = page_cmos_read(CMOS_HIGH_MEM_LOW) | (page_cmos_read(CMOS_HIGH_MEM_HIGH) << 8);
+    unsigned long long top;
+
+    kernel_log_info("Initializing page allocator");
+
+    // The CMOS only knows of one contiguous range from 1 MB: KB up to 16 MB,
+    // then 64 KB units from 16 MB up to 4 GB
+    if (high) {
+        top = 0x1000000ULL + ((unsigned long long)high << 16);
+    } else {
+        top = 0x100000ULL + ((unsigned long long)ext_kb << 10);
+    }
+
+    if (top > PAGE_MEMORY_LIMIT) {
+        top = PAGE_MEMORY_LIMIT;
+    }
+
+    kernel_log_info("page: %u MB of memory, kernel ends at 0x%08x",
+                    (unsigned int)(top >> 20), (unsigned int)(unsigned long)end);
+
+    top -= PAGE_TOP_RESERVE;
+
+    if (page_init_region(end, (void *)(unsigned long)top) != 0) {
+        return -1;
+    }
+
+    kernel_log_info("page: managing %u pages (%u KB) from 0x%08x",
+                    page_counters.total, page_counters.total * (PAGE_SIZE >> 10),
+                    (unsigned int)(unsigned long)page_base);
+    return 0;
+}
+
+/**
+ * Returns the frame index of an allocated block
+ * @return frame index, -1 if addr is not the start of an allocated block
+ */
+static int page_index_block(void *addr) {
+    unsigned long offset = (unsigned long)addr - (unsigned long)page_base;
+    int index = (int)(offset >> PAGE_SHIFT);
+
+    if ((unsigned long)addr < (unsigned long)page_base || (offset & (PAGE_SIZE - 1)) ||
+        index >= page_count || page_table[index].state != PAGE_USED) {
+        return -1;
+    }
+
+    return index;
+}
+
+/**
+ * Allocates a block of 2^order contiguous pages aligned to its size
+ * @param order - block order (0 to PAGE_ORDER_MAX)
+ * @return address of the block, NULL if no block is available
+ */
+void *page_alloc(int order) {
+    int found = order;
+    int index;
+
+    if (order < 0 || order > PAGE_ORDER_MAX) {
+        kernel_log_error("page: invalid order %d", order);
+        return NULL;
+    }
+
+    while (found <= PAGE_ORDER_MAX && page_free_list[found] < 0) {
+        found++;
+    }
+
+    if (found > PAGE_ORDER_MAX) {
+        page_counters.failures++;
+        return NULL;
+    }
+
+    index = page_free_list[found];
+    page_list_remove(index);
+
+    // Give back the upper half of the block until it is the right size
+    while (found > order) {
+        found--;
+        page_list_add(index + (1 << found), found);
+        page_counters.splits++;
+    }
+
+    page_table[index].state = PAGE_USED;
+    page_table[index].order = order;
+    page_table[index].refs = 1;
+
+    // The other frames still hold the owner of their previous block
+    for (int i = 0; i < 1 << order; i++) {
+        page_table[index + i].owner = NULL;
+    }
+
+    page_counters.free -= 1U << order;
+    page_counters.allocs++;
+
+    return page_base + ((unsigned long)index << PAGE_SHIFT);
+}
+
+/**
+ * Frees a block returned by page_alloc, merging it with its free buddies
+ * The block is freed whatever its reference count
+ * @param addr - address of the block
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_free(void *addr) {
+    int index = page_index_block(addr);
+
+    if (index < 0) {
+        kernel_log_error("page: free of 0x%08x which is not an allocated block",
+                         (unsigned int)(unsigned long)addr);
+        return -1;
+    }
+
+    page_counters.frees++;
+    page_release(index, page_table[index].order);
+    return 0;
+}
+
+/**
+ * Takes another reference to an allocated block
+ * @param addr - address of the block
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_get(void *addr) {
+    int index = page_index_block(addr);
+
+    if (index < 0 || page_table[index].refs == 0xffff) {
+        kernel_log_error("page: reference to 0x%08x which is not an allocated block",
+                         (unsigned int)(unsigned long)addr);
+        return -1;
+    }
+
+    page_table[index].refs++;
+    return 0;
+}
+
+/**
+ * Drops a reference to an allocated block, freeing it with the last one
+ * @param addr - address of the block
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_put(void *addr) {
+    int index = page_index_block(addr);
+
+    if (index < 0) {
+        kernel_log_error("page: release of 0x%08x which is not an allocated block",
+                         (unsigned int)(unsigned long)addr);
+        return -1;
+    }
+
+    if (--page_table[index].refs == 0) {
+        page_counters.frees++;
+        page_release(index, page_table[index].order);
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the number of references to an allocated block
+ * @param addr - address of the block
+ * @return reference count, 0 if addr is not an allocated block
+ */
+int page_refs(void *addr) {
+    int index = page_index_block(addr);
+
+    return index < 0 ? 0 : page_table[index].refs;
+}
+
+/**
+ * Returns the frame index of an address that may be inside an allocated
+ * block (the frames of free blocks past their first aren't told apart)
+ * @return frame index, -1 if the address is unmanaged or starts a free block
+ */
+static int page_index_used(void *addr) {
+    unsigned long offset = (unsigned long)addr - (unsigned long)page_base;
+    int index = (int)(offset >> PAGE_SHIFT);
+
+    if ((unsigned long)addr < (unsigned long)page_base || index >= page_count ||
+        page_table[index].state == PAGE_RESERVED || page_table[index].state == PAGE_FREE) {
+        return -1;
+    }
+
+    return index;
+}
+
+/**
+ * Records the owner of every page of an allocated block, so the owner can
+ * be found from any address inside the block with page_owner
+ * @param addr - address of the block (as returned by page_alloc)
+ * @param owner - owner to record
+ * @return 0 on success, -1 if addr is not an allocated block
+ */
+int page_set_owner(void *addr, void *owner) {
+    int index = page_index_used(addr);
+
+    if (index < 0 || page_table[index].state != PAGE_USED ||
+        ((unsigned long)addr & (PAGE_SIZE - 1))) {
+        kernel_log_error("page: owner set on 0x%08x which is not an allocated block",
+                         (unsigned int)(unsigned long)addr);
+        return -1;
+    }
+
+    for (int i = 0; i < 1 << page_table[index].order; i++) {
+        page_table[index + i].owner = owner;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the owner recorded for the page holding an address
+ * @param addr - any address inside an allocated block
+ * @return the owner, NULL if none was recorded or addr is not managed memory
+ */
+void *page_owner(void *addr) {
+    int index = page_index_used(addr);
+
+    return index < 0 ? NULL : page_table[index].owner;
+}
+
+/**
+ * Returns the smallest order whose blocks can hold a number of bytes
+ * @param size - number of bytes
+ * @return block order, -1 if size is larger than PAGE_BLOCK_MAX
+ */
+int page_order(unsigned int size) {
+    int order = 0;
+
+    if (size > PAGE_BLOCK_MAX) {
+        return -1;
+    }
+
+    while ((unsigned int)(PAGE_SIZE << order) < size) {
+        order++;
+    }
+
+    return order;
+}
+
+/**
+ * Copies the allocator statistics
+ * @param stats - statistics to fill in
+ */
+void page_stats(page_stats_t *stats) {
+    if (stats) {
+        *stats = page_counters;
+    }
+}
+
+/**
+ * Returns how much of the free memory can't be used for a block of the
+ * given order because it is split into smaller blocks
+ * @param order - block order
+ * @return percentage of free pages (0 when none are free)
+ */
+int page_fragmentation(int order) {
+    unsigned int usable = 0;
+
+    if (order < 0 || order > PAGE_ORDER_MAX || page_counters.free == 0) {
+        return 0;
+    }
+
+    for (int i = order; i < PAGE_ORDERS; i++) {
+        usable += page_counters.blocks[i] << i;
+    }
+
+    return (int)((page_counters.free - usable) * 100 / page_counters.free);
+}
+
+/**
+ * Prints the free block counts and fragmentation to the host console
+ */
+void page_stats_dump(void) {
+    kernel_log_info("page: %u of %u pages free; %u allocs, %u frees, %u splits, %u merges, %u failures",
+                    page_counters.free, page_counters.total, page_counters.allocs, page_counters.frees,
+                    page_counters.splits, page_counters.merges, page_counters.failures);
+    kernel_log_info("page: order  block KB  free blocks  unusable %%");
+
+    for (int order = 0; order < PAGE_ORDERS; order++) {
+        kernel_log_info("page: %5d  %8u  %11u  %10d",
+                        order, (PAGE_SIZE >> 10) << order, page_counters.blocks[order],
+                        page_fragmentation(order));
+    }
+}
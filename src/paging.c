@@ -0,0 +1,553 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Paging and per-process address spaces
+ *
+ * The kernel address space identity maps the whole 4 GB with 4 MB pages,
+ * so the kernel, every process stack and the page allocator's memory take
+ * one TLB entry per 4 MB. Those entries are global where the CPU supports
+ * it and stay in the TLB across CR3 reloads.
+ *
+ * Each user process has its own page directory: a copy of the kernel
+ * directory whose per-process window (PAGING_USER_BASE to
+ * PAGING_USER_LIMIT) is mapped with ordinary 4 KB page tables. Kernel
+ * processes run in the kernel address space. CR3 is reloaded on the way
+ * out of the kernel only when the next process has a different directory
+ * than the one the CPU already has loaded.
+ *
+ * Pages in the window are reference counted (page_get/page_put); each
+ * mapping holds one reference. paging_dir_fork shares every page of an
+ * address space with its copy and write-protects both, marking the
+ * entries PAGING_COW. The first write to such a page faults and the writer
+ * gets its own copy, or simply its write access back if nobody else shares
+ * the page any more. CR0.WP is set so writes from ring 0, where every
+ * process runs, respect read-only pages too.
+ */
+#include <spede/string.h>
+
+#include "interrupts.h"
+#include "kernel.h"
+#include "page.h"
+#include "paging.h"
+#include "smp.h"
+
+// CPUID leaf 1 feature bits (EDX)
+#define CPUID_PSE   (1 << 3)
+#define CPUID_PGE   (1 << 13)
+
+// Control register bits
+#define CR0_WP      0x00010000
+#define CR0_PG      0x80000000
+#define CR4_PSE     0x00000010
+#define CR4_PGE     0x00000080
+
+// Directory and table indexes of an address
+#define PAGING_DIR_INDEX(addr)      ((addr) >> 22)
+#define PAGING_TABLE_INDEX(addr)    (((addr) >> PAGE_SHIFT) & (PAGING_ENTRIES - 1))
+
+// Address held in an entry
+#define PAGING_ENTRY_ADDR(entry)    ((entry) & ~PAGING_FLAGS)
+
+// Kernel address space
+pde_t *paging_kernel;
+
+// Paging is on (the CPU supports 4 MB pages)
+int paging_enabled;
+
+// CR4 bits set on every CPU
+unsigned int paging_cr4;
+
+paging_stats_t paging_counters;
+
+/**
+ * CPU helpers
+ */
+static inline unsigned int paging_cpuid_features(void) {
+    unsigned int eax, ebx, ecx, edx;
+    asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    return edx;
+}
+
+static inline void paging_cr3_load(pde_t *dir) {
+    asm volatile("mov %0, %%cr3" : : "r"(dir) : "memory");
+}
+
+static inline void paging_invlpg(unsigned int addr) {
+    asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+static inline unsigned int paging_fault_addr(void) {
+    unsigned int cr2;
+    asm volatile("mov %%cr2, %0" : "=r"(cr2));
+    return cr2;
+}
+
+/**
+ * Turns on paging on the calling CPU with the kernel address space
+ * Read-only pages are write protected from the kernel as well (CR0.WP)
+ */
+static void paging_enable(void) {
+    unsigned int cr0;
+    unsigned int cr4;
+
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    asm volatile("mov %0, %%cr4" : : "r"(cr4 | paging_cr4));
+
+    paging_cr3_load(paging_kernel);
+
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %0, %%cr0" : : "r"(cr0 | CR0_PG | CR0_WP) : "memory");
+
+    smp_cpu()->page_dir = paging_kernel;
+}
+
+/**
+ * Builds the kernel address space, identity mapping memory with 4 MB pages,
+ * and enables paging on the bootstrap CPU
+ * Must be called after the page allocator and interrupts have been
+ * initialized
+ * @return 0 on success, -1 on error (paging stays disabled and user
+ *         processes can't run, since their stacks are in the per-process window)
+ */
+int paging_init(void) {
+    unsigned int features = paging_cpuid_features();
+    pde_t global = 0;
+
+    kernel_log_info("Initializing paging");
+
+    memset(&paging_counters, 0, sizeof(paging_counters));
+    paging_enabled = 0;
+    paging_cr4 = CR4_PSE;
+
+    if (features & CPUID_PGE) {
+        global = PAGING_GLOBAL;
+        paging_cr4 |= CR4_PGE;
+    }
+
+    if (!(paging_kernel = page_alloc(0))) {
+        kernel_log_error("paging: out of memory for the kernel page directory");
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < PAGING_ENTRIES; i++) {
+        unsigned int addr = i * PAGING_DIR_SPAN;
+
+        // The per-process window is left empty
+        if (addr >= PAGING_USER_BASE && addr < PAGING_USER_LIMIT) {
+            paging_kernel[i] = 0;
+            continue;
+        }
+
+        paging_kernel[i] = addr | PAGING_PRESENT | PAGING_WRITE | PAGING_LARGE | global;
+
+        // Above the window there are only memory mapped devices (APIC, IO APIC)
+        if (addr >= PAGING_USER_LIMIT) {
+            paging_kernel[i] |= PAGING_PCD | PAGING_PWT;
+        }
+    }
+
+    // Without 4 MB pages the kernel can't be identity mapped this way
+    if (!(features & CPUID_PSE)) {
+        kernel_log_error("paging: the CPU does not support 4 MB pages, paging disabled");
+        return -1;
+    }
+
+    interrupts_irq_register(IRQ_PAGE_FAULT, isr_entry_page_fault, paging_fault_handler);
+
+    paging_enable();
+    paging_enabled = 1;
+
+    kernel_log_info("paging: enabled, kernel directory at 0x%08x%s",
+                    (unsigned int)(unsigned long)paging_kernel, global ? " (global pages)" : "");
+    return 0;
+}
+
+/**
+ * Enables paging on an application processor with the kernel address space
+ */
+void paging_ap_init(void) {
+    if (paging_enabled) {
+        paging_enable();
+    }
+}
+
+/**
+ * Returns the kernel address space, used by kernel processes
+ * @return the kernel page directory
+ */
+pde_t *paging_kernel_dir(void) {
+    return paging_kernel;
+}
+
+/**
+ * Creates an address space sharing the kernel mappings with an empty
+ * per-process window
+ * @return the page directory, NULL if no memory is available
+ */
+pde_t *paging_dir_create(void) {
+    pde_t *dir;
+
+    if (!paging_kernel) {
+        kernel_log_error("paging: no kernel address space to copy");
+        return NULL;
+    }
+
+    if (!(dir = page_alloc(0))) {
+        kernel_log_error("paging: out of memory for a page directory");
+        return NULL;
+    }
+
+    // The window is empty in the kernel directory, so a copy is all it takes
+    memcpy(dir, paging_kernel, PAGE_SIZE);
+    paging_counters.dirs++;
+
+    return dir;
+}
+
+/**
+ * Creates a copy of an address space that shares every page of the
+ * per-process window with it, copy on write
+ * PAGING_SHARED pages (shared memory segments) stay writable and shared
+ * @param src - the page directory to copy
+ * @return the new page directory, NULL if no memory is available
+ */
+pde_t *paging_dir_fork(pde_t *src) {
+    pde_t *dir;
+
+    if (!src || src == paging_kernel) {
+        kernel_log_error("paging: only process address spaces can be forked");
+        return NULL;
+    }
+
+    if (!(dir = paging_dir_create())) {
+        return NULL;
+    }
+
+    for (unsigned int i = PAGING_DIR_INDEX(PAGING_USER_BASE); i < PAGING_DIR_INDEX(PAGING_USER_LIMIT); i++) {
+        pte_t *from;
+        pte_t *table;
+
+        if (!(src[i] & PAGING_PRESENT)) {
+            continue;
+        }
+
+        if (!(table = page_alloc(0))) {
+            kernel_log_error("paging: out of memory for a page table");
+            paging_dir_destroy(dir);
+            return NULL;
+        }
+
+        from = (pte_t *)(unsigned long)PAGING_ENTRY_ADDR(src[i]);
+
+        for (unsigned int j = 0; j < PAGING_ENTRIES; j++) {
+            if ((from[j] & PAGING_PRESENT) && (from[j] & PAGING_WRITE) && !(from[j] & PAGING_SHARED)) {
+                from[j] = (from[j] & ~PAGING_WRITE) | PAGING_COW;
+            }
+
+            if (from[j] & PAGING_PRESENT) {
+                page_get((void *)(unsigned long)PAGING_ENTRY_ADDR(from[j]));
+            }
+        }
+
+        // Both address spaces now hold a reference to every page
+        memcpy(table, from, PAGE_SIZE);
+        dir[i] = (pde_t)(unsigned long)table | (src[i] & PAGING_FLAGS);
+        paging_counters.tables++;
+    }
+
+    // Drop the writable entries the source may still have in the TLB
+    if (paging_enabled && smp_cpu()->page_dir == src) {
+        paging_cr3_load(src);
+    }
+
+    paging_counters.forks++;
+    return dir;
+}
+
+/**
+ * Destroys an address space created by paging_dir_create or paging_dir_fork
+ * The page tables of the per-process window are freed and the reference
+ * each mapping holds on its page is dropped
+ * @param dir - the page directory
+ */
+void paging_dir_destroy(pde_t *dir) {
+    if (!dir || dir == paging_kernel) {
+        return;
+    }
+
+    // Don't keep running on a directory that is about to be reused
+    if (smp_cpu()->page_dir == dir) {
+        paging_switch(paging_kernel);
+    }
+
+    // Another CPU with the directory loaded is still running on it; rather
+    // than free page tables under it, keep the address space (kproc_destroy
+    // never destroys a process that is current on another CPU)
+    for (int i = 0; i < CPU_MAX; i++) {
+        if (cpus[i].page_dir == dir) {
+            kernel_log_error("paging: directory 0x%08x is loaded on CPU %d, not freeing it",
+                             (unsigned int)(unsigned long)dir, i);
+            return;
+        }
+    }
+
+    for (unsigned int i = PAGING_DIR_INDEX(PAGING_USER_BASE); i < PAGING_DIR_INDEX(PAGING_USER_LIMIT); i++) {
+        pte_t *table;
+
+        if (!(dir[i] & PAGING_PRESENT)) {
+            continue;
+        }
+
+        table = (pte_t *)(unsigned long)PAGING_ENTRY_ADDR(dir[i]);
+
+        for (unsigned int j = 0; j < PAGING_ENTRIES; j++) {
+            if (table[j] & PAGING_PRESENT) {
+                page_put((void *)(unsigned long)PAGING_ENTRY_ADDR(table[j]));
+            }
+        }
+
+        page_free(table);
+        paging_counters.tables--;
+    }
+
+    page_free(dir);
+    paging_counters.dirs--;
+}
+
+/**
+ * Indicates if an address is a page in the per-process window
+ */
+static int paging_window_page(unsigned int addr) {
+    return addr >= PAGING_USER_BASE && addr < PAGING_USER_LIMIT && (addr & (PAGE_SIZE - 1)) == 0;
+}
+
+/**
+ * Maps a page into the per-process window of an address space
+ * The mapping takes over the caller's reference to the page
+ * @param dir - the page directory
+ * @param addr - page aligned address in the per-process window
+ * @param page - page aligned memory to map
+ * @param flags - entry flags (PAGING_PRESENT is implied)
+ * @return 0 on success, -1 on error
+ */
+int paging_map(pde_t *dir, unsigned int addr, void *page, unsigned int flags) {
+    pde_t *pde;
+    pte_t *table;
+
+    if (!dir || dir == paging_kernel || !paging_window_page(addr) ||
+        ((unsigned long)page & (PAGE_SIZE - 1))) {
+        kernel_log_error("paging: invalid mapping of 0x%08x at 0x%08x",
+                         (unsigned int)(unsigned long)page, addr);
+        return -1;
+    }
+
+    pde = &dir[PAGING_DIR_INDEX(addr)];
+
+    if (!(*pde & PAGING_PRESENT)) {
+        if (!(table = page_alloc(0))) {
+            kernel_log_error("paging: out of memory for a page table");
+            return -1;
+        }
+
+        memset(table, 0, PAGE_SIZE);
+
+        // The page table entries decide what is writable and user accessible
+        *pde = (pde_t)(unsigned long)table | PAGING_PRESENT | PAGING_WRITE | PAGING_USER;
+        paging_counters.tables++;
+    }
+
+    table = (pte_t *)(unsigned long)PAGING_ENTRY_ADDR(*pde);
+
+    if (table[PAGING_TABLE_INDEX(addr)] & PAGING_PRESENT) {
+        kernel_log_error("paging: 0x%08x is already mapped", addr);
+        return -1;
+    }
+
+    table[PAGING_TABLE_INDEX(addr)] = (pte_t)(unsigned long)page | (flags & PAGING_FLAGS) | PAGING_PRESENT;
+
+    return 0;
+}
+
+/**
+ * Removes a page from the per-process window of an address space
+ * The mapping's reference to the page is handed back to the caller
+ * @param dir - the page directory
+ * @param addr - page aligned address in the per-process window
+ * @return the page that was mapped, NULL if none was
+ */
+void *paging_unmap(pde_t *dir, unsigned int addr) {
+    pte_t *pte = paging_pte(dir, addr);
+    void *page;
+
+    if (!pte || !(*pte & PAGING_PRESENT)) {
+        return NULL;
+    }
+
+    page = (void *)(unsigned long)PAGING_ENTRY_ADDR(*pte);
+    *pte = 0;
+    paging_invalidate(dir, addr);
+
+    return page;
+}
+
+/**
+ * Returns the page table entry for an address in the per-process window
+ * @param dir - the page directory
+ * @param addr - address in the per-process window
+ * @return pointer to the entry, NULL if no page table covers the address
+ */
+pte_t *paging_pte(pde_t *dir, unsigned int addr) {
+    pde_t pde;
+
+    if (!dir || addr < PAGING_USER_BASE || addr >= PAGING_USER_LIMIT) {
+        return NULL;
+    }
+
+    pde = dir[PAGING_DIR_INDEX(addr)];
+
+    if (!(pde & PAGING_PRESENT)) {
+        return NULL;
+    }
+
+    return &((pte_t *)(unsigned long)PAGING_ENTRY_ADDR(pde))[PAGING_TABLE_INDEX(addr)];
+}
+
+/**
+ * Gives an address space its own writable copy of a copy-on-write page
+ * The page is only copied if another address space still shares it
+ * @param dir - the page directory
+ * @param addr - page aligned address in the per-process window
+ * @return 0 on success, -1 if the page isn't copy on write or no memory is available
+ */
+int paging_cow_break(pde_t *dir, unsigned int addr) {
+    pte_t *pte = paging_pte(dir, addr);
+    void *page;
+    void *copy;
+
+    if (!pte || (*pte & (PAGING_PRESENT | PAGING_COW)) != (PAGING_PRESENT | PAGING_COW)) {
+        return -1;
+    }
+
+    page = (void *)(unsigned long)PAGING_ENTRY_ADDR(*pte);
+
+    // The last one to write gets the page itself
+    if (page_refs(page) > 1) {
+        if (!(copy = page_alloc(0))) {
+            kernel_log_error("paging: out of memory to copy the page at 0x%08x", addr);
+            return -1;
+        }
+
+        memcpy(copy, page, PAGE_SIZE);
+        page_put(page);
+        page = copy;
+        paging_counters.cow_copies++;
+    }
+
+    *pte = (pte_t)(unsigned long)page | (*pte & PAGING_FLAGS & ~PAGING_COW) | PAGING_WRITE;
+    paging_invalidate(dir, addr);
+
+    return 0;
+}
+
+/**
+ * Translates an address in the per-process window of an address space to
+ * the kernel's (identity mapped) address of the same byte
+ * @param dir - the page directory
+ * @param addr - address in the per-process window
+ * @return the kernel address, NULL if nothing is mapped at addr
+ */
+void *paging_lookup(pde_t *dir, unsigned int addr) {
+    pte_t *pte = paging_pte(dir, addr);
+
+    if (!pte || !(*pte & PAGING_PRESENT)) {
+        return NULL;
+    }
+
+    return (char *)(unsigned long)PAGING_ENTRY_ADDR(*pte) + (addr & (PAGE_SIZE - 1));
+}
+
+/**
+ * Flushes the TLB entry for an address if the address space is loaded on
+ * the calling CPU
+ * A process only runs on one CPU at a time, and any other CPU that ran it
+ * has since reloaded CR3, so no other TLB can hold the entry
+ * @param dir - the page directory
+ * @param addr - address that was remapped
+ */
+void paging_invalidate(pde_t *dir, unsigned int addr) {
+    if (paging_enabled && smp_cpu()->page_dir == dir) {
+        paging_invlpg(addr);
+    }
+}
+
+/**
+ * Page fault handler
+ * Resolves writes to copy-on-write pages of the loaded address space;
+ * any other page fault is a kernel bug
+ * Processes run in ring 0 without a stack switch, so a fault can't be
+ * delivered on a read-only stack: process stacks are never left copy on write
+ */
+void paging_fault_handler(void) {
+    unsigned int addr = paging_fault_addr();
+
+    if (paging_cow_break(smp_cpu()->page_dir, addr & ~(PAGE_SIZE - 1)) == 0) {
+        paging_counters.cow_faults++;
+        return;
+    }
+
+    kernel_panic("paging: page fault at 0x%08x", addr);
+}
+
+/**
+ * Loads an address space on the calling CPU on the way out of the kernel
+ * CR3 is only reloaded (flushing the TLB) when the address space differs
+ * from the one already loaded
+ * @param dir - the page directory of the process about to run
+ */
+void paging_switch(pde_t *dir) {
+    cpu_t *cpu = smp_cpu();
+
+    if (!paging_enabled) {
+        return;
+    }
+
+    if (!dir) {
+        dir = paging_kernel;
+    }
+
+    if (cpu->page_dir == dir) {
+        paging_counters.cr3_avoided++;
+        return;
+    }
+
+    paging_cr3_load(dir);
+    cpu->page_dir = dir;
+    paging_counters.cr3_loads++;
+}
+
+/**
+ * Copies the paging statistics
+ * @param stats - statistics to fill in
+ */
+void paging_stats(paging_stats_t *stats) {
+    if (stats) {
+        *stats = paging_counters;
+    }
+}
+
+/**
+ * Prints the paging statistics to the host console
+ */
+void paging_stats_dump(void) {
+    unsigned int exits = paging_counters.cr3_loads + paging_counters.cr3_avoided;
+
+    kernel_log_info("paging: %s, %u address spaces, %u page tables",
+                    paging_enabled ? "enabled" : "disabled", paging_counters.dirs, paging_counters.tables);
+    kernel_log_info("paging: %u CR3 reloads, %u avoided (%u%% of kernel exits)",
+                    paging_counters.cr3_loads, paging_counters.cr3_avoided,
+                    exits >= 100 ? paging_counters.cr3_avoided / (exits / 100) :
+                    exits ? paging_counters.cr3_avoided * 100 / exits : 0);
+    kernel_log_info("paging: %u forks, %u copy-on-write faults, %u pages copied",
+                    paging_counters.forks, paging_counters.cow_faults, paging_counters.cow_copies);
+}
@@ -7,6 +7,7 @@
 
 #include <spede/stdio.h>
 #include <spede/string.h>
+#include "arena.h"
 #include "syscall.h"
 
 #define BUF_SIZE 128
@@ -24,6 +25,9 @@
 #define CMD_SLEEP "sleep"
 #define CMD_TIME "time"
 #define CMD_LOCK "lock"
+#define CMD_IRQS "irqs"
+#define CMD_TIMER "timer"
+#define CMD_HEAP "heap"
 
 /*
  * Mutexes for the lock
@@ -35,6 +39,9 @@ void prog_shell(void) {
     char name[32];
     char os_name[128];
 
+    // Heap arena; kept on the stack so every shell has its own
+    arena_t *arena = NULL;
+
     int buflen;
     int reading;
 
@@ -99,6 +106,9 @@ void prog_shell(void) {
                 pprintf("\tlock\t  takes a lock that may block other shells\n");
                 pprintf("\tsleep\t  puts the process to sleep for %d seconds\n", sleep_seconds);
                 pprintf("\ttime\t  displays the current system time\n");
+                pprintf("\tirqs\t  displays interrupt statistics\n");
+                pprintf("\ttimer\t  waits on a semaphore posted by a %d ms timer\n", sleep_seconds * 100);
+                pprintf("\theap\t  allocates strings from the process heap\n");
                 pprintf("\n");
             } else if(strncmp(input, CMD_SLEEP, strlen(CMD_SLEEP)) == 0) {
                 pprintf("Sleeping for %d seconds at time %d ... ", sleep_seconds, sys_get_time());
@@ -114,6 +124,55 @@ void prog_shell(void) {
                 mutex_lock(shell_mutex[pid % 2]);
                 proc_sleep(sleep_seconds);
                 mutex_unlock(shell_mutex[pid % 2]);
+            } else if (strncmp(input, CMD_TIMER, strlen(CMD_TIMER)) == 0) {
+                int sem = sem_init(0);
+                int timer = timer_create(sleep_seconds * 100, 0, sem);
+
+                if (sem < 0 || timer < 0) {
+                    pprintf("Unable to create the timer\n");
+                } else {
+                    pprintf("Waiting for timer %d at time %d ... ", timer, sys_get_time());
+                    sem_wait(sem);
+                    pprintf("... and posted at time %d!\n", sys_get_time());
+                }
+
+                if (sem >= 0) {
+                    sem_destroy(sem);
+                }
+            } else if (strncmp(input, CMD_HEAP, strlen(CMD_HEAP)) == 0) {
+                if (!arena) {
+                    arena = arena_create();
+                }
+
+                if (!arena) {
+                    pprintf("Unable to create the heap arena\n");
+                } else {
+                    int count = 0;
+
+                    // Strings of varying length, all dropped at once afterwards
+                    for (int i = 0; i < 32; i++) {
+                        char *str = arena_alloc(arena, 16 << (i % 8));
+
+                        if (str) {
+                            snprintf(str, 16, "string %d", i);
+                            count++;
+                        }
+                    }
+
+                    pprintf("Allocated %d strings (%u bytes) from a %u byte heap ending at 0x%08x\n",
+                            count, arena->in_use, arena->heap, (unsigned int)sbrk(0));
+                    arena_reset(arena);
+                }
+            } else if (strncmp(input, CMD_IRQS, strlen(CMD_IRQS)) == 0) {
+                irq_stats_t stats;
+
+                pprintf("vector  count       kcycles     max cycles\n");
+                for (int irq = 0; irq < IRQ_VECTOR_MAX; irq++) {
+                    if (sys_get_irq_stats(irq, &stats) == 0 && stats.count > 0) {
+                        pprintf("0x%02x    %-10u  %-10u  %u\n", irq, stats.count,
+                                (unsigned int)(stats.cycles >> 10), stats.max_cycles);
+                    }
+                }
             } else {
                 pprintf("You entered the following:\n%s\n", input);
             }
@@ -126,11 +185,56 @@ void prog_shell(void) {
  */
 int pingpong_semaphores[2] = {-1, -1};
 
+/*
+ * Shared memory segment the "pingpong" program passes its messages in
+ * The segment starts with a tag so a stale id can be recognized
+ */
+#define PINGPONG_MAGIC 0x676e6970     // "ping"
+
+typedef struct pingpong_msg_t {
+    unsigned int magic;
+    char text[BUF_SIZE];
+} pingpong_msg_t;
+
+int pingpong_shm = -1;
+
+/*
+ * Attaches the pingpong message buffer, creating it if needed
+ *
+ * The segment is freed when the last ping/pong exits and its id may then
+ * be handed to another program's segment, so a segment without the tag is
+ * detached again and a new one is created
+ */
+static char *pingpong_buffer(void) {
+    pingpong_msg_t *msg = NULL;
+
+    if (pingpong_shm >= 0) {
+        msg = shm_attach(pingpong_shm);
+
+        if (msg && msg->magic != PINGPONG_MAGIC) {
+            shm_detach(pingpong_shm);
+            msg = NULL;
+        }
+    }
+
+    if (!msg) {
+        pingpong_shm = shm_create(sizeof(pingpong_msg_t));
+        msg = pingpong_shm < 0 ? NULL : shm_attach(pingpong_shm);
+
+        if (msg) {
+            msg->magic = PINGPONG_MAGIC;
+        }
+    }
+
+    return msg ? msg->text : NULL;
+}
+
 void prog_ping(void) {
     int pid = proc_get_pid();
 
     int *ping = &pingpong_semaphores[0];
     int *pong = &pingpong_semaphores[1];
+    char *message = pingpong_buffer();
 
     if (*ping < 0) {
         *ping = sem_init(1);
@@ -146,6 +250,10 @@ void prog_ping(void) {
         sem_wait(*ping);
         pprintf("%04d pingpong[%02d] ping!\n", sys_get_time(), pid);
         proc_sleep((pid % 2) + 3);
+        // The message is written straight into the pong's memory
+        if (message) {
+            snprintf(message, BUF_SIZE, "from ping[%02d] at %04d", pid, sys_get_time());
+        }
         sem_post(*pong);
     }
 }
@@ -155,6 +263,7 @@ void prog_pong(void) {
 
     int *ping = &pingpong_semaphores[0];
     int *pong = &pingpong_semaphores[1];
+    char *message = pingpong_buffer();
 
     if (*ping < 0) {
         *ping = sem_init(0);
@@ -166,8 +275,26 @@ void prog_pong(void) {
 
     while (1) {
         sem_wait(*pong);
-        pprintf("%04d pingpong[%02d] pong!\n", sys_get_time(), pid);
+        pprintf("%04d pingpong[%02d] pong! %s\n", sys_get_time(), pid, message ? message : "");
         proc_sleep((pid % 2) + 2);
         sem_post(*ping);
     }
 }
+
+/*
+ * Amount of work done by each benchmark worker
+ */
+#ifndef WORKER_ITERATIONS
+#define WORKER_ITERATIONS 50000000
+#endif
+
+void prog_worker(void) {
+    volatile unsigned int sum = 0;
+
+    // Purely CPU-bound; no system calls until the work is done
+    for (unsigned int i = 0; i < WORKER_ITERATIONS; i++) {
+        sum += i ^ (sum >> 3);
+    }
+
+    proc_exit(0);
+}
@@ -3,27 +3,99 @@
  * California State University, Sacramento
  *
  * Simple ring buffer implementation
+ *
+ * The capacity is a power of two and head/tail run freely, so positions
+ * are found with a mask and a full buffer is told apart from an empty one
+ * without a separate count. Bulk transfers are split into at most two
+ * memcpy calls: up to the end of data[] and then from its start.
+ *
+ * Buffer data comes from kmalloc, whose size classes are powers of two, so
+ * a destroyed buffer's data is reused by the next buffer of the same size.
+ *
+ * One producer and one consumer may run at the same time without a lock:
+ *  - the producer reads head, writes the data, then publishes the new tail
+ *  - the consumer reads tail, reads the data, then publishes the new head
+ * x86 does not reorder loads with older loads or stores with older stores,
+ * so a compiler barrier between the data access and the index update is
+ * all the ordering that is needed, even between CPUs.
+ *
+ * Nothing more than that is lock-free. Several producers (or consumers)
+ * must be serialized by the caller, as must flushing, which moves head on
+ * behalf of the consumer. In the kernel that is the kernel lock with
+ * interrupts disabled: a TTY's io_output is written by every process
+ * attached to it and by the keyboard echo, and is flushed by processes,
+ * all of which run under the kernel lock. The only unlocked overlap is the
+ * keyboard IRQ echoing while tty_refresh drains the buffer from the timer
+ * softirq, which is one producer against one consumer.
  */
 
 #include <spede/stdbool.h>      // for bool type
 #include <spede/stddef.h>       // for size_t
-#include <spede/string.h>       // for memset
+#include <spede/string.h>       // for memset, memcpy
 
+#include "kmem.h"
 #include "ringbuf.h"
 
+// Keeps the compiler from moving data accesses across index updates
+#define ringbuf_barrier() asm volatile("" : : : "memory")
+
 /**
  * Initializes an empty ring buffer
- * Sets the empty data to 0
+ * Allocates the data with kmalloc (power-of-two sizes fit the size classes
+ * exactly); the data isn't cleared since nothing is readable until written
  *
  * @param  buf - pointer to the ring buffer data structure
+ * @param  size - capacity in bytes (rounded up to a power of two),
+ *                0 for RINGBUF_SIZE
  * @return -1 on error; 0 on success
  */
-int ringbuf_init(ringbuf_t *buf) {
+int ringbuf_init(ringbuf_t *buf, size_t size) {
+    unsigned int capacity = RINGBUF_SIZE_MIN;
+
     if (!buf) {
         return -1;
     }
 
-    memset(buf, 0, RINGBUF_SIZE);
+    if (size == 0) {
+        size = RINGBUF_SIZE;
+    } else if (size < RINGBUF_SIZE_MIN) {
+        size = RINGBUF_SIZE_MIN;
+    }
+
+    while (capacity < size && capacity < 0x80000000U) {
+        capacity <<= 1;
+    }
+
+    buf->head = 0;
+    buf->tail = 0;
+    buf->size = 0;
+
+    buf->data = kmalloc(capacity);
+    if (!buf->data) {
+        return -1;
+    }
+
+    buf->size = capacity;
+
+    return 0;
+}
+
+/**
+ * Frees the data of a ring buffer
+ * @param  buf - pointer to the ring buffer data structure
+ * @return -1 on error; 0 on success
+ */
+int ringbuf_destroy(ringbuf_t *buf) {
+    if (!buf || !buf->data) {
+        return -1;
+    }
+
+    kfree(buf->data);
+
+    buf->head = 0;
+    buf->tail = 0;
+    buf->size = 0;
+    buf->data = NULL;
 
     return 0;
 }
@@ -35,23 +107,21 @@ int ringbuf_init(ringbuf_t *buf) {
  * @return -1 on error; 0 on success
  */
 int ringbuf_write(ringbuf_t *buf, char byte) {
-    if (!buf) {
+    if (!buf || !buf->data) {
         return -1;
     }
 
-    if (buf->size == RINGBUF_SIZE) {
+    unsigned int tail = buf->tail;
+
+    if (tail - buf->head == buf->size) {
         return -1;
     }
+    ringbuf_barrier();
 
-    buf->data[buf->tail] = byte;
+    buf->data[tail & (buf->size - 1)] = byte;
 
-    buf->tail++;
-
-    if (buf->tail == RINGBUF_SIZE) {
-        buf->tail = 0;
-    }
-
-    buf->size++;
+    ringbuf_barrier();
+    buf->tail = tail + 1;
 
     return 0;
 }
@@ -63,23 +133,21 @@ int ringbuf_write(ringbuf_t *buf, char byte) {
  * @return -1 on error; 0 on success
  */
 int ringbuf_read(ringbuf_t *buf, char *byte) {
-    if (!buf || !byte) {
+    if (!buf || !buf->data || !byte) {
         return -1;
     }
 
-    if (buf->size == 0) {
+    unsigned int head = buf->head;
+
+    if (buf->tail == head) {
         return -1;
     }
+    ringbuf_barrier();
 
-    *byte = buf->data[buf->head];
-
-    buf->head++;
-
-    if (buf->head == RINGBUF_SIZE) {
-        buf->head = 0;
-    }
+    *byte = buf->data[head & (buf->size - 1)];
 
-    buf->size--;
+    ringbuf_barrier();
+    buf->head = head + 1;
 
     return 0;
 }
@@ -94,18 +162,34 @@ int ringbuf_read(ringbuf_t *buf, char *byte) {
  *       cannot be copied - i.e. the buffer would overflow
  */
 int ringbuf_write_mem(ringbuf_t *buf, char *mem, size_t size) {
-    if (!buf) {
+    unsigned int tail;
+    unsigned int pos;
+    unsigned int first;
+
+    if (!buf || !buf->data || (!mem && size)) {
         return -1;
     }
 
-    if (buf->size + size > RINGBUF_SIZE) {
+    tail = buf->tail;
+
+    if (size > buf->size - (tail - buf->head)) {
         return -1;
     }
+    ringbuf_barrier();
 
-    while (size-- && !ringbuf_is_full(buf)) {
-        ringbuf_write(buf, *mem++);
+    pos = tail & (buf->size - 1);
+    first = buf->size - pos;
+    if (first > size) {
+        first = size;
     }
 
+    memcpy(&buf->data[pos], mem, first);
+    memcpy(&buf->data[0], mem + first, size - first);
+
+    // Publish the data to the consumer
+    ringbuf_barrier();
+    buf->tail = tail + size;
+
     return 0;
 }
 
@@ -118,22 +202,172 @@ int ringbuf_write_mem(ringbuf_t *buf, char *mem, size_t size) {
  *         copied
  */
 int ringbuf_read_mem(ringbuf_t *buf, char *mem, size_t size) {
+    unsigned int head;
+    unsigned int used;
+    unsigned int pos;
+    unsigned int first;
+
+    if (!buf || !buf->data || (!mem && size)) {
+        return -1;
+    }
+
+    head = buf->head;
+    used = buf->tail - head;
+    if (size > used) {
+        size = used;
+    }
+    ringbuf_barrier();
+
+    pos = head & (buf->size - 1);
+    first = buf->size - pos;
+    if (first > size) {
+        first = size;
+    }
+
+    memcpy(mem, &buf->data[pos], first);
+    memcpy(mem + first, &buf->data[0], size - first);
+
+    // Hand the space back to the producer
+    ringbuf_barrier();
+    buf->head = head + size;
+
+    return size;
+}
+
+/**
+ * Reserves the contiguous free space at the tail of the buffer
+ * The producer may fill the region in place and then publish it with
+ * ringbuf_commit(); nothing is visible to the consumer until then
+ * @param buf - pointer to the ring buffer structure
+ * @param mem - pointer to where the start of the region will be stored
+ * @return -1 on error, otherwise the number of bytes that may be written
+ *         (0 if the buffer is full)
+ */
+int ringbuf_reserve(ringbuf_t *buf, char **mem) {
+    unsigned int tail;
+    unsigned int pos;
+    unsigned int free;
+
+    if (!buf || !buf->data || !mem) {
+        return -1;
+    }
+
+    tail = buf->tail;
+    free = buf->size - (tail - buf->head);
+    ringbuf_barrier();
+
+    pos = tail & (buf->size - 1);
+    if (free > buf->size - pos) {
+        free = buf->size - pos;
+    }
+
+    *mem = &buf->data[pos];
+    return free;
+}
+
+/**
+ * Publishes bytes written into a region returned by ringbuf_reserve()
+ * @param buf - pointer to the ring buffer structure
+ * @param size - number of bytes written
+ * @return -1 on error, 0 on success
+ */
+int ringbuf_commit(ringbuf_t *buf, size_t size) {
+    unsigned int tail;
+
+    if (!buf) {
+        return -1;
+    }
+
+    tail = buf->tail;
+
+    if (size > buf->size - (tail - buf->head)) {
+        return -1;
+    }
+
+    ringbuf_barrier();
+    buf->tail = tail + size;
+
+    return 0;
+}
+
+/**
+ * Gets the contiguous readable data at the head of the buffer
+ * The consumer may use the region in place and then release it with
+ * ringbuf_consume(); the data may wrap, so a second peek may return more
+ * @param buf - pointer to the ring buffer structure
+ * @param mem - pointer to where the start of the region will be stored
+ * @return -1 on error, otherwise the number of bytes that may be read
+ *         (0 if the buffer is empty)
+ */
+int ringbuf_peek_contiguous(ringbuf_t *buf, char **mem) {
+    unsigned int head;
+    unsigned int pos;
+    unsigned int used;
+
+    if (!buf || !buf->data || !mem) {
+        return -1;
+    }
+
+    head = buf->head;
+    used = buf->tail - head;
+    ringbuf_barrier();
+
+    pos = head & (buf->size - 1);
+    if (used > buf->size - pos) {
+        used = buf->size - pos;
+    }
+
+    *mem = &buf->data[pos];
+    return used;
+}
+
+/**
+ * Releases bytes returned by ringbuf_peek_contiguous() back to the producer
+ * @param buf - pointer to the ring buffer structure
+ * @param size - number of bytes consumed
+ * @return -1 on error, 0 on success
+ */
+int ringbuf_consume(ringbuf_t *buf, size_t size) {
+    unsigned int head;
+
     if (!buf) {
         return -1;
     }
 
-    int count = 0;
+    head = buf->head;
 
-    while (size-- && !ringbuf_is_empty(buf)) {
-        ringbuf_read(buf, mem++);
-        count++;
+    if (size > buf->tail - head) {
+        return -1;
     }
 
-    return count;
+    ringbuf_barrier();
+    buf->head = head + size;
+
+    return 0;
+}
+
+/**
+ * Returns the number of bytes in the buffer
+ * @param buf - pointer to the ring buffer structure
+ * @return number of bytes that can be read
+ */
+int ringbuf_size(ringbuf_t *buf) {
+    return buf ? (int)(buf->tail - buf->head) : 0;
+}
+
+/**
+ * Returns the capacity of the buffer
+ * @param buf - pointer to the ring buffer structure
+ * @return number of bytes the buffer can hold
+ */
+int ringbuf_capacity(ringbuf_t *buf) {
+    return buf ? (int)buf->size : 0;
 }
 
 /**
  * Flushes (empties) the buffer
+ * Discards everything written so far; this is a consumer operation, so it
+ * must not run at the same time as the consumer
  * @param buf - pointer to the ring buffer structure
  * @return -1 on error, 0 on success
  */
@@ -142,7 +376,8 @@ int ringbuf_flush(ringbuf_t *buf) {
         return -1;
     }
 
-    memset(buf, 0, RINGBUF_SIZE);
+    // Consume everything published so far; the producer keeps its tail
+    buf->head = buf->tail;
     return 0;
 }
 
@@ -152,7 +387,7 @@ int ringbuf_flush(ringbuf_t *buf) {
  * @return true if empty, false if not empty
  */
 bool ringbuf_is_empty(ringbuf_t *buf) {
-    return buf && buf->size == 0;
+    return buf && buf->tail == buf->head;
 }
 
 /**
@@ -161,6 +396,5 @@ bool ringbuf_is_empty(ringbuf_t *buf) {
  * @return true if full, false if not full
  */
 bool ringbuf_is_full(ringbuf_t *buf) {
-    return buf && buf->size == RINGBUF_SIZE;
+    return buf && buf->tail - buf->head == buf->size;
 }
-
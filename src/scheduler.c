@@ -14,41 +14,89 @@
 #include "kernel.h"
 #include "kproc.h"
 #include "scheduler.h"
+#include "smp.h"
 #include "timer.h"
 
 #include "queue.h"
 //d
 
 // Process Queues
-queue_t run_queue;
-queue_t sleep_queue;
+// (each CPU has its own run queue in cpus[], sleeping processes are shared)
+pid_queue_t sleep_queue;
 
-// Pointer to the currently active process
-proc_t *active_proc;
-
-void scheduler_timer(void) {//f
+pid_queue_t *scheduler_queue_pick(void) { //f
 /**
- * Scheduler timer callback
+ * Picks the run queue of the least loaded online CPU
+ * @return pointer to the run queue
+ */
+    cpu_t *best = &cpus[0];
+    for(int i = 1; i < CPU_MAX; i++){
+        if(cpus[i].online && pid_queue_size(&cpus[i].run_queue) < pid_queue_size(&best->run_queue)){
+            best = &cpus[i];
+        }
+    }
+    return &best->run_queue;
+}
+//d
+void scheduler_tick(void) { //f
+/**
+ * Per-CPU timer tick accounting
+ * Called by the timer IRQ handler on every CPU
  */
+    cpu_t *cpu = smp_cpu();
+    cpu->ticks++;
     // Update the active process' run time and CPU time
-    // TODO update this for the sleep thing?
-    if (active_proc != NULL) {
-        active_proc->run_time++;
-        active_proc->cpu_time++;
+    if (cpu->current != NULL) {
+        cpu->current->run_time++;
+        cpu->current->cpu_time++;
+        if (smp_is_idle_proc(cpu->current)) {
+            cpu->idle_ticks++;
+        }
     }
-    for(int i = 0; i < sleep_queue.size; i++){
+}
+//d
+void scheduler_timer(void) {//f
+/**
+ * Scheduler timer callback
+ */
+    // Wake up any processes that are done sleeping
+    int sleeping = pid_queue_size(&sleep_queue);
+    for(int i = 0; i < sleeping; i++){
         int pid = -1;
-        int success = queue_out(&sleep_queue,&pid);
+        int success = pid_queue_out(&sleep_queue,&pid);
         if(success==-1){kernel_log_error("Bad queue read schedule_timer");}
         proc_t* proc = pid_to_proc(pid);
         proc->sleep_time--;
         if(proc->sleep_time<=0){
             kernel_log_info("process pid: %d finished sleeping", pid);
-            queue_in(&run_queue, pid);
+            pid_queue_in(scheduler_queue_pick(), pid);
         }else{
-            queue_in(&sleep_queue, pid);
+            pid_queue_in(&sleep_queue, pid);
+        }
+    }
+}
+//d
+proc_t *scheduler_steal(cpu_t *cpu) { //f
+/**
+ * Takes a process from the busiest other CPU's run queue
+ * @param cpu - the CPU that has nothing to run
+ * @return pointer to the process, NULL if every run queue is empty
+ */
+    cpu_t *busiest = NULL;
+    int pid = -1;
+    for(int i = 0; i < CPU_MAX; i++){
+        if(&cpus[i] == cpu || pid_queue_is_empty(&cpus[i].run_queue)){
+            continue;
+        }
+        if(busiest == NULL || pid_queue_size(&cpus[i].run_queue) > pid_queue_size(&busiest->run_queue)){
+            busiest = &cpus[i];
         }
     }
+    if(busiest == NULL || pid_queue_out(&busiest->run_queue, &pid) == -1){
+        return NULL;
+    }
+    cpu->steals++;
+    return pid_to_proc(pid);
 }
 //d
 void scheduler_run(void) { //f
@@ -56,52 +104,53 @@ void scheduler_run(void) { //f
  * Executes the scheduler
  * Should ensure that `active_proc` is set to a valid process entry
  */
+    cpu_t *cpu = smp_cpu();
     // Ensure that processes not in the active state aren't still scheduled
     //kernel_log_info("scheduler run");
 
     // Check if we have an active process //f
-    if(active_proc != NULL){
+    if(cpu->current != NULL){
         // Check if the current process has exceeded it's time slice
-        if(active_proc->cpu_time >= SCHEDULER_TIMESLICE){
+        // (the idle process gives way as soon as anything else is runnable)
+        if(cpu->current->cpu_time >= SCHEDULER_TIMESLICE || smp_is_idle_proc(cpu->current)){
             // Reset the active time
-            active_proc->cpu_time = 0;
+            cpu->current->cpu_time = 0;
 
             // If the process is not the idle task, add it back to the scheduler
-            if(active_proc->pid != 0){
-                queue_in(&run_queue, active_proc->pid);
+            if(!smp_is_idle_proc(cpu->current)){
+                pid_queue_in(&cpu->run_queue, cpu->current->pid);
             }
             // Otherwise, simply set the state to IDLE
-            active_proc->state = IDLE;
+            cpu->current->state = IDLE;
             // Unschedule the active process
-            active_proc = NULL;
+            cpu->current = NULL;
         }
     }
     //d
     int next_pid = -1;
     // Check if we have a process scheduled or not
-    if(active_proc == NULL){
-        // Get the proces id from the run queue. (Remove unsched process)
-        queue_out(&run_queue,&next_pid); 
-        if(next_pid==-1)//-1 == empty queue
-        {
-            // default to process id 0 (idle task) if a process can't be scheduled
-            active_proc = pid_to_proc(0);
+    if(cpu->current == NULL){
+        // Get the proces id from this CPU's run queue. (Remove unsched process)
+        pid_queue_out(&cpu->run_queue,&next_pid);
+        if(next_pid != -1){
+            cpu->current = pid_to_proc(next_pid);
         }
-        // Update the active proc pointer
-        else{
-            active_proc = pid_to_proc(next_pid);
+        // Nothing local to run, try to take work from another CPU
+        else if((cpu->current = scheduler_steal(cpu)) == NULL){
+            // default to this CPU's idle task if a process can't be scheduled
+            cpu->current = cpu->idle_proc ? cpu->idle_proc : pid_to_proc(0);
         }
     }
     // Make sure we have a valid process at this point
     //f deal with paranoia
-    if(active_proc == NULL){
+    if(cpu->current == NULL){
         kernel_log_error("scheduler_run drew pid %d from the queue, this process no longer exists, breakpoint.",next_pid);//TODO this line may be unneccissary?
         kernel_break();
     }
     //d
 
     // Ensure that the process state is set
-    active_proc->state = ACTIVE;
+    cpu->current->state = ACTIVE;
 }
 //d
 void scheduler_add(proc_t *proc) { //f
@@ -109,24 +158,25 @@ void scheduler_add(proc_t *proc) { //f
  * Adds a process to the scheduler
  * @param proc - pointer to the process entry
  */
-    // Add the process to the run queue
-    queue_in(&run_queue, proc->pid);
+    // Add the process to the least loaded CPU's run queue
+    pid_queue_in(scheduler_queue_pick(), proc->pid);
     // Set the process state
     proc->state = IDLE;
 }
 //d
-int remove_item_from_queue(queue_t * removal_queue,int desired_item){ //f
+int remove_item_from_queue(pid_queue_t * removal_queue,int desired_item){ //f
     // loops through a queue searching for an specific item. returns 1 if found, 0 if not found.
     // I am iritated that queue is the data structure specified by specification. This feels not right.
-    for(int i = 0; i< removal_queue->size; i++){
+    int count = pid_queue_size(removal_queue);
+    for(int i = 0; i< count; i++){
         int current_item = -1;
-        int success = queue_out(removal_queue, &current_item);
+        int success = pid_queue_out(removal_queue, &current_item);
         if(current_item == -1){kernel_panic("How the fudgesickles did a -1 get in the PID queue? remove_item_from_queue");}
         if(success == -1){kernel_panic("Queue read failed! remove_item_from_queue");}
         if(current_item == desired_item){
             return 1;
         }
-        queue_in(removal_queue, current_item);
+        pid_queue_in(removal_queue, current_item);
     }
     return 0;
 }
@@ -134,9 +184,13 @@ int remove_item_from_queue(queue_t * removal_queue,int desired_item){ //f
 void scheduler_remove(proc_t *proc) { //f
 /**
  * Removes a process from the scheduler
+ * Only the calling CPU's active process is cleared; the process must not be
+ * current on another CPU (see kproc_destroy)
  * @param proc - pointer to the process entry
  */
-    remove_item_from_queue(&run_queue, proc->pid);
+    for(int i = 0; i < CPU_MAX; i++){
+        remove_item_from_queue(&cpus[i].run_queue, proc->pid);
+    }
     remove_item_from_queue(&sleep_queue, proc->pid);
     // If the process is the active process, ensure that the active process is cleared so when the
     // scheduler runs again, it will select a new process to run
@@ -153,8 +207,10 @@ void scheduler_init(void) { //f
     kernel_log_info("Initializing scheduler");
 
     // Initialize any data structures or variables
-    queue_init(&run_queue);
-    queue_init(&sleep_queue);
+    for(int i = 0; i < CPU_MAX; i++){
+        pid_queue_init(&cpus[i].run_queue);
+    }
+    pid_queue_init(&sleep_queue);
 
     // Register the timer callback (scheduler_timer) to run every tick
     timer_callback_register(scheduler_timer,1,-1);
@@ -176,20 +232,22 @@ void scheduler_sleep(proc_t *proc, int seconds){ //f
 //d
     proc->sleep_time = 100*seconds;
     proc->state = SLEEPING;
-    if(remove_item_from_queue(&run_queue, proc->pid)){
-        // if we find our item in the run queue, move it to the sleep queue
-        queue_in(&sleep_queue, proc->pid);
-        return;
+    for(int i = 0; i < CPU_MAX; i++){
+        if(remove_item_from_queue(&cpus[i].run_queue, proc->pid)){
+            // if we find our item in a run queue, move it to the sleep queue
+            pid_queue_in(&sleep_queue, proc->pid);
+            return;
+        }
     }
     if((active_proc)&&(active_proc==proc)){
         // if our process was the current active process, make it not the active process. Active processes can't be asleep!
-        queue_in(&sleep_queue, proc->pid);
+        pid_queue_in(&sleep_queue, proc->pid);
         active_proc=NULL;
         return;
     }
     if(remove_item_from_queue(&sleep_queue, proc->pid)){
         //out process was already sleeping? cool I guess? just keep sleeping
-        queue_in(&sleep_queue, proc->pid);
+        pid_queue_in(&sleep_queue, proc->pid);
         return;
     }
     //our our process is not one of the scheduled processes???? whoops? scream an error
@@ -0,0 +1,324 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Symmetric multiprocessing
+ *
+ * Every CPU has its own kernel stack, active process, idle process and
+ * run queue. Kernel code is serialized by the big kernel lock, which is
+ * taken on kernel entry and released right before returning to a process,
+ * so the process, semaphore, mutex and timer tables only ever see one CPU
+ * at a time while processes themselves run in parallel.
+ *
+ * Those tables have no locks of their own yet; giving the process,
+ * semaphore and mutex tables their own spinlocks so kernel entries on
+ * different CPUs can overlap is a follow-up to this big kernel lock.
+ */
+#include <spede/string.h>
+
+#include "apic.h"
+#include "clock.h"
+#include "kernel.h"
+#include "kproc.h"
+#include "paging.h"
+#include "prog_user.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "timer.h"
+#include "trace.h"
+
+/**
+ * Variables
+ */
+
+// Per-CPU data table
+cpu_t cpus[CPU_MAX];
+
+// Per-CPU kernel stacks
+unsigned char cpu_kstack[CPU_MAX][KSTACK_SIZE];
+
+// Number of CPUs running
+volatile int smp_cpus_online = 1;
+
+// Logical CPU number for each local APIC id
+unsigned char smp_apic_to_cpu[256];
+
+// Big kernel lock
+spinlock_t kernel_lock = SPINLOCK_INIT;
+
+// Handed to the application processor being started
+unsigned int smp_ap_stack;
+volatile int smp_ap_booting;
+
+// Descriptor tables loaded by application processors
+unsigned char smp_idtr[6];
+
+// Scaling benchmark state
+int smp_bench_pids[PROC_MAX];
+int smp_bench_workers;
+int smp_bench_start_tick;
+int smp_bench_timer = -1;
+
+/**
+ * Sets up the per-CPU data for the bootstrap CPU
+ */
+void smp_init_boot(void) {
+    memset(cpus, 0, sizeof(cpus));
+    memset(smp_apic_to_cpu, 0, sizeof(smp_apic_to_cpu));
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        cpus[i].id = i;
+        pid_queue_init(&cpus[i].run_queue);
+    }
+
+    cpus[0].online = 1;
+    smp_cpus_online = 1;
+}
+
+/**
+ * Returns the top of the kernel stack to switch to on kernel entry
+ * Called from kernel_enter (context.S) on the interrupted stack
+ * @return stack pointer, or 0 if the kernel itself was interrupted
+ */
+unsigned int kernel_stack_get(void) {
+    cpu_t *cpu = smp_cpu();
+
+    if (cpu->irq_depth) {
+        return 0;
+    }
+
+    return (unsigned int)&cpu_kstack[cpu->id][KSTACK_SIZE];
+}
+
+/**
+ * Indicates if the process is one of the per-CPU idle processes
+ * @param proc - pointer to the process entry
+ * @return 1 if it is an idle process, 0 otherwise
+ */
+int smp_is_idle_proc(proc_t *proc) {
+    for (int i = 0; i < CPU_MAX; i++) {
+        if (cpus[i].idle_proc == proc) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Application processor entry point (called from smp_boot.S)
+ * Runs on the CPU's own kernel stack with interrupts disabled
+ */
+void smp_ap_main(void) {
+    cpu_t *cpu = &cpus[smp_ap_booting];
+
+    asm volatile("lidt %0" : : "m"(smp_idtr));
+
+    apic_ap_init();
+
+    // Make this CPU visible to smp_cpu() before using any per-CPU data
+    smp_apic_to_cpu[apic_id()] = cpu->id;
+    asm volatile("lock incl %0" : "+m"(smp_cpus_online) : : "memory");
+
+    // Turn on paging with the kernel address space
+    paging_ap_init();
+    cpu->online = 1;
+
+    // Start running the idle process; the first tick schedules real work
+    spin_lock(&kernel_lock);
+    cpu->irq_depth = 0;
+    cpu->current = cpu->idle_proc;
+    cpu->current->state = ACTIVE;
+    paging_switch(cpu->current->page_dir);
+    spin_unlock(&kernel_lock);
+
+    kernel_context_exit(cpu->current->trapframe);
+}
+
+/**
+ * Starts all application processors described by ACPI
+ */
+void smp_start_aps(void) {
+    int bsp = apic_id();
+    int count = apic_cpu_count();
+    unsigned int size = smp_trampoline_end - smp_trampoline_start;
+    unsigned char *trampoline = (unsigned char *)SMP_TRAMPOLINE_ADDR;
+    unsigned char *gdtr;
+
+    if (!apic_enabled() || count <= 1) {
+        kernel_log_info("smp: running on a single CPU");
+        return;
+    }
+
+    kernel_log_info("smp: starting %d application processors", count - 1);
+
+    cpus[0].apic_id = bsp;
+    smp_apic_to_cpu[bsp] = 0;
+
+    // Copy the startup code below 1MB and give it the kernel GDT
+    memcpy(trampoline, smp_trampoline_start, size);
+    gdtr = trampoline + (smp_trampoline_gdtr - smp_trampoline_start);
+    asm volatile("sgdt (%0)" : : "r"(gdtr) : "memory");
+    asm volatile("sidt %0" : "=m"(smp_idtr));
+
+    // Keep other CPUs out of the kernel until all of them are set up
+    spin_lock(&kernel_lock);
+
+    for (int n = 0; n < count; n++) {
+        int id = apic_cpu_apic_id(n);
+        int next = smp_cpus_online;
+        cpu_t *cpu = &cpus[next];
+
+        if (id == bsp || next >= CPU_MAX) {
+            continue;
+        }
+
+        // Each CPU gets an idle process that is never placed on a run queue
+        int pid = kproc_create(kproc_idle, "idle", PROC_TYPE_KERNEL);
+        proc_t *idle = pid_to_proc(pid);
+        if (!idle) {
+            kernel_log_error("smp: unable to create idle process for CPU %d", next);
+            break;
+        }
+        scheduler_remove(idle);
+
+        cpu->apic_id = id;
+        cpu->idle_proc = idle;
+        smp_ap_booting = next;
+        smp_ap_stack = (unsigned int)&cpu_kstack[next][KSTACK_SIZE];
+
+        apic_cpu_start(id, SMP_TRAMPOLINE_ADDR);
+
+        // Give the CPU up to 100ms to come online
+        for (int wait = 0; wait < 100 && !cpu->online; wait++) {
+            udelay(1000);
+        }
+
+        if (!cpu->online) {
+            kernel_log_error("smp: CPU with APIC id %d did not start", id);
+            cpu->idle_proc = NULL;
+            kproc_destroy(idle);
+            continue;
+        }
+
+        trace_event(TRACE_CPU_START, idle->pid, next);
+        kernel_log_info("smp: CPU %d (APIC id %d) online", next, id);
+    }
+
+    spin_unlock(&kernel_lock);
+
+    kernel_log_info("smp: %d CPUs online", smp_cpus_online);
+}
+
+/**
+ * Takes the big kernel lock from a kernel process so it can call kernel
+ * functions; like a system call, the code runs with interrupts disabled
+ * until smp_kernel_unlock()
+ */
+void smp_kernel_lock(void) {
+    asm volatile("cli" : : : "memory");
+    spin_lock(&kernel_lock);
+}
+
+/**
+ * Releases the big kernel lock taken with smp_kernel_lock()
+ */
+void smp_kernel_unlock(void) {
+    spin_unlock(&kernel_lock);
+    asm volatile("sti" : : : "memory");
+}
+
+/**
+ * Benchmark timer callback; reports once all workers have exited
+ */
+void smp_bench_check(void) {
+    int elapsed;
+
+    for (int i = 0; i < smp_bench_workers; i++) {
+        if (pid_to_proc(smp_bench_pids[i]) != NULL) {
+            return;
+        }
+    }
+
+    elapsed = timer_get_ticks() - smp_bench_start_tick;
+
+    kernel_log_info("smp bench: %d workers on %d CPUs finished in %d ticks (%d workers/sec x100)",
+                    smp_bench_workers, smp_cpus_online, elapsed,
+                    elapsed ? smp_bench_workers * TIMER_HZ * 100 / elapsed : 0);
+    smp_stats_dump();
+
+    timer_callback_unregister(smp_bench_timer);
+    smp_bench_timer = -1;
+}
+
+/**
+ * Starts the scaling benchmark
+ * Run with QEMU -smp 1 through -smp 8 to compare scaling
+ *
+ * @param workers - number of worker processes
+ * @return 0 on success, -1 on error
+ */
+int smp_bench_start(int workers) {
+    if (smp_bench_timer >= 0) {
+        kernel_log_warn("smp bench: already running");
+        return -1;
+    }
+
+    if (workers <= 0 || workers > PROC_MAX) {
+        kernel_log_error("smp bench: invalid number of workers %d", workers);
+        return -1;
+    }
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        cpus[i].steals = 0;
+        cpus[i].ticks = 0;
+        cpus[i].idle_ticks = 0;
+    }
+
+    smp_bench_workers = 0;
+    smp_bench_start_tick = timer_get_ticks();
+
+    for (int i = 0; i < workers; i++) {
+        int pid = kproc_create(prog_worker, "worker", PROC_TYPE_USER);
+
+        if (pid < 0) {
+            break;
+        }
+
+        smp_bench_pids[smp_bench_workers++] = pid;
+    }
+
+    kernel_log_info("smp bench: started %d workers on %d CPUs", smp_bench_workers, smp_cpus_online);
+
+    smp_bench_timer = timer_callback_register(smp_bench_check, 10, -1);
+    return smp_bench_timer < 0 ? -1 : 0;
+}
+
+/**
+ * Kernel process that starts the scaling benchmark (CTRL+w), so the
+ * workers aren't created from inside the keyboard IRQ
+ */
+void smp_bench_proc(void) {
+    smp_kernel_lock();
+    smp_bench_start(SMP_BENCH_WORKERS);
+    smp_kernel_unlock();
+}
+
+/**
+ * Prints per-CPU scheduling statistics to the host console
+ */
+void smp_stats_dump(void) {
+    kernel_log_info("smp: cpu  apic    ticks     idle   steals  queued  running");
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        cpu_t *cpu = &cpus[i];
+
+        if (!cpu->online) {
+            continue;
+        }
+
+        kernel_log_info("smp: %3d  %4d  %7u  %7u  %7u  %6d  %s", i, cpu->apic_id,
+                        cpu->ticks, cpu->idle_ticks, cpu->steals, pid_queue_size(&cpu->run_queue),
+                        cpu->current ? cpu->current->name : "-");
+    }
+}
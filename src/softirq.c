@@ -0,0 +1,104 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Deferred interrupt work (softirqs)
+ *
+ * IRQ handlers only mark work as pending; the work itself is run from
+ * kernel_context_enter() once the IRQ has been dismissed in the PIC.
+ * Handlers run with interrupts enabled so any IRQ may preempt them.
+ */
+#include <spede/string.h>
+
+#include "kernel.h"
+#include "softirq.h"
+
+// Bitmask of pending softirq vectors
+volatile unsigned int softirq_pending;
+
+// Set while softirq handlers are running to prevent re-entry
+int softirq_active;
+
+// Softirq handler table
+void (*softirq_handlers[SOFTIRQ_MAX])();
+
+/**
+ * Initializes softirq data structures
+ */
+void softirq_init(void) {
+    kernel_log_info("Initializing softirqs");
+
+    softirq_pending = 0;
+    softirq_active = 0;
+    memset(softirq_handlers, 0, sizeof(softirq_handlers));
+}
+
+/**
+ * Registers the handler for a softirq vector
+ * @param nr - softirq vector
+ * @param handler - function to call when the vector has been raised
+ * @return 0 on success, -1 on error
+ */
+int softirq_register(int nr, void (*handler)()) {
+    if (nr < 0 || nr >= SOFTIRQ_MAX) {
+        kernel_log_error("softirq: invalid vector %d", nr);
+        return -1;
+    }
+
+    if (!handler) {
+        kernel_log_error("softirq: invalid handler for vector %d", nr);
+        return -1;
+    }
+
+    softirq_handlers[nr] = handler;
+    kernel_log_debug("softirq: vector %d registered", nr);
+    return 0;
+}
+
+/**
+ * Marks a softirq vector as pending; safe to call from an IRQ handler
+ * @param nr - softirq vector
+ */
+void softirq_raise(int nr) {
+    if (nr < 0 || nr >= SOFTIRQ_MAX) {
+        kernel_log_error("softirq: invalid vector %d", nr);
+        return;
+    }
+
+    // Single locked instruction so a nested IRQ cannot lose the update
+    asm volatile("lock orl %1, %0" : "+m"(softirq_pending) : "r"(1 << nr) : "memory");
+}
+
+/**
+ * Runs the handlers of all pending softirq vectors with interrupts enabled
+ * Called with interrupts disabled after the IRQ has been dismissed and
+ * before returning to the process; returns with interrupts disabled
+ */
+void softirq_run(void) {
+    unsigned int pending;
+
+    if (softirq_active) {
+        return;
+    }
+
+    softirq_active = 1;
+
+    // Handlers may raise more work, so loop until nothing is left
+    while (softirq_pending) {
+        // Atomically take ownership of everything pending right now
+        pending = 0;
+        asm volatile("xchgl %0, %1" : "+r"(pending), "+m"(softirq_pending) : : "memory");
+
+        asm volatile("sti" : : : "memory");
+
+        for (int nr = 0; nr < SOFTIRQ_MAX; nr++) {
+            if ((pending & (1 << nr)) && softirq_handlers[nr]) {
+                softirq_handlers[nr]();
+            }
+        }
+
+        asm volatile("cli" : : : "memory");
+    }
+
+    softirq_active = 0;
+}
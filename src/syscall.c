@@ -111,6 +111,15 @@ int sys_get_time(void) {
     return _syscall0(SYSCALL_SYS_GET_TIME);
 }
 
+/**
+ * Gets the time since boot from the monotonic nanosecond clock
+ * @param ns - pointer to where the number of nanoseconds will be copied
+ * @return 0 on success, -1 on error
+ */
+int sys_get_time_ns(unsigned long long *ns) {
+    return _syscall1(SYSCALL_SYS_GET_TIME_NS, (int)ns);
+}
+
 /**
  * Gets the operating system name
  * @param name - pointer to a character buffer where the name will be copied
@@ -120,6 +129,16 @@ int sys_get_name(char *name) {
     return _syscall1(SYSCALL_SYS_GET_NAME, (int)name);
 }
 
+/**
+ * Gets the interrupt statistics for the specified vector
+ * @param irq - interrupt vector number
+ * @param stats - pointer to the structure where the statistics will be copied
+ * @return 0 on success, -1 on error
+ */
+int sys_get_irq_stats(int irq, irq_stats_t *stats) {
+    return _syscall2(SYSCALL_SYS_IRQ_STATS, irq, (int)stats);
+}
+
 /**
  * Puts the current process to sleep for the specified number of seconds
  * @param seconds - number of seconds the process should sleep
@@ -144,6 +163,26 @@ int proc_get_pid(void) {
     return _syscall0(SYSCALL_PROC_GET_PID);
 }
 
+/**
+ * Grows or shrinks the heap of the current process
+ * New heap memory is cleared
+ * @param increment - number of bytes to add to the heap (negative to shrink it)
+ * @return the previous end of the heap, (void *)-1 on error
+ */
+void *sbrk(int increment) {
+    return (void *)_syscall1(SYSCALL_PROC_SBRK, increment);
+}
+
+/**
+ * Creates a copy of the current process
+ * The copy shares the memory of the process copy on write and resumes
+ * from the same point, so this returns twice
+ * @return process id of the copy in the parent, 0 in the copy, -1 on error
+ */
+int proc_fork(void) {
+    return _syscall0(SYSCALL_PROC_FORK);
+}
+
 /**
  * Gets the current process' name
  * @param name - pointer to a character buffer where the name will be copied
@@ -184,6 +223,18 @@ int io_flush(int io) {
     return _syscall1(SYSCALL_IO_FLUSH,io);
 }
 
+/**
+ * Replaces the I/O buffers of the process' TTY with ones of the given sizes
+ * Anything still buffered is discarded, and every process attached to the
+ * TTY uses the new buffers
+ * @param input_size - input buffer capacity in bytes
+ * @param output_size - output buffer capacity in bytes
+ * @return -1 on error or 0 on success
+ */
+int io_resize(int input_size, int output_size) {
+    return _syscall2(SYSCALL_IO_RESIZE, input_size, output_size);
+}
+
 /**
 <<<<<<< Updated upstream
  * Allocates a semaphore from the kernel
@@ -255,3 +306,53 @@ int mutex_lock(int mutex) {
 int mutex_unlock(int mutex) {
     return _syscall1(SYSCALL_MUTEX_UNLOCK, mutex);
 }
+
+/**
+ * Creates a timer that posts a semaphore when it expires
+ * @param ms - milliseconds until the timer expires
+ * @param periodic - 0 to fire once, otherwise fire every ms milliseconds
+ * @param sem - semaphore id to post
+ * @return -1 on error, all other values indicate the timer id
+ */
+int timer_create(int ms, int periodic, int sem) {
+    return _syscall3(SYSCALL_TIMER_CREATE, ms, periodic, sem);
+}
+
+/**
+ * Cancels a timer
+ * @param timer - timer id
+ * @return -1 on error, 0 on success
+ */
+int timer_cancel(int timer) {
+    return _syscall1(SYSCALL_TIMER_CANCEL, timer);
+}
+
+/**
+ * Creates a shared memory segment and attaches it to the current process
+ * The segment is cleared; it is freed when the last process detaches it
+ * @param size - segment size in bytes
+ * @return -1 on error, all other values indicate the segment id
+ */
+int shm_create(int size) {
+    return _syscall1(SYSCALL_SHM_CREATE, size);
+}
+
+/**
+ * Attaches a shared memory segment to the current process
+ * The segment is at the same address in every process it is attached to
+ * @param shm - segment id
+ * @return address of the segment, NULL on error
+ */
+void *shm_attach(int shm) {
+    // The kernel returns 0 for errors, so a failed attach comes back as NULL
+    return (void *)_syscall1(SYSCALL_SHM_ATTACH, shm);
+}
+
+/**
+ * Detaches a shared memory segment from the current process
+ * @param shm - segment id
+ * @return -1 on error, 0 on success
+ */
+int shm_detach(int shm) {
+    return _syscall1(SYSCALL_SHM_DETACH, shm);
+}
@@ -6,9 +6,17 @@
  */
 #include <spede/string.h>
 
+#include "apic.h"
+#include "clock.h"
+#include "idmap.h"
 #include "interrupts.h"
 #include "kernel.h"
+#include "kmem.h"
+#include "ksem.h"
 #include "queue.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "softirq.h"
 #include "timer.h"
 
 /**
@@ -16,9 +24,23 @@
  */
 // Timer data structure
 typedef struct timer_t {
+    int id;             // Timer id (index into the timers table)
     void (*callback)(); // Function to call when the interval occurs
+    void *arg;          // Argument passed to the callback (NULL for none)
+    int owner;          // Process that created the timer (-1 for the kernel)
+    int owner_sem;      // Semaphore posted when a process timer expires
     int interval;       // Interval in which the timer will be called
     int repeat;         // Indicate how many intervals to repeat (-1 should repeat forever)
+    int deferred;       // Run from the timer softirq instead of the timer IRQ
+    int pending;        // Number of deferred intervals waiting to be run
+
+    int expires;        // Absolute tick at which the timer next fires
+    int heap_index;     // Position in the timer heap (-1 if not queued)
+
+    unsigned int calls;             // Number of times the callback has run
+    unsigned long long cycles;      // Total CPU cycles spent in the callback
+    unsigned int max_cycles;        // Most expensive single invocation
+    unsigned int overruns;          // Invocations that went over the budget
 } timer_t;
 
 /**
@@ -28,45 +50,247 @@ typedef struct timer_t {
 // Number of timer ticks that have occured
 int timer_ticks;
 
-// Timers table; each item in the array is a timer_t struct
-timer_t timers[TIMERS_MAX];
+// Timers table; NULL for ids that aren't allocated
+timer_t *timers[TIMERS_MAX];
+
+// Cache the timer entries are allocated from
+kmem_cache_t *timer_cache;
 
 // Timer allocator; used to allocate indexes into the timers table
-queue_t timer_allocator;
+idmap_t timer_allocator;
+
+// Min-heap of timer ids ordered by expiry tick; timer_heap[0] fires next
+int timer_heap[TIMERS_MAX];
+int timer_heap_size;
+
+// Deferred timers with pending intervals, in the order they became due
+DEFINE_QUEUE(timer_id_queue, int, TIMERS_MAX)
+timer_id_queue_t timer_pending;
+
+// Ids currently in timer_pending; kept by id rather than in the entry since
+// a timer may be unregistered and its id reallocated while it is queued
+char timer_queued[TIMERS_MAX];
+
+// Per-invocation callback budget (0 until the clock is calibrated)
+unsigned int timer_budget_cycles;
 
+// Most expensive timer IRQ and timer softirq runs
+unsigned int timer_tick_max_cycles;
+unsigned int timer_softirq_max_cycles;
 
 /**
- * Registers a new callback to be called at the specified interval
+ * Timer heap helpers
+ * All of them must be called with the timer IRQ kept out
+ */
+static void timer_heap_set(int pos, int id) {
+    timer_heap[pos] = id;
+    timers[id]->heap_index = pos;
+}
+
+static void timer_heap_up(int pos) {
+    int id = timer_heap[pos];
+
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+
+        if (timers[timer_heap[parent]]->expires <= timers[id]->expires) {
+            break;
+        }
+
+        timer_heap_set(pos, timer_heap[parent]);
+        pos = parent;
+    }
+
+    timer_heap_set(pos, id);
+}
+
+static void timer_heap_down(int pos) {
+    int id = timer_heap[pos];
+
+    while (1) {
+        int child = pos * 2 + 1;
+
+        if (child >= timer_heap_size) {
+            break;
+        }
+
+        if (child + 1 < timer_heap_size &&
+            timers[timer_heap[child + 1]]->expires < timers[timer_heap[child]]->expires) {
+            child++;
+        }
+
+        if (timers[id]->expires <= timers[timer_heap[child]]->expires) {
+            break;
+        }
+
+        timer_heap_set(pos, timer_heap[child]);
+        pos = child;
+    }
+
+    timer_heap_set(pos, id);
+}
+
+static void timer_heap_push(int id) {
+    timer_heap_set(timer_heap_size++, id);
+    timer_heap_up(timers[id]->heap_index);
+}
+
+static void timer_heap_remove(int id) {
+    int pos = timers[id]->heap_index;
+    int last;
+
+    if (pos < 0) {
+        return;
+    }
+
+    timers[id]->heap_index = -1;
+    last = timer_heap[--timer_heap_size];
+
+    if (pos == timer_heap_size) {
+        return;
+    }
+
+    // Move the last entry into the hole and restore the heap order
+    timer_heap_set(pos, last);
+    timer_heap_up(pos);
+    timer_heap_down(timers[last]->heap_index);
+}
+
+
+/**
+ * Picks the first expiry for a new periodic timer
+ *
+ * Timers registered together with the same interval would otherwise fire
+ * on the same ticks forever. The first expiry is placed on the tick within
+ * one interval that the fewest existing timers fire on.
+ *
+ * @param interval - timer interval
+ * @return absolute tick of the first expiry
+ */
+static int timer_phase_pick(int interval) {
+    int best = timer_ticks + interval;
+    int best_load = TIMERS_MAX + 1;
+
+    for (int phase = 0; phase < interval && best_load > 0; phase++) {
+        int tick = timer_ticks + interval + phase;
+        int load = 0;
+
+        for (int i = 0; i < timer_heap_size; i++) {
+            timer_t *other = timers[timer_heap[i]];
+            int delta = tick - other->expires;
+
+            if (delta >= 0 && delta % other->interval == 0) {
+                load++;
+            }
+        }
+
+        if (load < best_load) {
+            best_load = load;
+            best = tick;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Allocates a timer entry and sets it up
  * @param func_ptr - function pointer to be called
  * @param interval - number of ticks before the callback is performed
  * @param repeat   - Indicate how many intervals to repeat (-1 should repeat forever)
+ * @param deferred - 1 to run the callback from the timer softirq
+ * @param arg      - argument passed to the callback (NULL to call it without one)
+ * @param stagger  - 1 to delay the first expiry to a less busy tick phase
  *
  * @return the allocated timer id or -1 for errors
  */
-int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
+static int timer_callback_alloc(void (*func_ptr)(), int interval, int repeat, int deferred, void *arg, int stagger) {
     int timer_id = -1;
+    timer_t *timer;
+    unsigned int flags;
 
     if (!func_ptr) {
         kernel_log_error("timer: invalid function pointer");
         return -1;
     }
 
+    if (interval <= 0) {
+        kernel_log_error("timer: invalid interval %d", interval);
+        return -1;
+    }
+
+    flags = interrupts_save_disable();
+
     // Obtain a timer id
-    if (queue_out(&timer_allocator, &timer_id) != 0) {
+    if ((timer_id = idmap_alloc(&timer_allocator)) == -1) {
+        interrupts_restore(flags);
         kernel_log_error("timer: unable to allocate a timer");
         return -1;
     }
 
+    // Entries come from the cache constructed (not in the heap)
+    if (!(timer = kmem_cache_alloc(timer_cache))) {
+        idmap_free(&timer_allocator, timer_id);
+        interrupts_restore(flags);
+        kernel_log_error("timer: out of memory for a timer");
+        return -1;
+    }
+
+    timers[timer_id] = timer;
+    timer->id = timer_id;
+
     // Set the callback function for the timer
-    timers[timer_id].callback = func_ptr;
+    timer->callback = func_ptr;
     // Set the interval value for the timer
-    timers[timer_id].interval = interval;
+    timer->interval = interval;
     // Set the repeat value for the timer
-    timers[timer_id].repeat = repeat;
+    timer->repeat = repeat;
+    // Set where the timer should be run from
+    timer->deferred = deferred;
+    timer->pending = 0;
+    // Set the callback argument; kernel timers are not owned by a process
+    timer->arg = arg;
+    timer->owner = -1;
+    timer->owner_sem = -1;
+    // Periodic timers are phased from their first expiry
+    timer->expires = stagger ? timer_phase_pick(interval) : timer_ticks + interval;
+    // Start the cost counters over
+    timer->calls = 0;
+    timer->cycles = 0;
+    timer->max_cycles = 0;
+    timer->overruns = 0;
+
+    timer_heap_push(timer_id);
+
+    interrupts_restore(flags);
 
     return timer_id;
 }
 
+/**
+ * Registers a new callback to be called at the specified interval
+ * @param func_ptr - function pointer to be called
+ * @param interval - number of ticks before the callback is performed
+ * @param repeat   - Indicate how many intervals to repeat (-1 should repeat forever)
+ *
+ * @return the allocated timer id or -1 for errors
+ */
+int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
+    return timer_callback_alloc(func_ptr, interval, repeat, 0, NULL, repeat != 1);
+}
+
+/**
+ * Registers a new callback that is deferred out of the timer IRQ
+ * @param func_ptr - function pointer to be called
+ * @param interval - number of ticks before the callback is performed
+ * @param repeat   - Indicate how many intervals to repeat (-1 should repeat forever)
+ *
+ * @return the allocated timer id or -1 for errors
+ */
+int timer_callback_register_deferred(void (*func_ptr)(), int interval, int repeat) {
+    return timer_callback_alloc(func_ptr, interval, repeat, 1, NULL, repeat != 1);
+}
+
 /**
  * Unregisters the specified callback
  * @param id
@@ -75,21 +299,37 @@ int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
  */
 int timer_callback_unregister(int id) {
     timer_t *timer;
+    unsigned int flags;
+    int rc = 0;
 
     if (id < 0 || id >= TIMERS_MAX) {
         kernel_log_error("timer: callback id out of range: %d", id);
         return -1;
     }
 
-    timer = &timers[id];
-    memset(timer, 0, sizeof(timer_t));
+    flags = interrupts_save_disable();
+
+    timer = timers[id];
 
-    if (queue_in(&timer_allocator, id) != 0) {
-        kernel_log_error("timer: unable to queue timer entry back to allocator");
+    if (timer == NULL) {
+        interrupts_restore(flags);
+        kernel_log_error("timer: callback %d is not registered", id);
         return -1;
     }
 
-    return 0;
+    // Out of the heap, the entry goes back to the cache as constructed
+    timer_heap_remove(id);
+    timers[id] = NULL;
+    kmem_cache_free(timer_cache, timer);
+
+    if (idmap_free(&timer_allocator, id) != 0) {
+        kernel_log_error("timer: timer %d was not allocated", id);
+        rc = -1;
+    }
+
+    interrupts_restore(flags);
+
+    return rc;
 }
 
 /**
@@ -101,37 +341,300 @@ int timer_get_ticks() {
     return timer_ticks;
 }
 
+/**
+ * Runs a timer callback, accounts for its cost and handles repeats
+ * @param id - timer id
+ */
+static void timer_callback_run(int id) {
+    timer_t *timer = timers[id];
+    void (*callback)() = timer->callback;
+    unsigned long long start;
+    unsigned int cycles;
+    unsigned int flags;
+
+    start = kernel_rdtsc();
+    if (timer->arg) {
+        ((void (*)(void *))callback)(timer->arg);
+    } else {
+        callback();
+    }
+    cycles = (unsigned int)(kernel_rdtsc() - start);
+
+    // The timer IRQ may preempt deferred callbacks, so keep it out
+    // while the timer entry and the allocator are updated
+    flags = interrupts_save_disable();
+
+    // The callback may have unregistered itself
+    if (timers[id] != timer || timer->callback != callback) {
+        interrupts_restore(flags);
+        return;
+    }
+
+    timer->calls++;
+    timer->cycles += cycles;
+    if (cycles > timer->max_cycles) {
+        timer->max_cycles = cycles;
+    }
+
+    // Warn about callbacks over budget; only on the 1st, 2nd, 4th, 8th, ...
+    // overrun so a consistently slow callback doesn't flood the console
+    if (timer_budget_cycles && cycles > timer_budget_cycles) {
+        timer->overruns++;
+        if ((timer->overruns & (timer->overruns - 1)) == 0) {
+            kernel_log_warn("timer: callback %d (0x%08x) took %u cycles, budget is %u (%u overruns)",
+                            id, (unsigned int)callback, cycles, timer_budget_cycles, timer->overruns);
+        }
+    }
+
+    // If the timer repeat is greater than 0, decrement
+    if (timer->repeat > 0) {
+        timer->repeat--;
+    }
+
+    // If the timer repeat is equal to 0, unregister the timer
+    // If the timer repeat is less than 0, do nothing
+    if (timer->repeat == 0) {
+        timer_callback_unregister(id);
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Timer softirq handler
+ *
+ * Runs each deferred callback once for every interval that was hit
+ * since the softirq last ran
+ */
+void timer_softirq(void) {
+    unsigned long long start = kernel_rdtsc();
+    unsigned int cycles;
+    unsigned int flags;
+    int id;
+
+    while (1) {
+        flags = interrupts_save_disable();
+        if (timer_id_queue_out(&timer_pending, &id) != 0) {
+            interrupts_restore(flags);
+            break;
+        }
+        timer_queued[id] = 0;
+        interrupts_restore(flags);
+
+        while (timers[id] != NULL && timers[id]->pending > 0) {
+            flags = interrupts_save_disable();
+            timers[id]->pending--;
+            interrupts_restore(flags);
+
+            timer_callback_run(id);
+        }
+    }
+
+    cycles = (unsigned int)(kernel_rdtsc() - start);
+    if (cycles > timer_softirq_max_cycles) {
+        timer_softirq_max_cycles = cycles;
+    }
+}
+
 /**
  * Timer IRQ Handler
  *
  * Should perform the following:
  *   - Increment the timer ticks every time the timer occurs
- *   - Handle each registered timer
- *     - If the interval is hit, run the callback function
+ *   - Handle each timer that is due (only the front of the timer heap
+ *     is looked at, so idle timers cost nothing per tick)
+ *     - Re-arm it one interval after its previous expiry
+ *     - Run the callback function (or mark it pending if deferred)
  *     - Handle timer repeats
  */
 void timer_irq_handler(void) {
+    unsigned long long start;
+    unsigned int cycles;
+    int deferred = 0;
+    timer_t *timer;
+    int id;
+
+    // Every CPU accounts for its own running process
+    scheduler_tick();
+
+    // The system tick and timer callbacks are driven by the bootstrap CPU
+    if (smp_cpu_id() != 0) {
+        return;
+    }
+
+    start = kernel_rdtsc();
+
     // Increment the timer_ticks value
     timer_ticks++;
-    for(int i = 0; i < (int)sizeof(timers)/(int)sizeof(timer_t); i++){
-    // Iterate through the timers table
-        if(timers[i].callback != NULL){
-        // If we have a valid callback, check if it needs to be called
-            // If the timer interval is hit, run the callback function
-            //Next line is the most hillarious bug I've ever seen!
-            //if((timers[i].interval % timer_ticks) == 0){
-            if((timer_ticks % timers[i].interval) == 0){
-            timers[i].callback();
-            // If the timer repeat is greater than 0, decrement
-            if(timers[i].repeat > 0)
-                timers[i].repeat--;
-            // If the timer repeat is equal to 0, unregister the timer
-            if(timers[i].repeat == 0)
-                timer_callback_unregister(i);
-            // If the timer repeat is less than 0, do nothing
+
+    // Handle every timer that is due
+    while (timer_heap_size > 0 && timers[timer_heap[0]]->expires <= timer_ticks) {
+        id = timer_heap[0];
+        timer = timers[id];
+
+        // Re-arm relative to the timer's own start before running it, so
+        // the callback can safely unregister or re-register timers
+        timer->expires += timer->interval;
+        timer_heap_down(0);
+
+        if (timer->deferred) {
+            // Each id is queued at most once, so the queue can't overflow
+            timer->pending++;
+            if (!timer_queued[id]) {
+                timer_queued[id] = 1;
+                timer_id_queue_in(&timer_pending, id);
             }
+            deferred = 1;
+        } else {
+            timer_callback_run(id);
         }
     }
+
+    if (deferred) {
+        softirq_raise(SOFTIRQ_TIMER);
+    }
+
+    cycles = (unsigned int)(kernel_rdtsc() - start);
+    if (cycles > timer_tick_max_cycles) {
+        timer_tick_max_cycles = cycles;
+    }
+}
+
+/**
+ * Process timer callback; posts the timer's semaphore
+ * Runs from the timer softirq since posting may wake up a process
+ *
+ * Softirqs run with interrupts enabled, but the semaphores, the run queues
+ * and the timer heap are also changed from the timer IRQ, so the timer IRQ
+ * is kept out while they are updated
+ * @param arg - pointer to the timer entry
+ */
+static void timer_proc_expire(void *arg) {
+    timer_t *timer = (timer_t *)arg;
+    int sem = timer->owner_sem;
+    unsigned int flags;
+
+    flags = interrupts_save_disable();
+
+    if (ksem_post(sem) < 0) {
+        kernel_log_error("timer: semaphore %d for process %d is gone, cancelling timer %d",
+                         sem, timer->owner, timer->id);
+        timer_callback_unregister(timer->id);
+    }
+
+    interrupts_restore(flags);
+}
+
+/**
+ * Creates a timer for a process that posts a semaphore when it expires
+ * @param pid - process id of the owner
+ * @param ms - milliseconds until the timer expires (rounded up to whole ticks),
+ *             1 to TIMER_PROC_MS_MAX
+ * @param periodic - 0 to fire once, otherwise fire every ms milliseconds
+ * @param sem - semaphore id to post
+ * @return the timer id or -1 on error
+ */
+int timer_proc_create(int pid, int ms, int periodic, int sem) {
+    int count = 0;
+    int ticks;
+    int id;
+
+    // Larger durations would overflow the tick count below
+    if (ms <= 0 || ms > TIMER_PROC_MS_MAX) {
+        kernel_log_error("timer: invalid process timer duration %d ms", ms);
+        return -1;
+    }
+
+    if (sem < 0 || sem >= SEM_MAX) {
+        kernel_log_error("timer: invalid semaphore %d", sem);
+        return -1;
+    }
+
+    for (int i = 0; i < TIMERS_MAX; i++) {
+        if (timers[i] != NULL && timers[i]->owner == pid) {
+            count++;
+        }
+    }
+
+    if (count >= TIMERS_PROC_MAX) {
+        kernel_log_error("timer: process %d already has %d timers", pid, count);
+        return -1;
+    }
+
+    ticks = (ms * TIMER_HZ + 999) / 1000;
+
+    // The callback is handed its own timer entry; the id is not known yet
+    // Process timers are never staggered: the first expiry must be on time
+    id = timer_callback_alloc(timer_proc_expire, ticks, periodic ? -1 : 1, 1, NULL, 0);
+    if (id < 0) {
+        return -1;
+    }
+
+    timers[id]->owner = pid;
+    timers[id]->owner_sem = sem;
+    timers[id]->arg = timers[id];
+
+    return id;
+}
+
+/**
+ * Cancels a process timer
+ * @param pid - process id of the owner
+ * @param id - timer id
+ * @return 0 on success, -1 on error
+ */
+int timer_proc_cancel(int pid, int id) {
+    if (id < 0 || id >= TIMERS_MAX || timers[id] == NULL || timers[id]->owner != pid) {
+        kernel_log_error("timer: process %d does not own timer %d", pid, id);
+        return -1;
+    }
+
+    return timer_callback_unregister(id);
+}
+
+/**
+ * Cancels every timer owned by a process
+ * @param pid - process id
+ */
+void timer_proc_release(int pid) {
+    for (int i = 0; i < TIMERS_MAX; i++) {
+        if (timers[i] != NULL && timers[i]->owner == pid) {
+            timer_callback_unregister(i);
+        }
+    }
+}
+
+/**
+ * Prints the per-callback cost counters to the host console
+ */
+void timer_stats_dump(void) {
+    kernel_log_info("timer: worst tick %u cycles, worst softirq %u cycles, budget %u cycles",
+                    timer_tick_max_cycles, timer_softirq_max_cycles, timer_budget_cycles);
+    kernel_log_info("timer: id  deferred  interval   expires      calls   total kcycles   max cycles  overruns  callback");
+
+    for (int i = 0; i < TIMERS_MAX; i++) {
+        timer_t *timer = timers[i];
+
+        if (timer == NULL) {
+            continue;
+        }
+
+        kernel_log_info("timer: %2d  %8d  %8d  %8d  %9u  %14u  %11u  %8u  0x%08x",
+                        i, timer->deferred, timer->interval, timer->expires, timer->calls,
+                        (unsigned int)(timer->cycles >> 10), timer->max_cycles,
+                        timer->overruns, (unsigned int)timer->callback);
+    }
+}
+
+/**
+ * Timer entry constructor; entries are freed once they are out of the heap
+ * @param obj - the timer entry
+ */
+static void timer_ctor(void *obj) {
+    timer_t *timer = obj;
+
+    timer->callback = NULL;
+    timer->heap_index = -1;
 }
 
 /**
@@ -144,10 +647,25 @@ void timer_init(void) {
     timer_ticks = 0;
     // Initialize the timers data structures
     memset(timers,0, sizeof(timers));
-    // Initialize the timer callback allocator queue
-    for(int i=0; i < TIMERS_MAX; i++)
-        queue_in(&timer_allocator, i);
-    // Populate items into the allocator queue
+    timer_heap_size = 0;
+    timer_id_queue_init(&timer_pending);
+    memset(timer_queued, 0, sizeof(timer_queued));
+    timer_tick_max_cycles = 0;
+    timer_softirq_max_cycles = 0;
+    // Callback budget in TSC cycles (clock_init has already calibrated the TSC)
+    timer_budget_cycles = clock_tsc_khz() * TIMER_BUDGET_US / 1000;
+    // Initialize the timer callback allocator
+    idmap_init(&timer_allocator, TIMERS_MAX);
+    // Timer entries are allocated from their own cache
+    timer_cache = kmem_cache_create("timer_t", sizeof(timer_t), timer_ctor);
+
+    // Deferred callbacks are run from the timer softirq
+    softirq_register(SOFTIRQ_TIMER, timer_softirq);
+
+    // With the APIC in use the ticks come from the local APIC timer
+    if (apic_enabled()) {
+        apic_timer_start(TIMER_HZ);
+    }
 
     // Register the Timer IRQ with the isr_entry_timer and timer_irq_handler
     interrupts_irq_register(IRQ_TIMER, isr_entry_timer, timer_irq_handler);
@@ -0,0 +1,219 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Kernel event recorder
+ *
+ * Events are recorded with the kernel lock held, so a single queue shared
+ * by every CPU keeps them in the order the kernel processed them. Once the
+ * queue is full further events are counted but dropped: the host replay
+ * needs an unbroken log from the start of the recording.
+ *
+ * A full recording is thousands of lines, so the kernel dumps it from a
+ * process (trace_dump_proc) that only holds the kernel lock while printing
+ * a batch of events.
+ */
+#include <spede/stdio.h>
+
+#include "interrupts.h"
+#include "kernel.h"
+#include "smp.h"
+#include "timer.h"
+#include "trace.h"
+
+// Recorded events
+trace_queue_t trace_events;
+
+// Recording is on
+int trace_recording;
+
+// Events lost because the queue was full
+unsigned int trace_dropped;
+
+// A dump is in progress; the recording must not be restarted meanwhile
+int trace_dumping;
+
+/**
+ * Initializes the recorder; starts recording if TRACE_BOOT is set
+ */
+void trace_init(void) {
+    kernel_log_info("Initializing event recorder");
+
+    trace_queue_init(&trace_events);
+    trace_recording = 0;
+    trace_dropped = 0;
+    trace_dumping = 0;
+
+    if (TRACE_BOOT) {
+        trace_start();
+    }
+}
+
+/**
+ * Discards any recorded events and starts recording
+ */
+void trace_start(void) {
+    if (trace_dumping) {
+        kernel_log_warn("trace: a dump is in progress, not restarting the recording");
+        return;
+    }
+
+    trace_queue_init(&trace_events);
+    trace_dropped = 0;
+    trace_recording = 1;
+}
+
+/**
+ * Stops recording; recorded events are kept until the next trace_start
+ */
+void trace_stop(void) {
+    trace_recording = 0;
+}
+
+/**
+ * Adds an event stamped with the current CPU, tick and TSC
+ * @return the event to fill in, NULL if it could not be recorded
+ */
+static trace_event_t *trace_record(trace_type_t type, int pid) {
+    trace_event_t *event;
+
+    if (!trace_recording) {
+        return NULL;
+    }
+
+    if (trace_queue_is_full(&trace_events)) {
+        trace_dropped++;
+        return NULL;
+    }
+
+    event = &trace_events.items[trace_events.tail & (TRACE_EVENTS_MAX - 1)];
+    event->tsc = kernel_rdtsc();
+    event->tick = timer_get_ticks();
+    event->type = type;
+    event->cpu = smp_cpu_id();
+    event->pid = pid;
+    event->irq = 0;
+    event->args[0] = 0;
+    event->args[1] = 0;
+    event->args[2] = 0;
+    event->args[3] = 0;
+    trace_events.tail++;
+
+    return event;
+}
+
+/**
+ * Records a kernel entry
+ * @param trapframe - trapframe of the interrupted code
+ * @param nested - 1 if the kernel itself was interrupted
+ */
+void trace_irq(trapframe_t *trapframe, int nested) {
+    trace_event_t *event;
+
+    event = trace_record(nested ? TRACE_IRQ_NESTED : TRACE_IRQ, active_proc ? active_proc->pid : -1);
+    if (!event) {
+        return;
+    }
+
+    event->irq = trapframe->interrupt;
+
+    if (event->irq == IRQ_SYSCALL && !nested) {
+        event->args[0] = trapframe->eax;
+        event->args[1] = trapframe->ebx;
+        event->args[2] = trapframe->ecx;
+        event->args[3] = trapframe->edx;
+    }
+}
+
+/**
+ * Records a process, CPU or other non-interrupt event
+ * @param type - event type
+ * @param pid - process the event applies to
+ * @param arg - event specific argument
+ */
+void trace_event(trace_type_t type, int pid, int arg) {
+    trace_event_t *event = trace_record(type, pid);
+
+    // The depth tells the replay whether this happened inside a kernel entry
+    if (event) {
+        event->irq = kernel_irq_depth;
+        event->args[0] = arg;
+    }
+}
+
+/**
+ * Prints a single event line
+ * @param event - recorded event
+ */
+static void trace_print(trace_event_t *event) {
+    printf("trace %d %d %d %08x%08x %d %d %d %d %d %d\n",
+           event->type, event->cpu, event->tick,
+           (unsigned int)(event->tsc >> 32), (unsigned int)event->tsc,
+           event->pid, event->irq,
+           event->args[0], event->args[1], event->args[2], event->args[3]);
+}
+
+/**
+ * Prints the recorded events to the host console in the format read by
+ * the host simulator's replay mode:
+ *
+ *   trace-begin EVENTS DROPPED
+ *   trace TYPE CPU TICK TSC PID IRQ ARG0 ARG1 ARG2 ARG3
+ *   ...
+ *   trace-end
+ *
+ * TSC is printed as 16 hex digits; everything else is decimal.
+ * Prints the whole recording at once; use trace_dump_proc in the kernel
+ */
+void trace_dump(void) {
+    unsigned int count = trace_queue_size(&trace_events);
+
+    printf("trace-begin %u %u\n", count, trace_dropped);
+
+    for (unsigned int i = trace_events.head; i != trace_events.tail; i++) {
+        trace_print(&trace_events.items[i & (TRACE_EVENTS_MAX - 1)]);
+    }
+
+    printf("trace-end\n");
+}
+
+/**
+ * Kernel process that stops recording and prints the recorded events in
+ * the same format as trace_dump, TRACE_DUMP_BATCH events at a time
+ *
+ * The kernel lock is dropped between batches so IRQs and other CPUs keep
+ * running during a long dump. Recording stays stopped until the next
+ * trace_start, so the events can't change underneath the dump.
+ */
+void trace_dump_proc(void) {
+    unsigned int i;
+    unsigned int end;
+
+    smp_kernel_lock();
+
+    if (trace_dumping) {
+        smp_kernel_unlock();
+        return;
+    }
+
+    trace_stop();
+    trace_dumping = 1;
+    i = trace_events.head;
+    end = trace_events.tail;
+    printf("trace-begin %u %u\n", end - i, trace_dropped);
+
+    smp_kernel_unlock();
+
+    while (i != end) {
+        smp_kernel_lock();
+        for (int n = 0; n < TRACE_DUMP_BATCH && i != end; n++, i++) {
+            trace_print(&trace_events.items[i & (TRACE_EVENTS_MAX - 1)]);
+        }
+        smp_kernel_unlock();
+    }
+
+    smp_kernel_lock();
+    printf("trace-end\n");
+    trace_dumping = 0;
+    smp_kernel_unlock();
+}
@@ -1,4 +1,5 @@
 #include <spede/string.h>
+#include "interrupts.h"
 #include "kernel.h"
 #include "timer.h"
 #include "tty.h"
@@ -32,15 +33,17 @@ void tty_init(void) {
         tty_table[i].pos_scroll = 0;
         //I think this should be all the intialization needed for phase 4 tty. I ak a bit iffy on my use of pointer directions here, but I think it should be ok. I should probably still ask Dylan though! -Hannah
         tty_table[i].echo=0;
-        ringbuf_init(&(tty_table[i].io_output));
-        ringbuf_init(&(tty_table[i].io_input));
+        if (ringbuf_init(&(tty_table[i].io_output), TTY_IO_OUTPUT_SIZE) != 0
+            || ringbuf_init(&(tty_table[i].io_input), TTY_IO_INPUT_SIZE) != 0) {
+            kernel_panic("tty: unable to allocate I/O buffers for tty %d", i);
+        }
     }
 
     // Select tty 0 to start with
     active_tty = &tty_table[0];
 
     // Register a timer callback to update the screen on a regular interval
-    timer_callback_register(tty_refresh, 50, -1); // Update every 100 ms?
+    timer_callback_register_deferred(tty_refresh, 50, -1); // Update every 100 ms?
 }
 
 /**
@@ -127,27 +130,104 @@ void tty_refresh(void) {
         kernel_panic("No TTY is selected!");
         return;
     }
+    // The keyboard IRQ may echo into io_output while we drain it from the
+    // timer softirq. Every other producer (processes writing to the TTY)
+    // needs the kernel lock, which this CPU holds, so the echo is the only
+    // producer that can overlap with us and the ring buffer needs no lock.
+    // Output is rendered straight out of the ring without an extra copy.
     while(!ringbuf_is_empty(&(active_tty->io_output))){
-        char c;
-        int success = ringbuf_read(&(active_tty->io_output), &c);
-        if (success==-1){
+        char *data;
+        int count = ringbuf_peek_contiguous(&(active_tty->io_output), &data);
+        if (count <= 0){
             kernel_log_error("tty io_output buffer read failed.");
+            break;
         }
-        tty_update(c);
+        for (int i = 0; i < count; i++) {
+            tty_update(data[i]);
+        }
+        ringbuf_consume(&(active_tty->io_output), count);
     }
 
     if (active_tty->refresh) {
+        // Clear the flag first so a tty_select() during the repaint isn't lost
+        active_tty->refresh = 0;
         for (int y = 0; y < VGA_HEIGHT; ++y) {
             for (int x = 0; x < VGA_WIDTH; ++x) {
                 char c = active_tty->buf[x + y * VGA_WIDTH];
                 vga_putc_at(x, y, active_tty->color_bg, active_tty->color_fg, c);
             }
         }
-        active_tty->refresh = 0;
     }
     //kernel_log_trace("tty refresh called");
 }
 
+/**
+ * Replaces the process I/O buffers of a TTY with ones of the given sizes
+ * Anything still buffered is discarded
+ * @param tty - TTY number
+ * @param input_size - input buffer capacity in bytes
+ * @param output_size - output buffer capacity in bytes
+ * @return -1 on error, 0 on success
+ */
+int tty_io_resize(int tty, int input_size, int output_size) {
+    struct tty_t *t = tty_get(tty);
+    ringbuf_t input;
+    ringbuf_t output;
+    ringbuf_t old;
+    unsigned int flags;
+
+    if (!t || input_size <= 0 || output_size <= 0) {
+        kernel_log_error("tty: invalid I/O buffer sizes %d/%d for tty %d", input_size, output_size, tty);
+        return -1;
+    }
+
+    // Allocate both new buffers first so the TTY keeps its old ones on failure
+    if (ringbuf_init(&input, input_size) != 0) {
+        kernel_log_error("tty: unable to allocate a %d byte input buffer for tty %d", input_size, tty);
+        return -1;
+    }
+
+    if (ringbuf_init(&output, output_size) != 0) {
+        ringbuf_destroy(&input);
+        kernel_log_error("tty: unable to allocate a %d byte output buffer for tty %d", output_size, tty);
+        return -1;
+    }
+
+    // Keep the keyboard IRQ out of the buffers while they are swapped;
+    // attached processes point at the ringbuf_t itself, which stays put
+    flags = interrupts_save_disable();
+
+    old = t->io_input;
+    t->io_input = input;
+    input = old;
+
+    old = t->io_output;
+    t->io_output = output;
+    output = old;
+
+    interrupts_restore(flags);
+
+    ringbuf_destroy(&input);
+    ringbuf_destroy(&output);
+
+    return 0;
+}
+
+/**
+ * Returns the TTY number whose process I/O buffers include the given one
+ * @param io - pointer to a process I/O buffer
+ * @return TTY number, -1 if the buffer doesn't belong to a TTY
+ */
+int tty_find_io(ringbuf_t *io) {
+    for (int i = 0; i < TTY_MAX; i++) {
+        if (io && (io == &tty_table[i].io_input || io == &tty_table[i].io_output)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
 tty_t * tty_get(int tty){ //f
 /**
  * Returns the tty structure for the given tty number
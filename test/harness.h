@@ -0,0 +1,100 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Host-side unit test and microbenchmark harness
+ */
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <stdio.h>
+#include <time.h>
+
+// Number of failed checks in the whole run
+extern int harness_failures;
+
+// Number of checks performed in the whole run
+extern int harness_checks;
+
+/**
+ * Checks a condition, reporting the location and expression if it fails
+ * The test keeps running so one run reports every failure
+ */
+#define CHECK(cond) do { \
+    harness_checks++; \
+    if (!(cond)) { \
+        harness_failures++; \
+        printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+/**
+ * Checks that two integer expressions are equal
+ */
+#define CHECK_EQ(a, b) do { \
+    long long __a = (long long)(a); \
+    long long __b = (long long)(b); \
+    harness_checks++; \
+    if (__a != __b) { \
+        harness_failures++; \
+        printf("  FAIL %s:%d: %s == %s (%lld != %lld)\n", \
+               __FILE__, __LINE__, #a, #b, __a, __b); \
+    } \
+} while (0)
+
+/**
+ * Times a statement over a number of operations and reports ns/op
+ * @param name - benchmark name
+ * @param ops - number of operations the statement is run for
+ * @param stmt - statement run once per operation (may use `i`)
+ */
+#define BENCH(name, ops, stmt) do { \
+    struct timespec __start, __end; \
+    long long __ops = (ops); \
+    clock_gettime(CLOCK_MONOTONIC, &__start); \
+    for (long long i = 0; i < __ops; i++) { \
+        stmt; \
+    } \
+    clock_gettime(CLOCK_MONOTONIC, &__end); \
+    harness_bench_report((name), __ops, &__start, &__end); \
+} while (0)
+
+/**
+ * Prints a benchmark result
+ * @param name - benchmark name
+ * @param ops - number of operations timed
+ * @param start - time before the first operation
+ * @param end - time after the last operation
+ */
+void harness_bench_report(const char *name, long long ops,
+                          struct timespec *start, struct timespec *end);
+
+/**
+ * Keeps the compiler from optimizing away a benchmarked result
+ */
+extern volatile unsigned long long harness_sink;
+
+/**
+ * Test suites; each one returns after running all of its checks
+ */
+void test_queue(void);
+void test_ringbuf(void);
+void test_bit(void);
+void test_idmap(void);
+void test_page(void);
+void test_kmem(void);
+void test_kshm(void);
+void test_arena(void);
+void test_sync(void);
+
+/**
+ * Benchmark suites
+ */
+void bench_queue(void);
+void bench_ringbuf(void);
+void bench_bit(void);
+void bench_page(void);
+void bench_kmem(void);
+void bench_arena(void);
+
+#endif
@@ -0,0 +1,7 @@
+/**
+ * Host stub: declaration helpers used by the kernel headers
+ */
+#ifndef SPEDE_MACHINE_ASMACROS_H
+#define SPEDE_MACHINE_ASMACROS_H
+#include <sys/cdefs.h>
+#endif
@@ -0,0 +1,9 @@
+/**
+ * Host stub: I/O port access (ports read as 0, writes are ignored)
+ */
+#ifndef SPEDE_MACHINE_IO_H
+#define SPEDE_MACHINE_IO_H
+
+static inline unsigned char inportb(unsigned short port) { (void)port; return 0; }
+static inline void outportb(unsigned short port, unsigned char value) { (void)port; (void)value; }
+#endif
@@ -0,0 +1,15 @@
+/**
+ * Host stub: EFLAGS values and segment register accessors
+ */
+#ifndef SPEDE_MACHINE_PROC_REG_H
+#define SPEDE_MACHINE_PROC_REG_H
+
+#define EF_DEFAULT_VALUE 0x2
+#define EF_INTR 0x200
+
+unsigned short get_cs(void);
+unsigned short get_ds(void);
+unsigned short get_es(void);
+unsigned short get_fs(void);
+unsigned short get_gs(void);
+#endif
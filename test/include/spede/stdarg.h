@@ -0,0 +1,7 @@
+/**
+ * Host stub: maps the SPEDE header to the host C library
+ */
+#ifndef SPEDE_STDARG_H
+#define SPEDE_STDARG_H
+#include <stdarg.h>
+#endif
@@ -0,0 +1,7 @@
+/**
+ * Host stub: maps the SPEDE header to the host C library
+ */
+#ifndef SPEDE_STDBOOL_H
+#define SPEDE_STDBOOL_H
+#include <stdbool.h>
+#endif
@@ -0,0 +1,7 @@
+/**
+ * Host stub: maps the SPEDE header to the host C library
+ */
+#ifndef SPEDE_STDDEF_H
+#define SPEDE_STDDEF_H
+#include <stddef.h>
+#endif
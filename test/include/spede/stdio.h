@@ -0,0 +1,7 @@
+/**
+ * Host stub: maps the SPEDE header to the host C library
+ */
+#ifndef SPEDE_STDIO_H
+#define SPEDE_STDIO_H
+#include <stdio.h>
+#endif
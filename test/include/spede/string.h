@@ -0,0 +1,7 @@
+/**
+ * Host stub: maps the SPEDE header to the host C library
+ */
+#ifndef SPEDE_STRING_H
+#define SPEDE_STRING_H
+#include <string.h>
+#endif
@@ -0,0 +1,7 @@
+/**
+ * Host stub: maps the SPEDE header to the host C library
+ */
+#ifndef SPEDE_TIME_H
+#define SPEDE_TIME_H
+#include <time.h>
+#endif
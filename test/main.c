@@ -0,0 +1,77 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Host-side unit test and microbenchmark runner
+ *
+ * Usage: host_test [test|bench]   (both by default)
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "harness.h"
+
+int harness_failures;
+int harness_checks;
+volatile unsigned long long harness_sink;
+
+/**
+ * Prints a benchmark result
+ * @param name - benchmark name
+ * @param ops - number of operations timed
+ * @param start - time before the first operation
+ * @param end - time after the last operation
+ */
+void harness_bench_report(const char *name, long long ops,
+                          struct timespec *start, struct timespec *end) {
+    double ns = (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+
+    printf("  %-36s %10.2f ns/op\n", name, ns / ops);
+}
+
+/**
+ * Runs a suite and reports how many of its checks failed
+ */
+static void run(const char *name, void (*suite)(void)) {
+    int failures = harness_failures;
+    int checks = harness_checks;
+
+    printf("%s\n", name);
+    suite();
+    printf("  %d/%d checks passed\n",
+           (harness_checks - checks) - (harness_failures - failures),
+           harness_checks - checks);
+}
+
+int main(int argc, char **argv) {
+    int tests = argc < 2 || strcmp(argv[1], "test") == 0;
+    int benches = argc < 2 || strcmp(argv[1], "bench") == 0;
+
+    if (tests) {
+        run("queue", test_queue);
+        run("ringbuf", test_ringbuf);
+        run("bit/bitmap", test_bit);
+        run("idmap", test_idmap);
+        run("page", test_page);
+        run("kmem", test_kmem);
+        run("kshm", test_kshm);
+        run("arena", test_arena);
+        run("kmutex/ksem/scheduler", test_sync);
+    }
+
+    if (benches) {
+        printf("benchmarks\n");
+        bench_queue();
+        bench_ringbuf();
+        bench_bit();
+        bench_page();
+        bench_kmem();
+        bench_arena();
+    }
+
+    if (tests) {
+        printf("%d checks, %d failures\n", harness_checks, harness_failures);
+    }
+
+    return harness_failures ? 1 : 0;
+}
@@ -0,0 +1,388 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Replays a kernel event recording (see include/trace.h) in the simulator
+ *
+ * Every recorded kernel entry is fed to the real scheduler, process,
+ * semaphore, mutex and timer code in the order the kernel handled it.
+ * Events recorded while handling an entry (nested IRQs, and process
+ * creation or CPU bring-up with a non-zero IRQ depth) are applied before
+ * the scheduler runs, as they were in the kernel. Before each entry the
+ * simulated CPU must be running the process the kernel interrupted and be
+ * on the same tick; any difference means the scheduling decisions have
+ * diverged from the recording.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "interrupts.h"
+#include "kernel.h"
+#include "kmutex.h"
+#include "kproc.h"
+#include "ksem.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "softirq.h"
+#include "syscall_common.h"
+#include "timer.h"
+#include "trace.h"
+
+#include "sim.h"
+
+// Process table state owned by kproc.c
+extern int next_pid;
+extern proc_t *proc_table[PROC_MAX];
+
+// Timer IRQ handler from timer.c (normally only reachable through the IDT)
+void timer_irq_handler(void);
+
+// Number of divergences printed in full
+#define REPLAY_REPORT_MAX 10
+
+static trace_event_t *replay_events;
+static int replay_count;
+static unsigned int replay_dropped;
+
+// Statistics
+static int replay_divergences;
+static unsigned int replay_types[TRACE_TYPE_MAX];
+static unsigned int replay_irqs[IRQ_VECTOR_MAX];
+static unsigned int replay_syscalls;
+
+/**
+ * Reads the events between trace-begin and trace-end; other lines (the
+ * rest of the host console output) are ignored
+ * @return 0 on success, -1 on error
+ */
+static int replay_load(const char *path) {
+    char line[256];
+    int capacity = 0;
+    int started = 0;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        char *text;
+        trace_event_t event;
+        int type;
+        int cpu;
+
+        if ((text = strstr(line, "trace-begin "))) {
+            sscanf(text, "trace-begin %*u %u", &replay_dropped);
+            replay_count = 0;
+            started = 1;
+            continue;
+        }
+
+        if (strstr(line, "trace-end")) {
+            started = 0;
+            continue;
+        }
+
+        if (!started || !(text = strstr(line, "trace "))) {
+            continue;
+        }
+
+        if (sscanf(text, "trace %d %d %d %llx %d %d %d %d %d %d", &type, &cpu, &event.tick,
+                   &event.tsc, &event.pid, &event.irq, &event.args[0], &event.args[1],
+                   &event.args[2], &event.args[3]) != 10 ||
+            type < 0 || type >= TRACE_TYPE_MAX || cpu < 0 || cpu >= CPU_MAX) {
+            fprintf(stderr, "%s: invalid event: %s", path, text);
+            fclose(file);
+            return -1;
+        }
+
+        event.type = type;
+        event.cpu = cpu;
+
+        if (replay_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            replay_events = realloc(replay_events, sizeof(trace_event_t) * capacity);
+            if (!replay_events) {
+                perror("realloc");
+                fclose(file);
+                return -1;
+            }
+        }
+
+        replay_events[replay_count++] = event;
+    }
+
+    fclose(file);
+
+    if (replay_count == 0) {
+        fprintf(stderr, "%s: no trace events found\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Finds a live process without the error pid_to_proc logs when it's missing
+ */
+static proc_t *replay_proc(int pid) {
+    for (int i = 0; i < PROC_MAX; i++) {
+        if (proc_table[i] && proc_table[i]->state != NONE && proc_table[i]->pid == pid) {
+            return proc_table[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Indicates if an event was recorded inside the kernel entry before it
+ */
+static int replay_is_inner(trace_event_t *event) {
+    return event->type == TRACE_IRQ_NESTED || (event->type != TRACE_IRQ && event->irq > 0);
+}
+
+/**
+ * Performs the scheduling-relevant system calls as ksyscall.c does;
+ * calls that only move data (I/O, names, times) don't affect scheduling
+ */
+static void replay_syscall(trace_event_t *event) {
+    proc_t *proc = active_proc;
+    int *args = event->args;
+
+    replay_syscalls++;
+
+    switch (args[0]) {
+        case SYSCALL_PROC_SLEEP:
+            if (proc) {
+                scheduler_sleep(proc, args[1]);
+            }
+            break;
+        case SYSCALL_PROC_EXIT:
+            if (proc) {
+                kproc_destroy(proc);
+            }
+            break;
+        case SYSCALL_MUTEX_INIT:
+            kmutex_init();
+            break;
+        case SYSCALL_MUTEX_DESTROY:
+            kmutex_destroy(args[1]);
+            break;
+        case SYSCALL_MUTEX_LOCK:
+            kmutex_lock(args[1]);
+            break;
+        case SYSCALL_MUTEX_UNLOCK:
+            kmutex_unlock(args[1]);
+            break;
+        case SYSCALL_SEM_INIT:
+            ksem_init(args[1]);
+            break;
+        case SYSCALL_SEM_DESTROY:
+            ksem_destroy(args[1]);
+            break;
+        case SYSCALL_SEM_WAIT:
+            ksem_wait(args[1]);
+            break;
+        case SYSCALL_SEM_POST:
+            ksem_post(args[1]);
+            break;
+        case SYSCALL_TIMER_CREATE:
+            if (proc) {
+                timer_proc_create(proc->pid, args[1], args[2], args[3]);
+            }
+            break;
+        case SYSCALL_TIMER_CANCEL:
+            if (proc) {
+                timer_proc_cancel(proc->pid, args[1]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Applies an event recorded outside of an interrupt handler or while one
+ * was being handled
+ */
+static void replay_inner(trace_event_t *event) {
+    proc_t *proc;
+
+    sim_cpu = event->cpu;
+
+    switch (event->type) {
+        case TRACE_IRQ_NESTED:
+            if (event->irq == IRQ_TIMER) {
+                timer_irq_handler();
+            }
+            break;
+
+        case TRACE_PROC_CREATE:
+            // Creations already made by the replayed kernel code are skipped
+            if (!replay_proc(event->pid)) {
+                next_pid = event->pid;
+                kproc_create(kproc_test, "replay", event->args[0]);
+                next_pid = event->pid + 1;
+            }
+            break;
+
+        case TRACE_PROC_DESTROY:
+            if ((proc = replay_proc(event->pid))) {
+                kproc_destroy(proc);
+            }
+            break;
+
+        case TRACE_CPU_START:
+            // Brought up as smp_start_aps/smp_ap_main do
+            if ((proc = replay_proc(event->pid)) && event->args[0] < CPU_MAX) {
+                cpu_t *cpu = &cpus[event->args[0]];
+
+                scheduler_remove(proc);
+                cpu->idle_proc = proc;
+                cpu->current = proc;
+                cpu->online = 1;
+                proc->state = ACTIVE;
+                smp_cpus_online = event->args[0] + 1;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Compares the simulated CPU with the recording at a kernel entry
+ */
+static void replay_check(int index, trace_event_t *event) {
+    proc_t *current = cpus[event->cpu].current;
+    int pid = current ? current->pid : -1;
+    int tick = timer_get_ticks();
+
+    if (pid == event->pid && tick == event->tick) {
+        return;
+    }
+
+    if (replay_divergences++ < REPLAY_REPORT_MAX) {
+        printf("divergence    event %d (cpu %d, irq 0x%02x): recorded pid %d tick %d, "
+               "replayed pid %d tick %d\n",
+               index, event->cpu, event->irq, event->pid, event->tick, pid, tick);
+    }
+}
+
+/**
+ * Prints the recording summary and the largest gaps between kernel entries
+ * on each CPU, where latency spikes show up
+ */
+static void replay_report(const char *path) {
+    unsigned long long last[CPU_MAX] = { 0 };
+    unsigned long long gap[CPU_MAX] = { 0 };
+    int gap_event[CPU_MAX];
+    trace_event_t *first = &replay_events[0];
+    trace_event_t *end = &replay_events[replay_count - 1];
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        gap_event[i] = -1;
+    }
+
+    for (int i = 0; i < replay_count; i++) {
+        trace_event_t *event = &replay_events[i];
+
+        if (event->type != TRACE_IRQ) {
+            continue;
+        }
+
+        if (last[event->cpu] && event->tsc - last[event->cpu] > gap[event->cpu]) {
+            gap[event->cpu] = event->tsc - last[event->cpu];
+            gap_event[event->cpu] = i;
+        }
+        last[event->cpu] = event->tsc;
+    }
+
+    printf("recording     %s\n", path);
+    printf("events        %d (%u dropped), ticks %d-%d, %d CPUs\n",
+           replay_count, replay_dropped, first->tick, end->tick, smp_cpus_online);
+    printf("entries       %u IRQ, %u nested, %u syscalls; %u created, %u destroyed\n",
+           replay_types[TRACE_IRQ], replay_types[TRACE_IRQ_NESTED], replay_syscalls,
+           replay_types[TRACE_PROC_CREATE], replay_types[TRACE_PROC_DESTROY]);
+
+    for (int irq = 0; irq < IRQ_VECTOR_MAX; irq++) {
+        if (replay_irqs[irq]) {
+            printf("irq 0x%02x      %u\n", irq, replay_irqs[irq]);
+        }
+    }
+
+    for (int i = 0; i < CPU_MAX; i++) {
+        if (gap_event[i] >= 0) {
+            trace_event_t *event = &replay_events[gap_event[i]];
+
+            printf("cpu %d         longest gap %llu cycles before event %d (tick %d, irq 0x%02x, pid %d)\n",
+                   i, gap[i], gap_event[i], event->tick, event->irq, event->pid);
+        }
+    }
+
+    if (replay_divergences) {
+        printf("replay        %d of %u kernel entries diverged from the recording\n",
+               replay_divergences, replay_types[TRACE_IRQ]);
+    } else {
+        printf("replay        all %u kernel entries matched the recording\n",
+               replay_types[TRACE_IRQ]);
+    }
+    printf("kernel errors %d\n", sim_log_errors);
+}
+
+/**
+ * Replays a recording dumped by trace_dump
+ * @param path - file holding the host console output
+ * @return 0 if the replay matched the recording, 1 if it diverged, -1 on error
+ */
+int sim_replay(const char *path) {
+    if (replay_load(path) != 0) {
+        return -1;
+    }
+
+    sim_kernel_init();
+
+    for (int i = 0; i < replay_count; i++) {
+        trace_event_t *event = &replay_events[i];
+
+        replay_types[event->type]++;
+
+        if (event->type != TRACE_IRQ) {
+            // Recorded outside of any kernel entry (boot, simulator setup)
+            replay_inner(event);
+            continue;
+        }
+
+        if (event->irq >= 0 && event->irq < IRQ_VECTOR_MAX) {
+            replay_irqs[event->irq]++;
+        }
+
+        sim_cpu = event->cpu;
+        replay_check(i, event);
+
+        if (event->irq == IRQ_TIMER) {
+            timer_irq_handler();
+        } else if (event->irq == IRQ_SYSCALL) {
+            replay_syscall(event);
+        }
+
+        // Apply what happened inside this entry before the scheduler runs
+        while (i + 1 < replay_count && replay_is_inner(&replay_events[i + 1])) {
+            replay_types[replay_events[++i].type]++;
+            replay_inner(&replay_events[i]);
+        }
+
+        sim_cpu = event->cpu;
+        softirq_run();
+        scheduler_run();
+    }
+
+    replay_report(path);
+    free(replay_events);
+
+    return replay_divergences ? 1 : 0;
+}
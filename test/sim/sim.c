@@ -0,0 +1,697 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Scheduler and synchronization simulator
+ *
+ * Runs the real scheduler.c, kproc.c, ksem.c, kmutex.c and timer.c as a
+ * Linux program. Simulated processes execute small scripted programs
+ * (compute for some ticks, sleep, wait/post semaphores, lock/unlock
+ * mutexes) and every tick goes through the same steps as the kernel:
+ * timer IRQ on each CPU, the timer softirq, then the scheduler. Runs are
+ * fully deterministic, so scheduling changes can be compared exactly.
+ *
+ * Workload file format (one directive per line, '#' starts a comment):
+ *   ticks N                 number of ticks to simulate
+ *   cpus N                  number of CPUs (default 1)
+ *   sem NAME VALUE          create a semaphore
+ *   mutex NAME              create a mutex
+ *   proc COUNT NAME OP...   create COUNT processes running the ops in a loop
+ *
+ * Ops: run:TICKS  sleep:SECONDS  wait:SEM  post:SEM  lock:MUTEX
+ *      unlock:MUTEX  exit
+ *
+ * The run can be recorded in the kernel's event recorder format (-d dumps
+ * it after the report) and any recording, from the kernel or from here,
+ * replayed with -r (see replay.c).
+ *
+ * Usage: sim WORKLOAD [-t TICKS] [-c CPUS] [-d]
+ *        sim -r RECORDING
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "idmap.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "kmem.h"
+#include "kmutex.h"
+#include "kproc.h"
+#include "ksem.h"
+#include "kshm.h"
+#include "page.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "softirq.h"
+#include "syscall_common.h"
+#include "timer.h"
+#include "trace.h"
+
+#include "sim.h"
+
+// Process table state owned by kproc.c (set up here instead of kproc_init)
+extern int next_pid;
+extern idmap_t proc_allocator;
+extern proc_t *proc_table[PROC_MAX];
+extern kmem_cache_t *proc_cache;
+void kproc_ctor(void *obj);
+
+// Memory handed to the page allocator: room for every process stack and
+// address space
+#define SIM_MEMORY (PROC_MAX * (PROC_STACK_SIZE + PAGE_SIZE) + 4 * PAGE_BLOCK_MAX)
+static char *sim_memory;
+
+// Timer IRQ handler from timer.c (normally only reachable through the IDT)
+void timer_irq_handler(void);
+
+// Process program operations
+typedef enum sim_op_type_t {
+    SIM_OP_RUN,
+    SIM_OP_SLEEP,
+    SIM_OP_WAIT,
+    SIM_OP_POST,
+    SIM_OP_LOCK,
+    SIM_OP_UNLOCK,
+    SIM_OP_EXIT
+} sim_op_type_t;
+
+typedef struct sim_op_t {
+    sim_op_type_t type;
+    int arg;                    // Ticks, seconds or kernel object id
+} sim_op_t;
+
+// A group of processes running the same program
+typedef struct sim_group_t {
+    char name[32];
+    int count;
+    int ops;
+    sim_op_t op[SIM_OPS_MAX];
+} sim_group_t;
+
+// Simulation state of each process, indexed by pid
+typedef struct sim_proc_t {
+    sim_group_t *group;         // Program, NULL for kernel processes
+    int pc;                     // Next op
+    int remaining;              // Ticks left in the current run op
+    int exited;                 // Process ran an exit op
+    state_t last_state;         // State at the previous scan
+    int ready_at;               // Tick the process became runnable, -1 if not waiting
+    unsigned int work;          // Ticks of run ops completed
+    unsigned int loops;         // Times the whole program was completed
+} sim_proc_t;
+
+// Named kernel objects
+typedef struct sim_object_t {
+    char name[32];
+    int mutex;                  // 1 for a mutex, 0 for a semaphore
+    int id;                     // Kernel id
+} sim_object_t;
+
+// Wake latencies are counted per tick up to this many ticks
+#define SIM_LATENCY_MAX 10000
+
+int sim_log_errors;
+
+static sim_group_t sim_groups[SIM_PID_MAX];
+static int sim_group_count;
+static sim_object_t sim_objects[SIM_OBJECTS_MAX];
+static int sim_object_count;
+static sim_proc_t sim_procs[SIM_PID_MAX];
+
+static int sim_ticks = 1000;
+static int sim_cpus = 1;
+static int sim_tick;
+
+// Statistics
+static unsigned int sim_latency[SIM_LATENCY_MAX + 1];
+static unsigned int sim_wakeups;
+static unsigned int sim_switches;
+static unsigned int sim_idle_ticks;
+static proc_t *sim_last_current[CPU_MAX];
+
+/**
+ * Records a kernel entry on the current CPU as kernel_context_enter would
+ * @param irq - interrupt number
+ * @param syscall - system call number (IRQ_SYSCALL only)
+ * @param arg - first system call argument
+ */
+static void sim_trace_irq(int irq, int syscall, int arg) {
+    trapframe_t frame;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.interrupt = irq;
+    frame.eax = syscall;
+    frame.ebx = arg;
+    trace_irq(&frame, 0);
+}
+
+/**
+ * Finds a named semaphore or mutex
+ */
+static sim_object_t *sim_object_find(const char *name, int mutex) {
+    for (int i = 0; i < sim_object_count; i++) {
+        if (strcmp(sim_objects[i].name, name) == 0 && sim_objects[i].mutex == mutex) {
+            return &sim_objects[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Parses one program op
+ * @return 0 on success, -1 on error
+ */
+static int sim_op_parse(char *text, sim_op_t *op) {
+    char *arg = strchr(text, ':');
+    sim_object_t *object;
+
+    if (arg) {
+        *arg++ = '\0';
+    }
+
+    if (strcmp(text, "exit") == 0) {
+        op->type = SIM_OP_EXIT;
+        return 0;
+    }
+
+    if (!arg) {
+        return -1;
+    }
+
+    if (strcmp(text, "run") == 0 || strcmp(text, "sleep") == 0) {
+        op->type = text[0] == 'r' ? SIM_OP_RUN : SIM_OP_SLEEP;
+        op->arg = atoi(arg);
+        return op->arg > 0 ? 0 : -1;
+    }
+
+    if (strcmp(text, "wait") == 0 || strcmp(text, "post") == 0) {
+        op->type = text[0] == 'w' ? SIM_OP_WAIT : SIM_OP_POST;
+        object = sim_object_find(arg, 0);
+    } else if (strcmp(text, "lock") == 0 || strcmp(text, "unlock") == 0) {
+        op->type = text[0] == 'l' ? SIM_OP_LOCK : SIM_OP_UNLOCK;
+        object = sim_object_find(arg, 1);
+    } else {
+        return -1;
+    }
+
+    if (!object) {
+        return -1;
+    }
+
+    op->arg = object->id;
+    return 0;
+}
+
+/**
+ * Creates the processes of a group
+ */
+static int sim_group_start(sim_group_t *group) {
+    for (int i = 0; i < group->count; i++) {
+        int pid = kproc_create(kproc_test, group->name, PROC_TYPE_USER);
+
+        if (pid < 0 || pid >= SIM_PID_MAX) {
+            fprintf(stderr, "sim: unable to create process %d of group %s (PROC_MAX is %d)\n",
+                    i, group->name, PROC_MAX);
+            return -1;
+        }
+
+        sim_procs[pid].group = group;
+        sim_procs[pid].ready_at = -1;
+        sim_procs[pid].last_state = IDLE;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads a workload file and creates its kernel objects and processes
+ * @return 0 on success, -1 on error
+ */
+static int sim_workload_load(const char *path, int ticks, int cpus) {
+    char line[512];
+    int number = 0;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        char *words[SIM_OPS_MAX + 3];
+        int count = 0;
+        char *comment = strchr(line, '#');
+
+        number++;
+        if (comment) {
+            *comment = '\0';
+        }
+
+        for (char *word = strtok(line, " \t\r\n"); word && count < SIM_OPS_MAX + 3;
+             word = strtok(NULL, " \t\r\n")) {
+            words[count++] = word;
+        }
+
+        if (count == 0) {
+            continue;
+        }
+
+        if (strcmp(words[0], "ticks") == 0 && count == 2) {
+            sim_ticks = atoi(words[1]);
+        } else if (strcmp(words[0], "cpus") == 0 && count == 2) {
+            sim_cpus = atoi(words[1]);
+        } else if ((strcmp(words[0], "sem") == 0 && count == 3) ||
+                   (strcmp(words[0], "mutex") == 0 && count == 2)) {
+            sim_object_t *object = &sim_objects[sim_object_count];
+            int mutex = words[0][0] == 'm';
+
+            if (sim_object_count == SIM_OBJECTS_MAX) {
+                fprintf(stderr, "%s:%d: too many semaphores/mutexes\n", path, number);
+                fclose(file);
+                return -1;
+            }
+
+            snprintf(object->name, sizeof(object->name), "%s", words[1]);
+            object->mutex = mutex;
+            // Created by a system call from the idle process on CPU 0
+            if (mutex) {
+                sim_trace_irq(IRQ_SYSCALL, SYSCALL_MUTEX_INIT, 0);
+                object->id = kmutex_init();
+            } else {
+                sim_trace_irq(IRQ_SYSCALL, SYSCALL_SEM_INIT, atoi(words[2]));
+                object->id = ksem_init(atoi(words[2]));
+            }
+            scheduler_run();
+            if (object->id < 0) {
+                fprintf(stderr, "%s:%d: unable to create %s\n", path, number, words[1]);
+                fclose(file);
+                return -1;
+            }
+            sim_object_count++;
+        } else if (strcmp(words[0], "proc") == 0 && count >= 4) {
+            sim_group_t *group = &sim_groups[sim_group_count++];
+
+            group->count = atoi(words[1]);
+            snprintf(group->name, sizeof(group->name), "%s", words[2]);
+            for (int i = 3; i < count; i++) {
+                if (sim_op_parse(words[i], &group->op[group->ops++]) != 0) {
+                    fprintf(stderr, "%s:%d: invalid op '%s'\n", path, number, words[i]);
+                    fclose(file);
+                    return -1;
+                }
+            }
+        } else {
+            fprintf(stderr, "%s:%d: invalid directive '%s'\n", path, number, words[0]);
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+
+    // Command line overrides
+    if (ticks > 0) {
+        sim_ticks = ticks;
+    }
+    if (cpus > 0) {
+        sim_cpus = cpus;
+    }
+
+    if (sim_cpus < 1 || sim_cpus > CPU_MAX) {
+        fprintf(stderr, "sim: cpus must be 1 to %d\n", CPU_MAX);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Brings up the kernel subsystems in the same order as main()
+ */
+void sim_kernel_init(void) {
+    memset(cpus, 0, sizeof(cpus));
+    for (int i = 0; i < CPU_MAX; i++) {
+        cpus[i].id = i;
+        pid_queue_init(&cpus[i].run_queue);
+        smp_apic_to_cpu[i] = i;
+    }
+    cpus[0].online = 1;
+    smp_cpus_online = 1;
+    sim_cpu = 0;
+
+    if (!sim_memory) {
+        sim_memory = aligned_alloc(PAGE_BLOCK_MAX, SIM_MEMORY);
+    }
+    page_init_region(sim_memory, sim_memory + SIM_MEMORY);
+    kmem_init();
+
+    timer_init();
+    scheduler_init();
+
+    // kproc_init without the shells and test programs
+    memset(proc_table, 0, sizeof(proc_table));
+    proc_cache = kmem_cache_create("proc_t", sizeof(proc_t), kproc_ctor);
+    idmap_init(&proc_allocator, PROC_MAX);
+    next_pid = 0;
+    kproc_create(kproc_idle, "idle", PROC_TYPE_KERNEL);
+    cpus[0].idle_proc = pid_to_proc(0);
+    scheduler_run();
+
+    ksemaphores_init();
+    kmutexes_init();
+    kshm_init();
+}
+
+/**
+ * Brings up the application processors as smp_start_aps does
+ */
+static void sim_cpus_start(void) {
+    for (int i = 1; i < sim_cpus; i++) {
+        proc_t *idle = pid_to_proc(kproc_create(kproc_idle, "idle", PROC_TYPE_KERNEL));
+
+        scheduler_remove(idle);
+        cpus[i].idle_proc = idle;
+        cpus[i].current = idle;
+        cpus[i].online = 1;
+        idle->state = ACTIVE;
+        trace_event(TRACE_CPU_START, idle->pid, i);
+    }
+
+    smp_cpus_online = sim_cpus;
+}
+
+/**
+ * Records wake-ups and wake latencies by watching process states
+ *
+ * A process that was waiting becomes runnable when its state changes to
+ * IDLE (semaphores and mutexes) or when its sleep ends; the latency is
+ * the number of ticks from then until it is ACTIVE on a CPU.
+ */
+static void sim_scan(void) {
+    for (int pid = 0; pid < next_pid && pid < SIM_PID_MAX; pid++) {
+        sim_proc_t *sp = &sim_procs[pid];
+        proc_t *proc;
+
+        if (!sp->group || sp->exited || !(proc = pid_to_proc(pid))) {
+            continue;
+        }
+
+        if (sp->last_state == WAITING && proc->state != WAITING && sp->ready_at < 0) {
+            sp->ready_at = sim_tick;
+        }
+
+        if (proc->state == ACTIVE && sp->ready_at >= 0) {
+            int latency = sim_tick - sp->ready_at;
+
+            sim_latency[latency < SIM_LATENCY_MAX ? latency : SIM_LATENCY_MAX]++;
+            sim_wakeups++;
+            sp->ready_at = -1;
+        }
+
+        sp->last_state = proc->state;
+    }
+}
+
+/**
+ * Performs a system call op for the active process, as ksyscall.c would
+ */
+static void sim_syscall(proc_t *proc, sim_proc_t *sp, sim_op_t *op) {
+    static const int numbers[] = {
+        [SIM_OP_SLEEP] = SYSCALL_PROC_SLEEP,
+        [SIM_OP_WAIT] = SYSCALL_SEM_WAIT,
+        [SIM_OP_POST] = SYSCALL_SEM_POST,
+        [SIM_OP_LOCK] = SYSCALL_MUTEX_LOCK,
+        [SIM_OP_UNLOCK] = SYSCALL_MUTEX_UNLOCK,
+        [SIM_OP_EXIT] = SYSCALL_PROC_EXIT
+    };
+
+    sim_trace_irq(IRQ_SYSCALL, numbers[op->type], op->arg);
+
+    switch (op->type) {
+        case SIM_OP_SLEEP:
+            scheduler_sleep(proc, op->arg);
+            // scheduler_timer counts the sleep down from the next tick
+            sp->ready_at = sim_tick + op->arg * TIMER_HZ;
+            break;
+        case SIM_OP_WAIT:
+            ksem_wait(op->arg);
+            break;
+        case SIM_OP_POST:
+            ksem_post(op->arg);
+            break;
+        case SIM_OP_LOCK:
+            kmutex_lock(op->arg);
+            break;
+        case SIM_OP_UNLOCK:
+            kmutex_unlock(op->arg);
+            break;
+        case SIM_OP_EXIT:
+            sp->exited = 1;
+            kproc_destroy(proc);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Runs processes on the current CPU for the rest of the tick
+ *
+ * System calls take no time. The CPU keeps running ops until one tick of
+ * computation has been done; if a process blocks first, whichever process
+ * the scheduler picked next gets the rest of the tick.
+ */
+static void sim_execute(void) {
+    cpu_t *cpu = smp_cpu();
+
+    // Bounded so a program made only of system calls can't spin forever
+    for (int step = 0; step < SIM_OPS_MAX * 4; step++) {
+        proc_t *proc = cpu->current;
+        sim_proc_t *sp;
+        sim_op_t *op;
+
+        if (proc != sim_last_current[sim_cpu]) {
+            sim_switches++;
+            sim_last_current[sim_cpu] = proc;
+        }
+
+        if (!proc || !sim_procs[proc->pid].group || sim_procs[proc->pid].exited) {
+            sim_idle_ticks++;
+            return;
+        }
+
+        sp = &sim_procs[proc->pid];
+        op = &sp->group->op[sp->pc];
+
+        if (op->type == SIM_OP_RUN) {
+            if (sp->remaining == 0) {
+                sp->remaining = op->arg;
+            }
+            sp->work++;
+            if (--sp->remaining > 0) {
+                return;
+            }
+        }
+
+        // Move past the op before it can block, so the process resumes after it
+        if (++sp->pc == sp->group->ops) {
+            sp->pc = 0;
+            sp->loops++;
+        }
+
+        if (op->type == SIM_OP_RUN) {
+            return;
+        }
+
+        // System call: kernel entry, handler, then the scheduler on the way out
+        kernel_irq_depth = 1;
+        sim_syscall(proc, sp, op);
+        scheduler_run();
+        kernel_irq_depth = 0;
+        sim_scan();
+    }
+}
+
+/**
+ * Simulates one timer tick on every CPU
+ */
+static void sim_step(void) {
+    sim_tick++;
+
+    // Timer IRQ on every CPU, then the softirq and the scheduler
+    for (sim_cpu = 0; sim_cpu < sim_cpus; sim_cpu++) {
+        sim_trace_irq(IRQ_TIMER, 0, 0);
+        kernel_irq_depth = 1;
+        timer_irq_handler();
+        if (sim_cpu == 0) {
+            softirq_run();
+        }
+        scheduler_run();
+        kernel_irq_depth = 0;
+    }
+    sim_scan();
+
+    // Each CPU's process runs until the next tick
+    for (sim_cpu = 0; sim_cpu < sim_cpus; sim_cpu++) {
+        sim_execute();
+    }
+    sim_scan();
+}
+
+/**
+ * Returns the wake latency at the given percentile
+ */
+static int sim_latency_percentile(int percent) {
+    unsigned long long target = ((unsigned long long)sim_wakeups * percent + 99) / 100;
+    unsigned long long seen = 0;
+
+    for (int i = 0; i <= SIM_LATENCY_MAX; i++) {
+        seen += sim_latency[i];
+        if (seen >= target && seen > 0) {
+            return i;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Jain's fairness index over the work done by a group's processes
+ * (1.0 when every process got the same amount of CPU time)
+ * @param group - the group, NULL for every process
+ */
+static double sim_fairness(sim_group_t *group) {
+    double sum = 0;
+    double squares = 0;
+    int n = 0;
+
+    for (int pid = 0; pid < next_pid && pid < SIM_PID_MAX; pid++) {
+        sim_proc_t *sp = &sim_procs[pid];
+
+        if (!sp->group || (group && sp->group != group)) {
+            continue;
+        }
+
+        sum += sp->work;
+        squares += (double)sp->work * sp->work;
+        n++;
+    }
+
+    return squares > 0 ? sum * sum / (n * squares) : 1.0;
+}
+
+/**
+ * Prints the results of the run
+ */
+static void sim_report(const char *workload) {
+    unsigned long long work = 0;
+    unsigned long long loops = 0;
+    unsigned long long latency_sum = 0;
+    int latency_max = 0;
+    double seconds = (double)sim_ticks / TIMER_HZ;
+    double cpu_ticks = (double)sim_ticks * sim_cpus;
+
+    for (int pid = 0; pid < next_pid && pid < SIM_PID_MAX; pid++) {
+        work += sim_procs[pid].work;
+        loops += sim_procs[pid].loops;
+    }
+
+    for (int i = 0; i <= SIM_LATENCY_MAX; i++) {
+        latency_sum += (unsigned long long)sim_latency[i] * i;
+        if (sim_latency[i]) {
+            latency_max = i;
+        }
+    }
+
+    printf("workload      %s\n", workload);
+    printf("config        %d CPUs, %d ticks (%.1f s), PROC_MAX %d, timeslice %d\n",
+           sim_cpus, sim_ticks, seconds, PROC_MAX, SCHEDULER_TIMESLICE);
+    printf("throughput    %llu loops (%.1f/s), %llu work ticks (%.1f%% of CPU time)\n",
+           loops, loops / seconds, work, 100.0 * work / cpu_ticks);
+    printf("scheduling    %u context switches, %u idle ticks\n", sim_switches, sim_idle_ticks);
+    printf("fairness      Jain index %.4f\n", sim_fairness(NULL));
+    printf("wake latency  %u wake-ups, mean %.2f, p50 %d, p99 %d, max %d%s ticks\n",
+           sim_wakeups, sim_wakeups ? (double)latency_sum / sim_wakeups : 0.0,
+           sim_latency_percentile(50), sim_latency_percentile(99), latency_max,
+           latency_max == SIM_LATENCY_MAX ? "+" : "");
+    printf("kernel errors %d\n", sim_log_errors);
+
+    printf("\ngroup            procs      loops     work ticks   fairness\n");
+    for (int g = 0; g < sim_group_count; g++) {
+        sim_group_t *group = &sim_groups[g];
+        unsigned long long group_loops = 0;
+        unsigned long long group_work = 0;
+
+        for (int pid = 0; pid < next_pid && pid < SIM_PID_MAX; pid++) {
+            if (sim_procs[pid].group == group) {
+                group_loops += sim_procs[pid].loops;
+                group_work += sim_procs[pid].work;
+            }
+        }
+
+        printf("%-15s  %5d  %9llu  %13llu   %.4f\n", group->name, group->count,
+               group_loops, group_work, sim_fairness(group));
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *workload = NULL;
+    int ticks = 0;
+    int cpus_override = 0;
+    int dump = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && argc == 3) {
+            return sim_replay(argv[++i]) == 0 ? 0 : 1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dump = 1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            ticks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            cpus_override = atoi(argv[++i]);
+        } else if (!workload) {
+            workload = argv[i];
+        } else {
+            workload = NULL;
+            break;
+        }
+    }
+
+    if (!workload) {
+        fprintf(stderr, "usage: %s WORKLOAD [-t TICKS] [-c CPUS] [-d]\n"
+                "       %s -r RECORDING\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    sim_kernel_init();
+
+    if (dump) {
+        trace_start();
+    }
+
+    if (sim_workload_load(workload, ticks, cpus_override) != 0) {
+        return 1;
+    }
+
+    sim_cpus_start();
+
+    for (int g = 0; g < sim_group_count; g++) {
+        if (sim_group_start(&sim_groups[g]) != 0) {
+            return 1;
+        }
+    }
+
+    while (sim_tick < sim_ticks) {
+        sim_step();
+    }
+
+    sim_report(workload);
+
+    if (dump) {
+        trace_dump();
+    }
+
+    return 0;
+}
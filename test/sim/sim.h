@@ -0,0 +1,40 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Scheduler and synchronization simulator
+ */
+#ifndef SIM_H
+#define SIM_H
+
+// Largest number of processes a workload may create over a whole run
+#ifndef SIM_PID_MAX
+#define SIM_PID_MAX 4096
+#endif
+
+// Largest number of operations in one process program
+#define SIM_OPS_MAX 16
+
+// Largest number of named semaphores/mutexes in a workload
+#define SIM_OBJECTS_MAX 16
+
+// CPU the simulator is currently running kernel code on
+extern int sim_cpu;
+
+// Number of kernel_log_error calls so far
+extern int sim_log_errors;
+
+/**
+ * Brings up the kernel subsystems in the same order as main(), with only
+ * the idle process of CPU 0
+ */
+void sim_kernel_init(void);
+
+/**
+ * Replays a recording dumped by trace_dump
+ * @param path - file holding the host console output
+ * @return 0 if the replay matched the recording, 1 if it diverged, -1 on error
+ */
+int sim_replay(const char *path);
+
+#endif
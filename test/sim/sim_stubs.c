@@ -0,0 +1,203 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Host-side stand-ins for the hardware and drivers below the scheduler
+ *
+ * The simulator links the real scheduler, process, semaphore, mutex and
+ * timer code; everything they reach below that (APIC, PIC, clock, TTYs,
+ * paging, softirq entry with sti/cli) is replaced here. The calling CPU is
+ * whatever the simulator last set sim_cpu to.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apic.h"
+#include "clock.h"
+#include "interrupts.h"
+#include "kernel.h"
+#include "page.h"
+#include "smp.h"
+#include "softirq.h"
+#include "tty.h"
+
+#include "sim.h"
+
+// CPU the simulator is currently running kernel code on
+int sim_cpu;
+
+// Per-CPU data
+cpu_t cpus[CPU_MAX];
+unsigned char cpu_kstack[CPU_MAX][KSTACK_SIZE];
+volatile int smp_cpus_online = 1;
+unsigned char smp_apic_to_cpu[256];
+spinlock_t kernel_lock = SPINLOCK_INIT;
+
+// Pending softirqs and their handlers
+static unsigned int sim_softirq_pending;
+static void (*sim_softirq_handlers[SOFTIRQ_MAX])();
+
+void kernel_log_error(char *msg, ...) { (void)msg; sim_log_errors++; }
+void kernel_log_warn(char *msg, ...) { (void)msg; }
+void kernel_log_info(char *msg, ...) { (void)msg; }
+void kernel_log_debug(char *msg, ...) { (void)msg; }
+void kernel_log_trace(char *msg, ...) { (void)msg; }
+
+void kernel_panic(char *msg, ...) {
+    fprintf(stderr, "kernel_panic: %s\n", msg);
+    abort();
+}
+
+void kernel_break(void) {
+}
+
+int apic_id(void) {
+    return sim_cpu;
+}
+
+int apic_enabled(void) {
+    return 0;
+}
+
+int apic_timer_start(int hz) {
+    (void)hz;
+    return 0;
+}
+
+unsigned int clock_tsc_khz(void) {
+    return 0;
+}
+
+unsigned int interrupts_save_disable(void) {
+    return 0;
+}
+
+void interrupts_restore(unsigned int flags) {
+    (void)flags;
+}
+
+// The simulator calls timer_irq_handler itself on every tick
+void interrupts_irq_register(int irq, void (*entry)(), void (*handler)()) {
+    (void)irq;
+    (void)entry;
+    (void)handler;
+}
+
+void isr_entry_timer() {
+}
+
+int softirq_register(int nr, void (*handler)()) {
+    sim_softirq_handlers[nr] = handler;
+    return 0;
+}
+
+void softirq_raise(int nr) {
+    sim_softirq_pending |= 1U << nr;
+}
+
+void softirq_run(void) {
+    while (sim_softirq_pending) {
+        unsigned int pending = sim_softirq_pending;
+
+        sim_softirq_pending = 0;
+        for (int nr = 0; nr < SOFTIRQ_MAX; nr++) {
+            if ((pending & (1U << nr)) && sim_softirq_handlers[nr]) {
+                sim_softirq_handlers[nr]();
+            }
+        }
+    }
+}
+
+// The simulator runs single threaded, so the kernel lock is never contended
+void smp_kernel_lock(void) {
+}
+
+void smp_kernel_unlock(void) {
+}
+
+int smp_is_idle_proc(proc_t *proc) {
+    for (int i = 0; i < CPU_MAX; i++) {
+        if (cpus[i].idle_proc == proc) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+struct tty_t *tty_get(int tty) {
+    (void)tty;
+    return NULL;
+}
+
+// Simulated processes never touch their memory, so an address space is
+// just the list of pages mapped into it, given back when it is destroyed
+typedef struct sim_dir_t {
+    unsigned long count;
+    void *pages[PAGE_SIZE / sizeof(void *) - 1];
+} sim_dir_t;
+
+static pde_t sim_page_dir[PAGING_ENTRIES];
+
+pde_t *paging_kernel_dir(void) { return sim_page_dir; }
+
+pde_t *paging_dir_create(void) {
+    sim_dir_t *dir = page_alloc(0);
+
+    if (dir) {
+        dir->count = 0;
+    }
+
+    return (pde_t *)dir;
+}
+
+void paging_dir_destroy(pde_t *dir) {
+    sim_dir_t *sim_dir = (sim_dir_t *)dir;
+
+    if (!dir || dir == sim_page_dir) {
+        return;
+    }
+
+    for (unsigned long i = 0; i < sim_dir->count; i++) {
+        page_put(sim_dir->pages[i]);
+    }
+
+    page_free(dir);
+}
+
+int paging_map(pde_t *dir, unsigned int addr, void *page, unsigned int flags) {
+    sim_dir_t *sim_dir = (sim_dir_t *)dir;
+
+    (void)addr;
+    (void)flags;
+
+    if (!dir || dir == sim_page_dir || sim_dir->count == sizeof(sim_dir->pages) / sizeof(void *)) {
+        return -1;
+    }
+
+    sim_dir->pages[sim_dir->count++] = page;
+    return 0;
+}
+
+void *paging_unmap(pde_t *dir, unsigned int addr) { (void)dir; (void)addr; return NULL; }
+
+// Simulated processes don't fork
+pde_t *paging_dir_fork(pde_t *src) { (void)src; return NULL; }
+int paging_cow_break(pde_t *dir, unsigned int addr) { (void)dir; (void)addr; return -1; }
+void *paging_lookup(pde_t *dir, unsigned int addr) { (void)dir; (void)addr; return NULL; }
+
+unsigned short get_cs(void) { return 0; }
+unsigned short get_ds(void) { return 0; }
+unsigned short get_es(void) { return 0; }
+unsigned short get_fs(void) { return 0; }
+unsigned short get_gs(void) { return 0; }
+
+// Programs referenced by kproc_init; simulated processes never run code
+void prog_shell(void) { }
+void prog_ping(void) { }
+void prog_pong(void) { }
+void prog_worker(void) { }
+
+// Return address of kernel process functions, which never run here either
+void proc_exit(int exitcode) { (void)exitcode; }
@@ -0,0 +1,15 @@
+# Mixed workload: 500 processes on 2 CPUs for 60 simulated seconds
+#
+# Compute-bound processes compete with sleepers, a producer/consumer pair
+# of groups sharing a semaphore and a group contending for one mutex.
+ticks 6000
+cpus 2
+
+sem items 0
+mutex shared
+
+proc 100 compute   run:20
+proc 150 sleeper   run:1 sleep:1
+proc 50  producer  run:3 post:items sleep:1
+proc 100 consumer  wait:items run:2
+proc 100 locker    lock:shared run:2 unlock:shared run:5
@@ -0,0 +1,209 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Host-side stand-ins for the kernel services used by the tested modules
+ *
+ * Only what kmutex.c, ksem.c, kshm.c and scheduler.c link against is
+ * provided: logging, a process table, a single CPU, a timer that is ticked
+ * by hand from the tests and a record of the pages mapped into each
+ * address space.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel.h"
+#include "kmem.h"
+#include "page.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "stubs.h"
+#include "syscall.h"
+
+// Per-CPU data; the tests run as CPU 0
+cpu_t cpus[CPU_MAX];
+unsigned char cpu_kstack[CPU_MAX][KSTACK_SIZE];
+volatile int smp_cpus_online = 1;
+unsigned char smp_apic_to_cpu[256];
+spinlock_t kernel_lock = SPINLOCK_INIT;
+
+// Memory handed to the page allocator on every reset
+#define STUB_MEMORY (4 * PAGE_BLOCK_MAX)
+static char *stub_memory;
+
+// Process table handed out by stub_proc_create
+static proc_t stub_procs[PROC_MAX];
+
+// Registered timer callbacks
+#define STUB_TIMERS_MAX 8
+static void (*stub_timers[STUB_TIMERS_MAX])();
+static int stub_timer_count;
+
+// Pages mapped with paging_map (a NULL dir marks a free entry)
+#define STUB_MAPPINGS_MAX 256
+static struct {
+    pde_t *dir;
+    unsigned int addr;
+    void *page;
+} stub_mappings[STUB_MAPPINGS_MAX];
+
+// Process heap handed out by sbrk
+#define STUB_HEAP (1 << 20)
+static char stub_heap[STUB_HEAP];
+int stub_heap_used;
+
+int stub_log_errors;
+
+void kernel_log_error(char *msg, ...) { (void)msg; stub_log_errors++; }
+void kernel_log_warn(char *msg, ...) { (void)msg; }
+void kernel_log_info(char *msg, ...) { (void)msg; }
+void kernel_log_debug(char *msg, ...) { (void)msg; }
+void kernel_log_trace(char *msg, ...) { (void)msg; }
+
+void kernel_panic(char *msg, ...) {
+    printf("kernel_panic: %s\n", msg);
+    abort();
+}
+
+void kernel_break(void) {
+}
+
+int apic_id(void) {
+    return 0;
+}
+
+int smp_is_idle_proc(proc_t *proc) {
+    return proc == cpus[0].idle_proc;
+}
+
+proc_t *pid_to_proc(int pid) {
+    if (pid < 0 || pid >= PROC_MAX || stub_procs[pid].state == NONE) {
+        return NULL;
+    }
+
+    return &stub_procs[pid];
+}
+
+int timer_callback_register(void (*func_ptr)(), int interval, int repeat) {
+    (void)interval;
+    (void)repeat;
+
+    if (stub_timer_count == STUB_TIMERS_MAX) {
+        return -1;
+    }
+
+    stub_timers[stub_timer_count] = func_ptr;
+    return stub_timer_count++;
+}
+
+int paging_map(pde_t *dir, unsigned int addr, void *page, unsigned int flags) {
+    (void)flags;
+
+    for (int i = 0; i < STUB_MAPPINGS_MAX; i++) {
+        if (stub_mappings[i].dir == dir && stub_mappings[i].addr == addr) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < STUB_MAPPINGS_MAX; i++) {
+        if (!stub_mappings[i].dir) {
+            stub_mappings[i].dir = dir;
+            stub_mappings[i].addr = addr;
+            stub_mappings[i].page = page;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+void *paging_unmap(pde_t *dir, unsigned int addr) {
+    for (int i = 0; i < STUB_MAPPINGS_MAX; i++) {
+        if (stub_mappings[i].dir == dir && stub_mappings[i].addr == addr) {
+            stub_mappings[i].dir = NULL;
+            return stub_mappings[i].page;
+        }
+    }
+
+    return NULL;
+}
+
+void *sbrk(int increment) {
+    char *end = stub_heap + stub_heap_used;
+
+    if (increment > STUB_HEAP - stub_heap_used || increment < -stub_heap_used) {
+        return (void *)-1;
+    }
+
+    stub_heap_used += increment;
+    return end;
+}
+
+/**
+ * Counts the pages mapped into an address space
+ * @param dir - the page directory
+ * @return number of pages mapped with paging_map
+ */
+int stub_mapped(pde_t *dir) {
+    int count = 0;
+
+    for (int i = 0; i < STUB_MAPPINGS_MAX; i++) {
+        count += stub_mappings[i].dir == dir;
+    }
+
+    return count;
+}
+
+/**
+ * Resets the memory allocators, stub process table, mappings, heap, per-CPU
+ * data and timer callbacks
+ */
+void stub_reset(void) {
+    if (!stub_memory) {
+        stub_memory = aligned_alloc(PAGE_BLOCK_MAX, STUB_MEMORY);
+    }
+
+    page_init_region(stub_memory, stub_memory + STUB_MEMORY);
+    kmem_init();
+
+    memset(stub_procs, 0, sizeof(stub_procs));
+    memset(stub_mappings, 0, sizeof(stub_mappings));
+    memset(cpus, 0, sizeof(cpus));
+    stub_timer_count = 0;
+    stub_heap_used = 0;
+    stub_log_errors = 0;
+
+    cpus[0].online = 1;
+    scheduler_init();
+
+    // pid 0 is the idle process, as in the kernel
+    stub_procs[0].pid = 0;
+    stub_procs[0].state = IDLE;
+    cpus[0].idle_proc = &stub_procs[0];
+}
+
+/**
+ * Creates a process entry with the given pid and adds it to the scheduler
+ * @param pid - process id (also its process table entry)
+ * @return pointer to the process
+ */
+proc_t *stub_proc_create(int pid) {
+    proc_t *proc = &stub_procs[pid];
+
+    memset(proc, 0, sizeof(proc_t));
+    proc->pid = pid;
+    proc->state = IDLE;
+    scheduler_add(proc);
+
+    return proc;
+}
+
+/**
+ * Runs every registered timer callback once, as a timer tick would
+ */
+void stub_timer_tick(void) {
+    for (int i = 0; i < stub_timer_count; i++) {
+        stub_timers[i]();
+    }
+}
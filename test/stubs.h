@@ -0,0 +1,43 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Host-side stand-ins for the kernel services used by the tested modules
+ */
+#ifndef STUBS_H
+#define STUBS_H
+
+#include "kproc.h"
+
+/**
+ * Resets the memory allocators, stub process table, mappings, heap, per-CPU
+ * data and timer callbacks
+ */
+void stub_reset(void);
+
+/**
+ * Creates a process entry with the given pid and adds it to the scheduler
+ * @param pid - process id (also its process table entry)
+ * @return pointer to the process
+ */
+proc_t *stub_proc_create(int pid);
+
+/**
+ * Runs every registered timer callback once, as a timer tick would
+ */
+void stub_timer_tick(void);
+
+/**
+ * Counts the pages mapped into an address space
+ * @param dir - the page directory
+ * @return number of pages mapped with paging_map
+ */
+int stub_mapped(pde_t *dir);
+
+// Bytes of the stub heap handed out by sbrk since the last reset
+extern int stub_heap_used;
+
+// Number of kernel_log_error calls since the last reset
+extern int stub_log_errors;
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * User heap arena tests (with a stubbed sbrk)
+ */
+#include <string.h>
+
+#include "arena.h"
+#include "harness.h"
+#include "stubs.h"
+
+void test_arena(void) {
+    arena_t *arena;
+    char *a;
+    char *b;
+    char *c;
+    char *big;
+    int heap;
+
+    stub_reset();
+    arena = arena_create();
+    CHECK(arena != NULL);
+    CHECK_EQ(arena->heap, 0);
+    CHECK(arena_alloc(arena, 0) == NULL);
+
+    // Blocks are aligned, rounded up to their size class and don't overlap
+    a = arena_alloc(arena, 1);
+    b = arena_alloc(arena, 17);
+    c = arena_alloc(arena, 2048);
+    CHECK(a && b && c);
+    CHECK_EQ((unsigned long)a & 7, 0);
+    CHECK_EQ((unsigned long)b & 7, 0);
+    CHECK_EQ((unsigned long)c & 7, 0);
+    CHECK(b >= a + 16);
+    CHECK(c >= b + 32);
+    memset(a, 0xaa, 16);
+    memset(b, 0xbb, 32);
+    memset(c, 0xcc, 2048);
+    CHECK_EQ((unsigned char)a[15], 0xaa);
+    CHECK_EQ((unsigned char)b[31], 0xbb);
+    CHECK(arena->heap > ARENA_CHUNK_SIZE && (int)arena->heap < stub_heap_used);
+    heap = stub_heap_used;
+
+    // A freed block is the next one handed out in its class
+    CHECK_EQ(arena_free(arena, b), 0);
+    CHECK(arena_alloc(arena, 20) == b);
+    CHECK_EQ(arena_free(arena, b), 0);
+    CHECK(arena_alloc(arena, 64) != b);
+
+    // Double and bogus frees are refused; NULL is ignored
+    CHECK_EQ(arena_free(arena, b), -1);
+    CHECK_EQ(arena_free(arena, a + 1), -1);
+    CHECK_EQ(arena_free(arena, NULL), 0);
+
+    // Large blocks are reused first fit, whole
+    big = arena_alloc(arena, 5000);
+    CHECK(big != NULL);
+    CHECK_EQ(arena_free(arena, big), 0);
+    CHECK(arena_alloc(arena, 3000) == big);
+    CHECK_EQ(arena_free(arena, big), 0);
+    CHECK(arena_alloc(arena, 6000) != big);
+    CHECK_EQ(stub_heap_used, heap);
+
+    // Requests larger than a chunk get a chunk of their own
+    big = arena_alloc(arena, 3 * ARENA_CHUNK_SIZE);
+    CHECK(big != NULL);
+    memset(big, 0xdd, 3 * ARENA_CHUNK_SIZE);
+    CHECK(stub_heap_used > heap + 3 * ARENA_CHUNK_SIZE);
+
+    // Resetting frees everything and reuses the heap without growing it
+    heap = stub_heap_used;
+    arena_reset(arena);
+    CHECK_EQ(arena->in_use, 0);
+    CHECK(arena_alloc(arena, 1) == a);
+    CHECK(arena_alloc(arena, 3 * ARENA_CHUNK_SIZE) == big);
+    CHECK_EQ(stub_heap_used, heap);
+
+    // Accounting covers every block and its header
+    arena_reset(arena);
+    a = arena_alloc(arena, 100);
+    b = arena_alloc(arena, 4000);
+    CHECK(arena->in_use >= 128 + 4000);
+    arena_free(arena, a);
+    arena_free(arena, b);
+    CHECK_EQ(arena->in_use, 0);
+
+    // Once the heap can't grow, allocations fail and the arena stays usable
+    CHECK(arena_alloc(arena, 1 << 21) == NULL);
+    CHECK(arena_alloc(arena, 16) != NULL);
+
+    // Separate arenas have separate free lists
+    b = arena_alloc(arena, 32);
+    arena_free(arena, b);
+    c = arena_alloc(arena_create(), 32);
+    CHECK(c != NULL && c != b);
+}
+
+void bench_arena(void) {
+    static void *objs[64];
+    arena_t *arena;
+
+    stub_reset();
+    arena = arena_create();
+
+    BENCH("arena_alloc/free 64 bytes", 10000000, {
+        void *mem = arena_alloc(arena, 64);
+        harness_sink += (unsigned long)mem;
+        arena_free(arena, mem);
+    });
+
+    // A window of live blocks of mixed sizes, freed out of order
+    BENCH("arena_alloc/free mixed sizes", 10000000, {
+        int slot = (i * 37) & 63;
+        if (objs[slot]) {
+            arena_free(arena, objs[slot]);
+        }
+        objs[slot] = arena_alloc(arena, 16 << (i % 8));
+    });
+
+    // Building up a batch of blocks and dropping them all at once
+    arena_reset(arena);
+    BENCH("arena_alloc 32 bytes, reset every 256", 10000000, {
+        harness_sink += (unsigned long)arena_alloc(arena, 32);
+        if ((i & 255) == 255) {
+            arena_reset(arena);
+        }
+    });
+}
@@ -0,0 +1,110 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Bit and bitmap tests and benchmarks
+ */
+#include <stdlib.h>
+
+#include "bit.h"
+#include "bitmap.h"
+#include "harness.h"
+
+#define TEST_BITS 200
+
+/**
+ * Compares the bitmap searches with a bit-at-a-time reference
+ */
+static int test_bitmap_reference_next(unsigned int *map, int bits, int start, int value) {
+    for (int i = start < 0 ? 0 : start; i < bits; i++) {
+        if (bitmap_test(map, i) == value) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void test_bit(void) {
+    unsigned int map[BITMAP_WORDS(TEST_BITS)];
+    int errors = 0;
+
+    CHECK_EQ(bit_count(0), 0);
+    CHECK_EQ(bit_count(0xffffffff), 32);
+    CHECK_EQ(bit_count(0x80000001), 2);
+    CHECK_EQ(bit_ffs(0), -1);
+    CHECK_EQ(bit_ffs(0x80000000), 31);
+    CHECK_EQ(bit_ffs(0x00000600), 9);
+    CHECK_EQ(bit_fls(0x00000600), 10);
+    CHECK_EQ(bit_ffz(0xffffffff), -1);
+    CHECK_EQ(bit_ffz(0x0000ffff), 16);
+    CHECK_EQ(bit_set(0, 31), 0x80000000);
+    CHECK_EQ(bit_clear(0xff, 0), 0xfe);
+    CHECK_EQ(bit_toggle(0xf0, 4), 0xe0);
+
+    srand(42);
+    for (int round = 0; round < 20000; round++) {
+        int bits = 1 + rand() % TEST_BITS;
+        int start = rand() % bits;
+        int count = rand() % (bits - start + 1);
+        int set = 0;
+        int bit;
+
+        for (unsigned int w = 0; w < BITMAP_WORDS(TEST_BITS); w++) {
+            map[w] = (unsigned int)rand() ^ ((unsigned int)rand() << 16);
+        }
+
+        if (rand() & 1) {
+            bitmap_set_range(map, start, count);
+            for (int i = start; i < start + count; i++) {
+                errors += !bitmap_test(map, i);
+            }
+        } else {
+            bitmap_clear_range(map, start, count);
+            for (int i = start; i < start + count; i++) {
+                errors += bitmap_test(map, i);
+            }
+        }
+
+        for (int i = 0; i < bits; i++) {
+            set += bitmap_test(map, i);
+        }
+        errors += bitmap_count(map, bits) != set;
+
+        start = rand() % (bits + 2) - 1;
+        errors += bitmap_next_set(map, bits, start) != test_bitmap_reference_next(map, bits, start, 1);
+        errors += bitmap_next_clear(map, bits, start) != test_bitmap_reference_next(map, bits, start, 0);
+
+        bitmap_for_each(bit, map, bits) {
+            set--;
+        }
+        errors += set != 0;
+    }
+    CHECK_EQ(errors, 0);
+}
+
+/**
+ * bit_count as it was before the bitmap library
+ */
+static unsigned int bench_bit_count_recursive(unsigned int value) {
+    if (value == 0) {
+        return 0;
+    }
+    return (value & 1) + bench_bit_count_recursive(value >> 1);
+}
+
+void bench_bit(void) {
+    static unsigned int map[BITMAP_WORDS(256)];
+
+    BENCH("bit_count (recursive)", 10000000,
+          harness_sink += bench_bit_count_recursive((unsigned int)i * 2654435761u));
+    BENCH("bit_count", 10000000,
+          harness_sink += bit_count((unsigned int)i * 2654435761u));
+
+    BENCH("bitmap_first_set 256 bits", 10000000, {
+        int bit = i % 256;
+        bitmap_set(map, bit);
+        harness_sink += bitmap_first_set(map, 256);
+        bitmap_clear(map, bit);
+    });
+}
@@ -0,0 +1,33 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * ID allocator tests
+ */
+#include "harness.h"
+#include "idmap.h"
+
+void test_idmap(void) {
+    idmap_t map;
+
+    CHECK_EQ(idmap_init(&map, 0), -1);
+    CHECK_EQ(idmap_init(&map, IDMAP_MAX + 1), -1);
+    CHECK_EQ(idmap_init(&map, 40), 0);
+
+    // Ids are handed out lowest first until the map is full
+    for (int i = 0; i < 40; i++) {
+        CHECK_EQ(idmap_alloc(&map), i);
+    }
+    CHECK_EQ(idmap_alloc(&map), -1);
+
+    // Freed ids are reused lowest first; double frees are rejected
+    CHECK_EQ(idmap_free(&map, 35), 0);
+    CHECK_EQ(idmap_free(&map, 35), -1);
+    CHECK_EQ(idmap_free(&map, 3), 0);
+    CHECK_EQ(idmap_test(&map, 3), 0);
+    CHECK_EQ(idmap_alloc(&map), 3);
+    CHECK_EQ(idmap_alloc(&map), 35);
+
+    CHECK_EQ(idmap_free(&map, -1), -1);
+    CHECK_EQ(idmap_free(&map, 40), -1);
+}
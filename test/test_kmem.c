@@ -0,0 +1,175 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Object cache and kmalloc tests and benchmarks
+ */
+#include <string.h>
+
+#include "harness.h"
+#include "kmem.h"
+#include "page.h"
+#include "stubs.h"
+
+// Test object: the constructor fills in a pattern allocation must keep
+typedef struct test_kmem_obj_t {
+    int constructed;
+    int value;
+    char data[40];
+} test_kmem_obj_t;
+
+static int test_kmem_ctors;
+
+static void test_kmem_ctor(void *obj) {
+    test_kmem_obj_t *o = obj;
+
+    o->constructed = 0x5eed;
+    o->value = 0;
+    test_kmem_ctors++;
+}
+
+void test_kmem(void) {
+    static test_kmem_obj_t *objs[1000];
+    page_stats_t before;
+    page_stats_t after;
+    kmem_cache_t *cache;
+    kmem_cache_t *other;
+    test_kmem_obj_t *obj;
+    int unconstructed = 0;
+    int misaligned = 0;
+    int failed = 0;
+    char *mem;
+
+    stub_reset();
+    page_stats(&before);
+    test_kmem_ctors = 0;
+
+    cache = kmem_cache_create("test", sizeof(test_kmem_obj_t), test_kmem_ctor);
+    CHECK(cache != NULL);
+    CHECK(cache->per_slab >= KMEM_SLAB_OBJECTS_MIN);
+
+    // The first allocation builds a slab and constructs all of its objects
+    obj = kmem_cache_alloc(cache);
+    CHECK(obj != NULL);
+    CHECK_EQ(obj->constructed, 0x5eed);
+    CHECK_EQ(test_kmem_ctors, cache->per_slab);
+    CHECK_EQ(cache->slab_count, 1);
+    CHECK_EQ(cache->in_use, 1);
+
+    // A freed object comes back as it was left, without being constructed again
+    obj->value = 42;
+    CHECK_EQ(kmem_cache_free(cache, obj), 0);
+    CHECK(kmem_cache_alloc(cache) == obj);
+    CHECK_EQ(obj->value, 42);
+    CHECK_EQ(test_kmem_ctors, cache->per_slab);
+
+    // Double frees and objects of other caches are rejected
+    other = kmem_cache_create("other", sizeof(test_kmem_obj_t), NULL);
+    CHECK_EQ(kmem_cache_free(cache, obj), 0);
+    CHECK_EQ(kmem_cache_free(cache, obj), -1);
+    obj = kmem_cache_alloc(other);
+    CHECK_EQ(kmem_cache_free(cache, obj), -1);
+    CHECK_EQ(kmem_cache_free(cache, (char *)obj + 4), -1);
+    CHECK_EQ(kmem_cache_free(other, obj), 0);
+    CHECK_EQ(stub_log_errors, 3);
+
+    // Occupancy follows allocations across many slabs
+    for (int i = 0; i < 1000; i++) {
+        objs[i] = kmem_cache_alloc(cache);
+        unconstructed += objs[i]->constructed != 0x5eed;
+        misaligned += ((unsigned long)objs[i] & 7) != 0;
+    }
+    CHECK_EQ(unconstructed, 0);
+    CHECK_EQ(misaligned, 0);
+    CHECK_EQ(cache->in_use, 1000);
+    CHECK_EQ(cache->slab_count, (1000 + cache->per_slab - 1) / cache->per_slab);
+
+    // A cache with live objects can't be destroyed
+    CHECK_EQ(kmem_cache_destroy(cache), -1);
+
+    for (int i = 0; i < 1000; i++) {
+        failed += kmem_cache_free(cache, objs[i]) != 0;
+    }
+    CHECK_EQ(failed, 0);
+    CHECK_EQ(cache->in_use, 0);
+    CHECK_EQ(cache->allocs, cache->frees);
+
+    // Destroying the caches gives every slab back to the page allocator
+    CHECK_EQ(kmem_cache_destroy(cache), 0);
+    CHECK_EQ(kmem_cache_destroy(other), 0);
+    page_stats(&after);
+    CHECK_EQ(after.free, before.free);
+
+    // kmalloc rounds up to its size classes and kfree finds the class
+    for (unsigned int size = 1; size <= KMEM_KMALLOC_MAX; size += 37) {
+        mem = kmalloc(size);
+        memset(mem, 0xa5, size);
+        failed += mem == NULL || kfree(mem) != 0;
+    }
+    CHECK_EQ(failed, 0);
+
+    // Objects anywhere in a multi-page slab can be freed, including slabs
+    // cut from pages the page allocator had never handed out before
+    stub_reset();
+    for (int i = 0; i < 32; i++) {
+        objs[i] = kmalloc(2000);
+    }
+    for (int i = 0; i < 32; i++) {
+        failed += objs[i] == NULL || kfree(objs[i]) != 0;
+    }
+    CHECK_EQ(failed, 0);
+    CHECK_EQ(stub_log_errors, 0);
+
+    // Larger requests are whole page blocks
+    page_stats(&before);
+    mem = kmalloc(3 * PAGE_SIZE);
+    CHECK(mem != NULL);
+    CHECK_EQ((unsigned long)mem & (PAGE_SIZE - 1), 0);
+    page_stats(&after);
+    CHECK_EQ(before.free - after.free, 4);
+    CHECK_EQ(kfree(mem), 0);
+    CHECK_EQ(kfree(NULL), 0);
+    CHECK_EQ(kfree(mem), -1);
+
+    // Out of pages, allocations fail and are counted
+    stub_reset();
+    cache = kmem_cache_create("test", sizeof(test_kmem_obj_t), NULL);
+    while (page_alloc(0) != NULL) {
+    }
+    CHECK(kmem_cache_alloc(cache) == NULL);
+    CHECK_EQ(cache->failures, 1);
+    CHECK(kmalloc(64) == NULL);
+}
+
+void bench_kmem(void) {
+    static void *objs[64];
+    kmem_cache_t *cache;
+
+    stub_reset();
+    cache = kmem_cache_create("bench", sizeof(test_kmem_obj_t), test_kmem_ctor);
+
+    BENCH("kmem_cache_alloc/free", 10000000, {
+        void *obj = kmem_cache_alloc(cache);
+        harness_sink += (unsigned long)obj;
+        kmem_cache_free(cache, obj);
+    });
+
+    BENCH("kmalloc/kfree 64 bytes", 10000000, {
+        void *mem = kmalloc(64);
+        harness_sink += (unsigned long)mem;
+        kfree(mem);
+    });
+
+    // A window of live objects of mixed sizes, freed out of order
+    BENCH("kmalloc/kfree mixed sizes", 10000000, {
+        int slot = (i * 37) & 63;
+        if (objs[slot]) {
+            kfree(objs[slot]);
+        }
+        objs[slot] = kmalloc(16 << (i % 8));
+    });
+
+    for (int i = 0; i < 64; i++) {
+        kfree(objs[i]);
+    }
+}
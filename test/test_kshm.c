@@ -0,0 +1,102 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Shared memory segment tests (with stubbed address spaces)
+ */
+#include "harness.h"
+#include "kshm.h"
+#include "page.h"
+#include "stubs.h"
+
+extern shm_t *shm_segments[SHM_MAX];
+
+// Stand-in page directories; the stubs only use them as keys
+static pde_t test_kshm_dirs[3][1];
+
+static proc_t *test_kshm_proc(int pid) {
+    proc_t *proc = stub_proc_create(pid);
+
+    proc->type = PROC_TYPE_USER;
+    proc->page_dir = test_kshm_dirs[pid - 1];
+    return proc;
+}
+
+void test_kshm(void) {
+    proc_t *a;
+    proc_t *b;
+    proc_t *c;
+    void *page;
+    int id;
+
+    stub_reset();
+    CHECK_EQ(kshm_init(), 0);
+    a = test_kshm_proc(1);
+    b = test_kshm_proc(2);
+    c = test_kshm_proc(3);
+
+    // The creator is attached to a cleared segment of whole pages
+    id = kshm_create(a, 3 * PAGE_SIZE - 10);
+    CHECK(id >= 0);
+    CHECK_EQ(shm_segments[id]->size, 3 * PAGE_SIZE);
+    CHECK_EQ(shm_segments[id]->refs, 1);
+    CHECK_EQ(a->shm_attached, 1U << id);
+    CHECK_EQ(stub_mapped(a->page_dir), 3);
+    page = shm_segments[id]->pages[0];
+    CHECK_EQ(((char *)page)[PAGE_SIZE - 1], 0);
+    CHECK_EQ(page_refs(page), 2);
+
+    // Every process sees the segment at the same address; attaching twice
+    // doesn't take another reference
+    CHECK_EQ(kshm_attach(b, id), SHM_BASE + id * SHM_SIZE_MAX);
+    CHECK_EQ(kshm_attach(b, id), SHM_BASE + id * SHM_SIZE_MAX);
+    CHECK_EQ(shm_segments[id]->refs, 2);
+    CHECK_EQ(page_refs(page), 3);
+
+    // A forked copy shares the attachment
+    kshm_fork(b, c);
+    CHECK_EQ(c->shm_attached, b->shm_attached);
+    CHECK_EQ(shm_segments[id]->refs, 3);
+    CHECK_EQ(kshm_detach(c, id), 0);
+
+    // Detaching unmaps the segment from that process only
+    CHECK_EQ(kshm_detach(a, id), 0);
+    CHECK_EQ(stub_mapped(a->page_dir), 0);
+    CHECK_EQ(a->shm_attached, 0);
+    CHECK_EQ(shm_segments[id]->refs, 1);
+    CHECK_EQ(page_refs(page), 2);
+    CHECK_EQ(kshm_detach(a, id), -1);
+    CHECK_EQ(stub_log_errors, 1);
+
+    // The last process to go frees the segment and its pages
+    kshm_release(b);
+    CHECK_EQ(b->shm_attached, 0);
+    CHECK_EQ(stub_mapped(b->page_dir), 0);
+    CHECK(shm_segments[id] == NULL);
+    CHECK_EQ(page_refs(page), 0);
+    CHECK_EQ(kshm_attach(b, id), 0);
+    CHECK_EQ(stub_log_errors, 2);
+
+    // Invalid sizes, kernel processes and unknown ids are rejected
+    stub_reset();
+    kshm_init();
+    a = test_kshm_proc(1);
+    CHECK_EQ(kshm_create(a, 0), -1);
+    CHECK_EQ(kshm_create(a, SHM_SIZE_MAX + 1), -1);
+    a->type = PROC_TYPE_KERNEL;
+    CHECK_EQ(kshm_create(a, PAGE_SIZE), -1);
+    CHECK_EQ(kshm_detach(a, SHM_MAX), -1);
+    CHECK_EQ(stub_log_errors, 4);
+
+    // Every id is handed out once; freed ids are reused
+    a->type = PROC_TYPE_USER;
+    for (int i = 0; i < SHM_MAX; i++) {
+        CHECK_EQ(kshm_create(a, PAGE_SIZE), i);
+    }
+    CHECK_EQ(kshm_create(a, PAGE_SIZE), -1);
+    CHECK_EQ(kshm_detach(a, 5), 0);
+    CHECK_EQ(kshm_create(a, PAGE_SIZE), 5);
+    kshm_release(a);
+    CHECK_EQ(a->shm_attached, 0);
+    CHECK_EQ(stub_mapped(a->page_dir), 0);
+}
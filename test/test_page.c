@@ -0,0 +1,210 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Page-frame allocator tests and benchmarks
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "page.h"
+#include "stubs.h"
+
+// Memory handed to the allocator: four 4 MB blocks
+#define TEST_PAGE_MEMORY (4 * PAGE_BLOCK_MAX)
+
+static char *test_page_memory;
+
+/**
+ * Sets up the allocator over the whole test memory
+ * @return number of pages the allocator manages
+ */
+static unsigned int test_page_setup(void) {
+    page_stats_t stats;
+
+    if (!test_page_memory) {
+        test_page_memory = aligned_alloc(PAGE_BLOCK_MAX, TEST_PAGE_MEMORY);
+    }
+
+    if (page_init_region(test_page_memory, test_page_memory + TEST_PAGE_MEMORY) != 0) {
+        return 0;
+    }
+
+    page_stats(&stats);
+    return stats.total;
+}
+
+void test_page(void) {
+    static void *blocks[TEST_PAGE_MEMORY / PAGE_SIZE];
+    page_stats_t stats;
+    page_stats_t after;
+    unsigned int total;
+    int outside = 0;
+    int failed = 0;
+    int count;
+    char *block;
+    char *buddy;
+
+    CHECK_EQ(page_order(1), 0);
+    CHECK_EQ(page_order(PAGE_SIZE), 0);
+    CHECK_EQ(page_order(PAGE_SIZE + 1), 1);
+    CHECK_EQ(page_order(PAGE_BLOCK_MAX), PAGE_ORDER_MAX);
+    CHECK_EQ(page_order(PAGE_BLOCK_MAX + 1), -1);
+
+    // The bookkeeping takes the first pages; the rest is free
+    total = test_page_setup();
+    page_stats(&stats);
+    CHECK(total >= TEST_PAGE_MEMORY / PAGE_SIZE - 16);
+    CHECK(total < TEST_PAGE_MEMORY / PAGE_SIZE);
+    CHECK_EQ(stats.free, total);
+    CHECK_EQ(stats.blocks[PAGE_ORDER_MAX], 3);
+
+    // Every page can be allocated once, and each one is usable memory
+    count = 0;
+    while ((block = page_alloc(0)) != NULL) {
+        outside += block < test_page_memory || block >= test_page_memory + TEST_PAGE_MEMORY;
+        memset(block, 0xa5, PAGE_SIZE);
+        blocks[count++] = block;
+    }
+    CHECK_EQ(count, total);
+    CHECK_EQ(outside, 0);
+    page_stats(&stats);
+    CHECK_EQ(stats.free, 0);
+    CHECK_EQ(stats.failures, 1);
+    CHECK_EQ(page_fragmentation(0), 0);
+
+    // Freeing every other page leaves nothing usable above order 0
+    for (int i = 0; i < count; i += 2) {
+        failed += page_free(blocks[i]) != 0;
+    }
+    CHECK_EQ(failed, 0);
+    CHECK_EQ(page_fragmentation(0), 0);
+    CHECK_EQ(page_fragmentation(1), 100);
+    CHECK(page_alloc(1) == NULL);
+
+    // Freeing the rest merges everything back into the largest blocks
+    for (int i = 1; i < count; i += 2) {
+        failed += page_free(blocks[i]) != 0;
+    }
+    CHECK_EQ(failed, 0);
+    page_stats(&stats);
+    CHECK_EQ(stats.free, total);
+    CHECK_EQ(stats.blocks[PAGE_ORDER_MAX], 3);
+    CHECK_EQ(page_fragmentation(PAGE_ORDER_MAX), (int)((total - 3 * 1024) * 100 / total));
+
+    // Blocks are aligned to their size
+    for (int order = 0; order <= PAGE_ORDER_MAX; order++) {
+        block = page_alloc(order);
+        CHECK(block != NULL);
+        CHECK_EQ((unsigned long)block & ((PAGE_SIZE << order) - 1), 0);
+        CHECK_EQ(page_free(block), 0);
+    }
+
+    // Double frees, unaligned and foreign addresses are rejected
+    stub_reset();
+    block = page_alloc(2);
+    CHECK_EQ(page_free(block + PAGE_SIZE), -1);
+    CHECK_EQ(page_free(block + 1), -1);
+    CHECK_EQ(page_free(test_page_memory), -1);
+    CHECK_EQ(page_free(block), 0);
+    CHECK_EQ(page_free(block), -1);
+    CHECK_EQ(stub_log_errors, 4);
+
+    // A page merged into its lower buddy can't be freed again
+    stub_reset();
+    block = page_alloc(0);
+    buddy = page_alloc(0);
+    CHECK(buddy == block + PAGE_SIZE);
+    CHECK_EQ(page_free(block), 0);
+    CHECK_EQ(page_free(buddy), 0);
+    CHECK_EQ(page_free(buddy), -1);
+    CHECK_EQ(page_put(buddy), -1);
+    CHECK_EQ(stub_log_errors, 2);
+
+    // A reallocated block has no owner on any of its pages
+    block = page_alloc(2);
+    CHECK_EQ(page_set_owner(block, &stats), 0);
+    CHECK(page_owner(block + 3 * PAGE_SIZE) == &stats);
+    CHECK_EQ(page_free(block), 0);
+    CHECK(page_alloc(2) == block);
+    CHECK(page_owner(block) == NULL);
+    CHECK(page_owner(block + 3 * PAGE_SIZE) == NULL);
+    CHECK_EQ(page_free(block), 0);
+
+    // A shared block is only freed with its last reference
+    stub_reset();
+    page_stats(&stats);
+    block = page_alloc(1);
+    CHECK_EQ(page_refs(block), 1);
+    CHECK_EQ(page_get(block), 0);
+    CHECK_EQ(page_refs(block), 2);
+    CHECK_EQ(page_put(block), 0);
+    page_stats(&after);
+    CHECK_EQ(stats.free - after.free, 2);
+    CHECK_EQ(page_put(block), 0);
+    CHECK_EQ(page_refs(block), 0);
+    page_stats(&after);
+    CHECK_EQ(after.free, stats.free);
+    CHECK_EQ(page_get(block), -1);
+    CHECK_EQ(page_put(block), -1);
+    CHECK_EQ(stub_log_errors, 2);
+
+    // A region too small for its own bookkeeping is refused
+    stub_reset();
+    CHECK_EQ(page_init_region(test_page_memory, test_page_memory + PAGE_SIZE), -1);
+    CHECK_EQ(stub_log_errors, 1);
+
+    // Taking a page from a 4 MB block splits it all the way down, and
+    // freeing the page merges it all the way back up
+    test_page_setup();
+    page_stats(&stats);
+    for (int order = 0; order < PAGE_ORDER_MAX; order++) {
+        for (unsigned int i = 0; i < stats.blocks[order]; i++) {
+            page_alloc(order);
+        }
+    }
+    page_stats(&stats);
+    block = page_alloc(0);
+    page_stats(&after);
+    CHECK_EQ(after.splits - stats.splits, PAGE_ORDER_MAX);
+    CHECK_EQ(after.blocks[PAGE_ORDER_MAX], stats.blocks[PAGE_ORDER_MAX] - 1);
+    page_free(block);
+    page_stats(&after);
+    CHECK_EQ(after.merges - stats.merges, PAGE_ORDER_MAX);
+    CHECK_EQ(after.blocks[PAGE_ORDER_MAX], stats.blocks[PAGE_ORDER_MAX]);
+    CHECK_EQ(after.blocks[0], 0);
+}
+
+void bench_page(void) {
+    static void *blocks[64];
+
+    test_page_setup();
+
+    BENCH("page_alloc/free order 0", 10000000, {
+        void *block = page_alloc(0);
+        harness_sink += (unsigned long)block;
+        page_free(block);
+    });
+
+    BENCH("page_alloc/free order 4", 10000000, {
+        void *block = page_alloc(4);
+        harness_sink += (unsigned long)block;
+        page_free(block);
+    });
+
+    // A window of live blocks of mixed sizes, freed out of order
+    BENCH("page_alloc/free mixed orders", 10000000, {
+        int slot = (i * 37) & 63;
+        if (blocks[slot]) {
+            page_free(blocks[slot]);
+        }
+        blocks[slot] = page_alloc(i % 5);
+    });
+
+    for (int i = 0; i < 64; i++) {
+        if (blocks[i]) {
+            page_free(blocks[i]);
+        }
+    }
+}
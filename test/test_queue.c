@@ -0,0 +1,64 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Queue tests and benchmarks
+ */
+#include "harness.h"
+#include "queue.h"
+
+DEFINE_QUEUE(test_ptr_queue, void *, 4)
+
+void test_queue(void) {
+    queue_t queue;
+    int item = -1;
+
+    CHECK_EQ(queue_init(&queue), 0);
+    CHECK(queue_is_empty(&queue));
+    CHECK_EQ(queue_out(&queue, &item), -1);
+
+    // Fill, overflow and drain several times so head/tail wrap
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < QUEUE_SIZE; i++) {
+            CHECK_EQ(queue_in(&queue, round * 100 + i), 0);
+        }
+        CHECK(queue_is_full(&queue));
+        CHECK_EQ(queue_size(&queue), QUEUE_SIZE);
+        CHECK_EQ(queue_in(&queue, -1), -1);
+
+        for (int i = 0; i < QUEUE_SIZE; i++) {
+            CHECK_EQ(queue_out(&queue, &item), 0);
+            CHECK_EQ(item, round * 100 + i);
+        }
+        CHECK(queue_is_empty(&queue));
+    }
+
+    CHECK_EQ(queue_in(NULL, 1), -1);
+    CHECK_EQ(queue_out(&queue, NULL), -1);
+
+    // Queues of other types and capacities
+    test_ptr_queue_t ptrs;
+    void *ptr = NULL;
+
+    test_ptr_queue_init(&ptrs);
+    for (int i = 0; i < 4; i++) {
+        CHECK_EQ(test_ptr_queue_in(&ptrs, &queue), 0);
+    }
+    CHECK_EQ(test_ptr_queue_in(&ptrs, &queue), -1);
+    CHECK_EQ(test_ptr_queue_out(&ptrs, &ptr), 0);
+    CHECK(ptr == &queue);
+    CHECK_EQ(test_ptr_queue_size(&ptrs), 3);
+}
+
+void bench_queue(void) {
+    queue_t queue;
+    int item;
+
+    queue_init(&queue);
+
+    BENCH("queue in+out", 10000000, {
+        queue_in(&queue, (int)i);
+        queue_out(&queue, &item);
+        harness_sink += item;
+    });
+}
@@ -0,0 +1,171 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Ring buffer tests and benchmarks
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "ringbuf.h"
+#include "stubs.h"
+
+/**
+ * Moves random amounts through the buffer with every API and compares
+ * the bytes read with the bytes written
+ */
+static void test_ringbuf_random(ringbuf_t *buf) {
+    unsigned char next_write = 0;
+    unsigned char next_read = 0;
+    char mem[4096];
+    int used = 0;
+    int errors = 0;
+
+    srand(159);
+
+    for (int op = 0; op < 200000; op++) {
+        int capacity = ringbuf_capacity(buf);
+        int n = rand() % (capacity + 8);
+        char *region;
+        int count;
+
+        switch (rand() % 6) {
+            case 0:
+                if (ringbuf_write(buf, next_write) == 0) {
+                    next_write++;
+                    used++;
+                } else if (used != capacity) {
+                    errors++;
+                }
+                break;
+            case 1:
+                for (int i = 0; i < n && i < (int)sizeof(mem); i++) {
+                    mem[i] = next_write + i;
+                }
+                if (n > (int)sizeof(mem)) {
+                    n = sizeof(mem);
+                }
+                if (ringbuf_write_mem(buf, mem, n) == 0) {
+                    next_write += n;
+                    used += n;
+                } else if (used + n <= capacity) {
+                    errors++;
+                }
+                break;
+            case 2:
+                if (ringbuf_read(buf, mem) == 0) {
+                    errors += (unsigned char)mem[0] != next_read++;
+                    used--;
+                } else if (used != 0) {
+                    errors++;
+                }
+                break;
+            case 3:
+                if (n > (int)sizeof(mem)) {
+                    n = sizeof(mem);
+                }
+                count = ringbuf_read_mem(buf, mem, n);
+                errors += count != (n < used ? n : used);
+                for (int i = 0; i < count; i++) {
+                    errors += (unsigned char)mem[i] != next_read++;
+                }
+                used -= count;
+                break;
+            case 4:
+                count = ringbuf_reserve(buf, &region);
+                count = count ? rand() % (count + 1) : 0;
+                for (int i = 0; i < count; i++) {
+                    region[i] = next_write++;
+                }
+                errors += ringbuf_commit(buf, count) != 0;
+                used += count;
+                break;
+            case 5:
+                count = ringbuf_peek_contiguous(buf, &region);
+                count = count ? rand() % (count + 1) : 0;
+                for (int i = 0; i < count; i++) {
+                    errors += (unsigned char)region[i] != next_read++;
+                }
+                errors += ringbuf_consume(buf, count) != 0;
+                used -= count;
+                break;
+        }
+
+        errors += ringbuf_size(buf) != used;
+    }
+
+    CHECK_EQ(errors, 0);
+}
+
+void test_ringbuf(void) {
+    ringbuf_t buf;
+    ringbuf_t small;
+    char byte;
+
+    stub_reset();
+
+    CHECK_EQ(ringbuf_init(&buf, 0), 0);
+    CHECK_EQ(ringbuf_capacity(&buf), RINGBUF_SIZE);
+    CHECK(ringbuf_is_empty(&buf));
+    CHECK_EQ(ringbuf_read(&buf, &byte), -1);
+
+    // Capacities round up to a power of two
+    CHECK_EQ(ringbuf_init(&small, 100), 0);
+    CHECK_EQ(ringbuf_capacity(&small), 128);
+
+    // Writes that do not fit are rejected whole
+    char fill[128] = {0};
+    CHECK_EQ(ringbuf_write_mem(&small, fill, 100), 0);
+    CHECK_EQ(ringbuf_write_mem(&small, fill, 29), -1);
+    CHECK_EQ(ringbuf_write_mem(&small, fill, 28), 0);
+    CHECK(ringbuf_is_full(&small));
+    CHECK_EQ(ringbuf_commit(&small, 1), -1);
+
+    // Flush discards everything and keeps the buffer usable
+    CHECK_EQ(ringbuf_flush(&small), 0);
+    CHECK(ringbuf_is_empty(&small));
+    CHECK_EQ(ringbuf_consume(&small, 1), -1);
+
+    test_ringbuf_random(&buf);
+    test_ringbuf_random(&small);
+
+    // Destroyed buffers give their data back for reuse
+    char *data = small.data;
+    CHECK_EQ(ringbuf_destroy(&small), 0);
+    CHECK_EQ(ringbuf_write(&small, 'x'), -1);
+    CHECK_EQ(ringbuf_init(&small, 128), 0);
+    CHECK(small.data == data);
+
+    ringbuf_destroy(&small);
+    ringbuf_destroy(&buf);
+}
+
+void bench_ringbuf(void) {
+    static char src[RINGBUF_SIZE];
+    static char dst[RINGBUF_SIZE];
+    ringbuf_t buf;
+    int sizes[] = { 1, 64, 2048 };
+
+    stub_reset();
+    ringbuf_init(&buf, 0);
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s];
+        char name[64];
+
+        snprintf(name, sizeof(name), "ringbuf write+read_mem %4d bytes", size);
+        BENCH(name, 20000000 / size, {
+            ringbuf_write_mem(&buf, src, size);
+            harness_sink += ringbuf_read_mem(&buf, dst, size);
+        });
+    }
+
+    BENCH("ringbuf write+read 1 byte", 10000000, {
+        ringbuf_write(&buf, (char)i);
+        ringbuf_read(&buf, dst);
+        harness_sink += dst[0];
+    });
+
+    ringbuf_destroy(&buf);
+}
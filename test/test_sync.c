@@ -0,0 +1,133 @@
+/**
+ * CPE/CSC 159 - Operating System Pragmatics
+ * California State University, Sacramento
+ *
+ * Mutex, semaphore and scheduler tests (with stubbed kernel services)
+ */
+#include "harness.h"
+#include "kernel.h"
+#include "kmutex.h"
+#include "ksem.h"
+#include "scheduler.h"
+#include "stubs.h"
+
+/**
+ * Round robin between runnable processes; idle only runs when nothing else can
+ */
+static void test_scheduler(void) {
+    stub_reset();
+    scheduler_run();
+    CHECK(active_proc == pid_to_proc(0));
+
+    proc_t *a = stub_proc_create(1);
+    proc_t *b = stub_proc_create(2);
+
+    scheduler_run();
+    CHECK(active_proc == a);
+    CHECK_EQ(a->state, ACTIVE);
+
+    // A process keeps the CPU until its time slice is used up
+    a->cpu_time = SCHEDULER_TIMESLICE;
+    scheduler_run();
+    CHECK(active_proc == b);
+    CHECK_EQ(a->state, IDLE);
+
+    // A sleeping process is skipped until enough ticks have passed
+    scheduler_sleep(b, 1);
+    scheduler_run();
+    CHECK(active_proc == a);
+    for (int i = 0; i < 100; i++) {
+        stub_timer_tick();
+    }
+    a->cpu_time = SCHEDULER_TIMESLICE;
+    scheduler_run();
+    CHECK(active_proc == b);
+
+    scheduler_remove(b);
+    scheduler_remove(a);
+    scheduler_run();
+    CHECK(active_proc == pid_to_proc(0));
+}
+
+/**
+ * Contended mutexes block the caller and hand ownership over on unlock
+ */
+static void test_kmutex(void) {
+    stub_reset();
+    kmutexes_init();
+
+    proc_t *a = stub_proc_create(1);
+    proc_t *b = stub_proc_create(2);
+    int mutex = kmutex_init();
+
+    CHECK(mutex >= 0);
+
+    scheduler_run();
+    CHECK(active_proc == a);
+    CHECK_EQ(kmutex_lock(mutex), 1);
+
+    // b blocks on the mutex that a holds
+    a->cpu_time = SCHEDULER_TIMESLICE;
+    scheduler_run();
+    CHECK(active_proc == b);
+    CHECK_EQ(kmutex_lock(mutex), 2);
+    CHECK_EQ(b->state, WAITING);
+    CHECK(active_proc == NULL);
+
+    // Unlocking wakes b and makes it the owner
+    scheduler_run();
+    CHECK(active_proc == a);
+    CHECK_EQ(kmutex_unlock(mutex), 1);
+    CHECK_EQ(b->state, IDLE);
+    CHECK_EQ(kmutex_destroy(mutex), -1);
+
+    a->cpu_time = SCHEDULER_TIMESLICE;
+    scheduler_run();
+    CHECK(active_proc == b);
+    CHECK_EQ(kmutex_unlock(mutex), 0);
+    CHECK_EQ(kmutex_destroy(mutex), 0);
+    CHECK_EQ(kmutex_destroy(mutex), -1);
+
+    // Every mutex can be allocated, then allocation fails
+    for (int i = 0; i < MUTEX_MAX; i++) {
+        CHECK_EQ(kmutex_init(), i);
+    }
+    CHECK_EQ(kmutex_init(), -1);
+}
+
+/**
+ * Semaphore waits block at zero and posts release waiters in order
+ */
+static void test_ksem(void) {
+    stub_reset();
+    ksemaphores_init();
+
+    proc_t *a = stub_proc_create(1);
+    proc_t *b = stub_proc_create(2);
+    int sem = ksem_init(1);
+
+    CHECK(sem >= 0);
+
+    scheduler_run();
+    CHECK(active_proc == a);
+    CHECK_EQ(ksem_wait(sem), 0);
+    CHECK_EQ(a->state, ACTIVE);
+
+    a->cpu_time = SCHEDULER_TIMESLICE;
+    scheduler_run();
+    CHECK(active_proc == b);
+    CHECK_EQ(ksem_wait(sem), 0);
+    CHECK_EQ(b->state, WAITING);
+
+    scheduler_run();
+    CHECK(active_proc == a);
+    CHECK_EQ(ksem_post(sem), 0);
+    CHECK_EQ(b->state, IDLE);
+    CHECK_EQ(ksem_post(sem), 1);
+}
+
+void test_sync(void) {
+    test_scheduler();
+    test_kmutex();
+    test_ksem();
+}